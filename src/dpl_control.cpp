@@ -42,7 +42,7 @@
  */
 DplControl::DplControl() :
     configuration_file_path_(), log_file_path_(), image_path_(), camera_model_(0), camera_enabled_(false),  draw_min_distance_(0.0), draw_max_distance_(0.0),
-    is_draw_outside_bounds_(false), isc_image_info_(), isc_data_proc_result_data_(), camera_parameter_(), isc_dpl_configuration_(), isc_dpl_(nullptr), isc_start_mode_(),
+    is_draw_outside_bounds_(false), pcl_lod_mode_(0), pcl_lod_step_(1), pcl_output_frame_(0), pcl_extrinsic_(), isc_image_info_(), isc_data_proc_result_data_(), camera_parameter_(), isc_dpl_configuration_(), isc_dpl_(nullptr), isc_start_mode_(),
     disp_color_map_distance_(), disp_color_map_disparity_(), max_disparity_(0.0)
 {
 
@@ -81,6 +81,10 @@ bool DplControl::Initialize(const wchar_t* module_path)
     draw_min_distance_ = dpl_config.GetDrawMinDistance();
     draw_max_distance_ = dpl_config.GetDrawMaxDistance();
     is_draw_outside_bounds_ = dpl_config.IsDrawOutsideBounds();
+    pcl_lod_mode_ = dpl_config.GetPclLodMode();
+    pcl_lod_step_ = dpl_config.GetPclLodStep();
+    pcl_output_frame_ = dpl_config.GetPclOutputFrame();
+    dpl_config.GetPclExtrinsic(pcl_extrinsic_);
 
 	// open library
 	isc_dpl_ = new ns_isc_dpl::IscDpl;
@@ -138,7 +142,7 @@ bool DplControl::Initialize(const wchar_t* module_path)
 		isc_dpl_->DeviceGetOption(IscCameraInfo::kBaseLength, &camera_parameter_.b);
 		isc_dpl_->DeviceGetOption(IscCameraInfo::kBF, &camera_parameter_.bf);
 		isc_dpl_->DeviceGetOption(IscCameraInfo::kDINF, &camera_parameter_.dinf);
-		camera_parameter_.setup_angle = 0;
+		camera_parameter_.setup_angle = (float)dpl_config.GetCameraSetupAngle();
 	
         if (isc_dpl_configuration_.enabled_camera) {
             // information
@@ -161,7 +165,7 @@ bool DplControl::Initialize(const wchar_t* module_path)
             camera_parameter_.b = 0.1F;
             camera_parameter_.bf = 60.0F;
             camera_parameter_.dinf = 2.01F;
-            camera_parameter_.setup_angle = 0.0F;
+            camera_parameter_.setup_angle = (float)dpl_config.GetCameraSetupAngle();
         }
 
     }
@@ -340,6 +344,92 @@ double DplControl::GetDrawMaxDistance() const
     return draw_max_distance_;
 }
 
+/**
+ * 3D表示のLODを返します.
+ *
+ * @retval 0:off 1:stride 2:block average 3:block min disparity
+ *
+ */
+int DplControl::GetPclLodMode() const
+{
+    return pcl_lod_mode_;
+}
+
+/**
+ * 3D表示のLODのブロックの大きさを返します.
+ *
+ * @retval ブロックの大きさ(pixel)
+ *
+ */
+int DplControl::GetPclLodStep() const
+{
+    return pcl_lod_step_;
+}
+
+/**
+ * 3D表示のLODを設定し、設定ファイルへ保存します.
+ *
+ * @param[in] mode 0:off 1:stride 2:block average 3:block min disparity
+ * @param[in] step ブロックの大きさ(pixel)
+ *
+ * @return none.
+ */
+void DplControl::SetPclLod(const int mode, const int step)
+{
+    DplGuiConfiguration dpl_config;
+    if (!dpl_config.Load(configuration_file_path_)) {
+        return;
+    }
+
+    dpl_config.SetPclLodMode(mode);
+    dpl_config.SetPclLodStep(step);
+    dpl_config.Save();
+
+    pcl_lod_mode_ = dpl_config.GetPclLodMode();
+    pcl_lod_step_ = dpl_config.GetPclLodStep();
+
+    return;
+}
+
+/**
+ * 3D表示の座標系を返します.
+ *
+ * @retval 0:camera 1:ROS 2:Unity 3:extrinsic
+ *
+ */
+int DplControl::GetPclOutputFrame() const
+{
+    return pcl_output_frame_;
+}
+
+/**
+ * 3D表示の外部パラメータを返します.
+ *
+ * @param[out] extrinsic 4x4 row major カメラ座標系から出力座標系への変換
+ *
+ * @return none.
+ *
+ */
+void DplControl::GetPclExtrinsic(double* extrinsic) const
+{
+    for (int i = 0; i < 16; i++) {
+        extrinsic[i] = pcl_extrinsic_[i];
+    }
+
+    return;
+}
+
+/**
+ * カメラ設置角度を返します.
+ *
+ * @retval カメラ設置角度(度) x軸回り 上向きが正
+ *
+ */
+double DplControl::GetCameraSetupAngle() const
+{
+    return camera_parameter_.setup_angle;
+}
+
 /**
  * ライブラリ isc-dpl　のポインタを返します.
  *
@@ -910,15 +1000,24 @@ bool DplControl::MakeDepthColorImage(   const bool is_color_by_distance, const b
     const double b = b_i;
     const double dinf = dinf_i;
     const double rad = angle_i * pi / 180.0;
+    const double cos_angle = cos(rad);
+    const double sin_angle = sin(rad);
     const double color_map_step_mag = 1.0 / disp_color_map->color_map_step;
 
     if (is_color_by_distance) {
         // 距離変換
+        // tilt: za = -yh * sin + z * cos = (bf * cos - row_y * sin) / d, yh = row_y / d
+        // the numerator depends on the row only, so the cost per pixel is the same as without tilt
+        // the data is upside down (rotated 180 degrees), row_y is the same as the 3D projection
+        const int yc = height / 2;
 
         for (int i = 0; i < height; i++) {
             float* src = depth + (i * width);
             unsigned char* dst = bgra_image + (i * width * 4);
 
+            const double row_y = b * (yc - ((height - 1) - i));
+            const double za_numerator = (bf * cos_angle) - (row_y * sin_angle);
+
             for (int j = 0; j < width; j++) {
                 int r = 0, g = 0, b = 0;
                 if (*src <= dinf) {
@@ -930,13 +1029,7 @@ bool DplControl::MakeDepthColorImage(   const bool is_color_by_distance, const b
                     double d = (*src - dinf);
                     double za = max_length_i;
                     if (d > 0) {
-#if 0
-                        double yh = (b * (i - (height / 2))) / d;
-                        double z = bf / d;
-                        za = -1 * yh * sin(rad) + z * cos(rad);
-#else
-                        za = bf / d;
-#endif
+                        za = za_numerator / d;
                     }
 
                     if (is_draw_outside_bounds) {
@@ -91,6 +91,36 @@ public:
 	 */
 	double GetDrawMaxDistance() const;
 
+	/** @brief Returns the level of detail for 3D display.
+		@return 0:off 1:stride 2:block average 3:block min disparity.
+	 */
+	int GetPclLodMode() const;
+
+	/** @brief Returns the block size of the level of detail for 3D display.
+		@return block size (pixels).
+	 */
+	int GetPclLodStep() const;
+
+	/** @brief Sets the level of detail for 3D display and saves it to the configuration file.
+		@return none.
+	 */
+	void SetPclLod(const int mode, const int step);
+
+	/** @brief Returns the coordinate frame for 3D display.
+		@return 0:camera 1:ROS 2:Unity 3:extrinsic.
+	 */
+	int GetPclOutputFrame() const;
+
+	/** @brief Returns the extrinsic for 3D display (camera frame to output frame).
+		@return none.
+	 */
+	void GetPclExtrinsic(double* extrinsic) const;
+
+	/** @brief Returns the camera setup angle.
+		@return tilt (degree) around the x axis, upward is positive.
+	 */
+	double GetCameraSetupAngle() const;
+
 	/** @brief Returns a pointer to the library isc-dpl.
 		@return iscDpl object pointer.
 	 */
@@ -152,6 +182,9 @@ private:
 	bool camera_enabled_;							/**< Camera enabled. */
 	double draw_min_distance_, draw_max_distance_;	/**< Minimum and maximum distances to draw */
 	bool is_draw_outside_bounds_;					/**< Draws outside the specified area */
+	int pcl_lod_mode_, pcl_lod_step_;				/**< Level of detail for 3D display */
+	int pcl_output_frame_;							/**< Coordinate frame for 3D display */
+	double pcl_extrinsic_[16];						/**< Extrinsic for 3D display (4x4 row major) */
 
 	IscImageInfo isc_image_info_;						/**< image buffer */
 	IscDataProcResultData isc_data_proc_result_data_;	/**< Data processing results */
@@ -26,6 +26,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "pcl_def.h"
+
 #include "dpl_gui_configuration.h"
 
 /**
@@ -41,10 +43,15 @@ DplGuiConfiguration::DplGuiConfiguration():
 	enabled_camera_(false),
 	camera_model_(0),
 	data_record_path_(),
+	camera_setup_angle_(0),
 	enabled_data_proc_library_(false),
 	draw_min_distance_(0),
 	draw_max_distance_(10.0),
 	draw_outside_bounds_(true),
+	pcl_lod_mode_(0),
+	pcl_lod_step_(2),
+	pcl_output_frame_(0),
+	pcl_extrinsic_(),
 	max_disparity_(255)
 {
 
@@ -89,6 +96,7 @@ bool DplGuiConfiguration::Load(const wchar_t* file_path)
 		ENABLED=0
 		CAMERA_MODEL=0		;0:VM 1:XC 2:4K 3:4KA 4:4KJ
 		DATA_RECORD_PATH=c:\temp
+		SETUP_ANGLE=0		;camera tilt (degree) around the x axis, upward is positive
 
 
 		[DATA_PROC_MODULES]
@@ -100,6 +108,10 @@ bool DplGuiConfiguration::Load(const wchar_t* file_path)
 		MIN_DISTANCE=0
 		MAX_DISTANCE=10
 		DRAW_OUTSIDE_BOUNDS=1
+		PCL_LOD_MODE=0		;0:off 1:stride 2:block average 3:block min disparity
+		PCL_LOD_STEP=2		;block size (pixels) 2 - 8
+		PCL_OUTPUT_FRAME=0	;0:camera 1:ROS 2:Unity 3:extrinsic
+		PCL_EXTRINSIC=1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1	;4x4 row major, camera frame to output frame
 
 	*/
 	
@@ -126,6 +138,12 @@ bool DplGuiConfiguration::Load(const wchar_t* file_path)
 	GetPrivateProfileStringW(L"CAMERA", L"DATA_RECORD_PATH", L"c:\\temp", returned_string, sizeof(returned_string) / sizeof(wchar_t), configuration_file_name_);
 	swprintf_s(data_record_path_, L"%s", returned_string);
 
+	GetPrivateProfileStringW(L"CAMERA", L"SETUP_ANGLE", L"0", returned_string, sizeof(returned_string) / sizeof(wchar_t), configuration_file_name_);
+	camera_setup_angle_ = _wtof(returned_string);
+	if (camera_setup_angle_ < -90.0 || camera_setup_angle_ > 90.0) {
+		camera_setup_angle_ = 0;
+	}
+
 	if (camera_model_ == 0) {
 		// 0:VM
 		max_disparity_ = 127.0;
@@ -179,6 +197,40 @@ bool DplGuiConfiguration::Load(const wchar_t* file_path)
 	temp_value = _wtoi(returned_string);
 	draw_outside_bounds_ = temp_value == 1 ? true : false;
 
+	// 3D level of detail
+	// 4K cameras default to stride, the full resolution is too heavy for 3D display at camera rate
+	const bool is_4k_camera = (camera_model_ == 2 || camera_model_ == 3 || camera_model_ == 4);
+
+	GetPrivateProfileStringW(L"DRAW", L"PCL_LOD_MODE", is_4k_camera ? L"1" : L"0", returned_string, sizeof(returned_string) / sizeof(wchar_t), configuration_file_name_);
+	pcl_lod_mode_ = _wtoi(returned_string);
+	if (pcl_lod_mode_ < 0 || pcl_lod_mode_ > 3) {
+		pcl_lod_mode_ = 0;
+	}
+
+	GetPrivateProfileStringW(L"DRAW", L"PCL_LOD_STEP", is_4k_camera ? L"4" : L"2", returned_string, sizeof(returned_string) / sizeof(wchar_t), configuration_file_name_);
+	pcl_lod_step_ = _wtoi(returned_string);
+	if (pcl_lod_step_ < kPCL_LOD_STEP_MIN || pcl_lod_step_ > kPCL_LOD_STEP_MAX) {
+		pcl_lod_step_ = is_4k_camera ? 4 : 2;
+	}
+
+	// 3D coordinate frame
+	GetPrivateProfileStringW(L"DRAW", L"PCL_OUTPUT_FRAME", L"0", returned_string, sizeof(returned_string) / sizeof(wchar_t), configuration_file_name_);
+	pcl_output_frame_ = _wtoi(returned_string);
+	if (pcl_output_frame_ < 0 || pcl_output_frame_ > 3) {
+		pcl_output_frame_ = 0;
+	}
+
+	GetPrivateProfileStringW(L"DRAW", L"PCL_EXTRINSIC", L"1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1", returned_string, sizeof(returned_string) / sizeof(wchar_t), configuration_file_name_);
+	double* e = pcl_extrinsic_;
+	int read_count = swscanf_s(returned_string, L"%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+		&e[0], &e[1], &e[2], &e[3], &e[4], &e[5], &e[6], &e[7], &e[8], &e[9], &e[10], &e[11], &e[12], &e[13], &e[14], &e[15]);
+	if (read_count != 16) {
+		// error, identity
+		for (int i = 0; i < 16; i++) {
+			pcl_extrinsic_[i] = (i % 5 == 0) ? 1.0 : 0.0;
+		}
+	}
+
 
 	// for 4K
 	// 4Kカメラは、データ処理ライブラリの対象外です
@@ -238,6 +290,9 @@ bool DplGuiConfiguration::Save()
 
 	WritePrivateProfileStringW(L"CAMERA", L"DATA_RECORD_PATH", data_record_path_, configuration_file_name_);
 
+	swprintf_s(write_string, L"%.3f", camera_setup_angle_);
+	WritePrivateProfileStringW(L"CAMERA", L"SETUP_ANGLE", write_string, configuration_file_name_);
+
 	// [DATA_PROC_MODULES]
 	swprintf_s(write_string, L"%d", enabled_data_proc_library_ ? 1 : 0);
 	WritePrivateProfileStringW(L"DATA_PROC_MODULES", L"ENABLED", write_string, configuration_file_name_);
@@ -252,6 +307,21 @@ bool DplGuiConfiguration::Save()
 	swprintf_s(write_string, L"%d", (int)draw_outside_bounds_);
 	WritePrivateProfileStringW(L"DRAW", L"DRAW_OUTSIDE_BOUNDS", write_string, configuration_file_name_);
 
+	swprintf_s(write_string, L"%d", pcl_lod_mode_);
+	WritePrivateProfileStringW(L"DRAW", L"PCL_LOD_MODE", write_string, configuration_file_name_);
+
+	swprintf_s(write_string, L"%d", pcl_lod_step_);
+	WritePrivateProfileStringW(L"DRAW", L"PCL_LOD_STEP", write_string, configuration_file_name_);
+
+	swprintf_s(write_string, L"%d", pcl_output_frame_);
+	WritePrivateProfileStringW(L"DRAW", L"PCL_OUTPUT_FRAME", write_string, configuration_file_name_);
+
+	wchar_t extrinsic_string[512] = {};
+	const double* e = pcl_extrinsic_;
+	swprintf_s(extrinsic_string, L"%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g",
+		e[0], e[1], e[2], e[3], e[4], e[5], e[6], e[7], e[8], e[9], e[10], e[11], e[12], e[13], e[14], e[15]);
+	WritePrivateProfileStringW(L"DRAW", L"PCL_EXTRINSIC", extrinsic_string, configuration_file_name_);
+
 	return true;
 }
 
@@ -390,6 +460,32 @@ void DplGuiConfiguration::SetDataRecordPath(const wchar_t* path)
 	return;
 }
 
+/**
+ * 設定ファイルより設定を読み込み
+ *
+ * @param[in] カメラ設置角度(度) x軸回り 上向きが正
+ * @param[out] paramB 第一引数の説明
+ * @return int 戻り値の説明
+ */
+double DplGuiConfiguration::GetCameraSetupAngle() const
+{
+	return camera_setup_angle_;
+}
+
+/**
+ * 設定ファイルより設定を読み込み
+ *
+ * @param[in] カメラ設置角度(度) x軸回り 上向きが正
+ * @param[out] paramB 第一引数の説明
+ * @return int 戻り値の説明
+ */
+void DplGuiConfiguration::SetCameraSetupAngle(const double angle)
+{
+	camera_setup_angle_ = angle;
+
+	return;
+}
+
 
 /**
  * 設定ファイルより設定を読み込み
@@ -504,5 +600,111 @@ void DplGuiConfiguration::SetDrawOutsideBounds(const bool enabled)
 {
 	draw_outside_bounds_ = enabled;
 
+	return;
+}
+
+/**
+ * 3D表示のLODを返します.
+ *
+ * @retval 0:off 1:stride 2:block average 3:block min disparity
+ */
+int DplGuiConfiguration::GetPclLodMode() const
+{
+	return pcl_lod_mode_;
+}
+
+/**
+ * 3D表示のLODを設定します. 範囲外の場合は off とします.
+ *
+ * @param[in] mode 0:off 1:stride 2:block average 3:block min disparity
+ *
+ * @return none.
+ */
+void DplGuiConfiguration::SetPclLodMode(const int mode)
+{
+	pcl_lod_mode_ = (mode < 0 || mode > 3) ? 0 : mode;
+
+	return;
+}
+
+/**
+ * 3D表示のLODのブロックの大きさを返します.
+ *
+ * @retval ブロックの大きさ(pixel) kPCL_LOD_STEP_MIN - kPCL_LOD_STEP_MAX
+ */
+int DplGuiConfiguration::GetPclLodStep() const
+{
+	return pcl_lod_step_;
+}
+
+/**
+ * 3D表示のLODのブロックの大きさを設定します. 範囲外の場合は範囲内に丸めます.
+ *
+ * @param[in] step ブロックの大きさ(pixel) kPCL_LOD_STEP_MIN - kPCL_LOD_STEP_MAX
+ *
+ * @return none.
+ */
+void DplGuiConfiguration::SetPclLodStep(const int step)
+{
+	pcl_lod_step_ = (step < kPCL_LOD_STEP_MIN) ? kPCL_LOD_STEP_MIN : ((step > kPCL_LOD_STEP_MAX) ? kPCL_LOD_STEP_MAX : step);
+
+	return;
+}
+
+/**
+ * 設定ファイルより設定を読み込み
+ *
+ * @param[in] 3D表示の座標系 0:camera 1:ROS 2:Unity 3:extrinsic
+ * @param[out] paramB 第一引数の説明
+ * @return int 戻り値の説明
+ */
+int DplGuiConfiguration::GetPclOutputFrame() const
+{
+	return pcl_output_frame_;
+}
+
+/**
+ * 設定ファイルより設定を読み込み
+ *
+ * @param[in] 3D表示の座標系 0:camera 1:ROS 2:Unity 3:extrinsic
+ * @param[out] paramB 第一引数の説明
+ * @return int 戻り値の説明
+ */
+void DplGuiConfiguration::SetPclOutputFrame(const int frame)
+{
+	pcl_output_frame_ = frame;
+
+	return;
+}
+
+/**
+ * 設定ファイルより設定を読み込み
+ *
+ * @param[in] 3D表示の外部パラメータ (4x4 row major) カメラ座標系から出力座標系への変換
+ * @param[out] paramB 第一引数の説明
+ * @return int 戻り値の説明
+ */
+void DplGuiConfiguration::GetPclExtrinsic(double* extrinsic) const
+{
+	for (int i = 0; i < 16; i++) {
+		extrinsic[i] = pcl_extrinsic_[i];
+	}
+
+	return;
+}
+
+/**
+ * 設定ファイルより設定を読み込み
+ *
+ * @param[in] 3D表示の外部パラメータ (4x4 row major) カメラ座標系から出力座標系への変換
+ * @param[out] paramB 第一引数の説明
+ * @return int 戻り値の説明
+ */
+void DplGuiConfiguration::SetPclExtrinsic(const double* extrinsic)
+{
+	for (int i = 0; i < 16; i++) {
+		pcl_extrinsic_[i] = extrinsic[i];
+	}
+
 	return;
 }
\ No newline at end of file
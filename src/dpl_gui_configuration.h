@@ -46,6 +46,8 @@ public:
 	void SetCameraModel(const int model);
 	bool GetDataRecordPath(wchar_t* path, const int max_length) const;
 	void SetDataRecordPath(const wchar_t* path);
+	double GetCameraSetupAngle() const;
+	void SetCameraSetupAngle(const double angle);
 	
 	bool IsEnabledDataProcLib() const;
 	void SetEnabledDataProcLib(const bool enabled);
@@ -58,6 +60,15 @@ public:
 	bool IsDrawOutsideBounds() const;
 	void SetDrawOutsideBounds(const bool enabled);
 
+	int GetPclLodMode() const;
+	void SetPclLodMode(const int mode);
+	int GetPclLodStep() const;
+	void SetPclLodStep(const int step);
+	int GetPclOutputFrame() const;
+	void SetPclOutputFrame(const int frame);
+	void GetPclExtrinsic(double* extrinsic) const;
+	void SetPclExtrinsic(const double* extrinsic);
+
 private:
 
 	bool successfully_loaded_;					/**< Configuration successfully loaded. */
@@ -71,6 +82,7 @@ private:
 	bool enabled_camera_;						/**< camera-enabled */
 	int camera_model_;							/**< Camera type 0:VM 1:XC 2:4K 3:4KA 4:4KJ */
 	wchar_t data_record_path_[_MAX_PATH];		/**< Data Storage Destination */
+	double camera_setup_angle_;					/**< Camera tilt (degree) around the x axis, upward is positive */
 
 	bool enabled_data_proc_library_;			/**< Data Processing Module Enabled */
 
@@ -78,6 +90,11 @@ private:
 	double draw_max_distance_;					/**< Maximum display distance */
 	bool draw_outside_bounds_;					/**< Draw outside the minimum to maximum display */
 
+	int pcl_lod_mode_;							/**< 3D level of detail 0:off 1:stride 2:block average 3:block min disparity */
+	int pcl_lod_step_;							/**< 3D level of detail block size (pixels) */
+	int pcl_output_frame_;						/**< 3D coordinate frame 0:camera 1:ROS 2:Unity 3:extrinsic */
+	double pcl_extrinsic_[16];					/**< 3D extrinsic (4x4 row major) camera frame to output frame */
+
 	double max_disparity_;						/**< maximum parallax value */
 
 };
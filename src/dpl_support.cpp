@@ -86,6 +86,7 @@ int InitializeDplControl(const wchar_t* module_path, ImageState* image_state)
 
 		return -1;
 	}
+	image_state->angle = image_state->dpl_control->GetCameraSetupAngle();
 
 	if (image_state->width != 0 && image_state->height != 0) {
 		image_state->bgra_image = new unsigned char[image_state->width * image_state->height * 4];
@@ -185,6 +186,78 @@ double GetDrawMaxDistance(ImageState* image_state)
 	return image_state->dpl_control->GetDrawMaxDistance();
 }
 
+/**
+ * 3D表示のLODを返します.
+ *
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ *
+ * @retval 0:off 1:stride 2:block average 3:block min disparity
+ *
+ */
+int GetPclLodMode(ImageState* image_state)
+{
+	return image_state->dpl_control->GetPclLodMode();
+}
+
+/**
+ * 3D表示のLODのブロックの大きさを返します.
+ *
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ *
+ * @retval ブロックの大きさ(pixel)
+ *
+ */
+int GetPclLodStep(ImageState* image_state)
+{
+	return image_state->dpl_control->GetPclLodStep();
+}
+
+/**
+ * 3D表示のLODを設定し、設定ファイルへ保存します.
+ *
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ * @param[in] mode 0:off 1:stride 2:block average 3:block min disparity
+ * @param[in] step ブロックの大きさ(pixel)
+ *
+ * @return none.
+ *
+ */
+void SetPclLod(ImageState* image_state, const int mode, const int step)
+{
+	image_state->dpl_control->SetPclLod(mode, step);
+
+	return;
+}
+
+/**
+ * 3D表示の座標系を返します.
+ *
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ *
+ * @retval 0:camera 1:ROS 2:Unity 3:extrinsic
+ *
+ */
+int GetPclOutputFrame(ImageState* image_state)
+{
+	return image_state->dpl_control->GetPclOutputFrame();
+}
+
+/**
+ * 3D表示の外部パラメータを返します.
+ *
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ * @param[out] extrinsic 4x4 row major カメラ座標系から出力座標系への変換
+ *
+ * @return none.
+ *
+ */
+void GetPclExtrinsic(ImageState* image_state, double* extrinsic)
+{
+	image_state->dpl_control->GetPclExtrinsic(extrinsic);
+
+	return;
+}
+
 /**
  * 取り込みを開始する.
  *
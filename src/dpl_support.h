@@ -69,6 +69,31 @@ double GetDrawMinDistance(ImageState* image_state);
  */
 double GetDrawMaxDistance(ImageState* image_state);
 
+/** @brief Returns the level of detail for 3D display.
+	@return 0:off 1:stride 2:block average 3:block min disparity.
+ */
+int GetPclLodMode(ImageState* image_state);
+
+/** @brief Returns the block size of the level of detail for 3D display.
+	@return block size (pixels).
+ */
+int GetPclLodStep(ImageState* image_state);
+
+/** @brief Sets the level of detail for 3D display and saves it to the configuration file.
+	@return none.
+ */
+void SetPclLod(ImageState* image_state, const int mode, const int step);
+
+/** @brief Returns the coordinate frame for 3D display.
+	@return 0:camera 1:ROS 2:Unity 3:extrinsic.
+ */
+int GetPclOutputFrame(ImageState* image_state);
+
+/** @brief Returns the extrinsic for 3D display (4x4 row major, camera frame to output frame).
+	@return none.
+ */
+void GetPclExtrinsic(ImageState* image_state, double* extrinsic);
+
 /** @brief Start capturing.
 	@return 0, if successful.
  */
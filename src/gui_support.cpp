@@ -30,6 +30,10 @@
 #include <sstream>
 #include <vector>
 #include <iostream>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <utility>
 
 #include "opencv2/opencv.hpp"
 
@@ -45,6 +49,8 @@
 #include "dpl_support.h"
 #include "pcl_def.h"
 #include "pcl_support.h"
+#include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
 
 #include "gui_support.h"
 #include "win_support.h"
@@ -185,6 +191,38 @@ struct ImageDataBuffers {
 };
 ImageDataBuffers image_buffers_ = {};   /**< 作業用バッファー */
 
+// 
+// frames for the 3D view
+// 
+/** 3D表示に渡すフレームの数 (書き込み中 + フレームバッファーの保持する3つ + Ringの保持するフレーム + 各Consumerが読み出し中のフレーム) */
+constexpr int kPCL_FRAME_COUNT = 1 + 3 + kPCL_FRAME_RING_DEPTH + kPCL_FRAME_CONSUMER_MAX;
+
+/** @struct  PclFrameBuffers
+ *  @brief 3D表示に渡すフレームの画像. ImageState と同じ方法で確保し、ImageState と入れ替えます
+ */
+struct PclFrameBuffers {
+    IscImageInfo isc_image_Info;
+    IscDataProcResultData isc_data_proc_result_data;
+    unsigned char* bgra_image;
+};
+
+/** @struct  PclFrameOwnedBuffers
+ *  @brief 確保した時の画像. 入れ替えた画像は解放の前に確保した側に戻します
+ */
+struct PclFrameOwnedBuffers {
+    IscImageInfo::FrameData camera_frame_data;
+    IscImageInfo::FrameData data_proc_frame_data;
+    unsigned char* bgra_image;
+};
+PclFrameBuffers pcl_frame_buffers_[kPCL_FRAME_COUNT] = {};                  /**< 各フレームの画像 */
+PclFrameOwnedBuffers pcl_frame_owned_buffers_[kPCL_FRAME_COUNT] = {};       /**< 各フレームが確保した画像 */
+PclFrameOwnedBuffers pcl_frame_image_state_owned_buffers_ = {};             /**< ImageState が確保した画像 */
+PclFramePool pcl_frame_pool_;                                               /**< 3D表示に渡すフレーム */
+DplControl* pcl_frame_dpl_control_ = nullptr;                               /**< pcl_frame_buffers_ を確保した DplControl */
+ImageState* pcl_frame_image_state_ = nullptr;                               /**< 画像を入れ替える ImageState */
+int pcl_frame_width_ = 0, pcl_frame_height_ = 0;                            /**< 画像の大きさ (ImageState と同じです) */
+long long pcl_frame_copy_count_ = 0;                                        /**< フレームを渡せずに画像をコピーした数 */
+
 // 
 // functions
 // 
@@ -193,6 +231,9 @@ int ProcedureControl(GuiControls& gui_control_previous, GuiControls& gui_control
 int DrawDplImages(GuiControls& gui_control_latest, ImageState* image_state, GLuint* texture, ImageDataBuffers* image_buffers);
 int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_control_start_mode_latest, ImageState* image_state, ImageDataBuffers* image_buffers,
                     PclVizInputArgs* input_args, PclVizOutputArgs* output_args);
+int InitializePclFrames(ImageState* image_state);
+int TerminatePclFrames();
+PclFrame* HandOverPclFrame(const bool is_data_processing, ImageState* image_state, const PclVizInputArgs* input_args);
 
 // 
 // implementations
@@ -267,13 +308,31 @@ GLFWwindow* InitializeWindow(InitializeWindowParameter* initialze_window_paramet
     gui_control_.pcl_filter_parameter.enabled_pass_through_filter                   = true;
     gui_control_.pcl_filter_parameter.pass_through_filter_range.min                 = std::max(0.1, initialze_window_parameter->dra_min_distance);
     gui_control_.pcl_filter_parameter.pass_through_filter_range.max                 = std::min(40.0, initialze_window_parameter->dra_max_distance);
+    gui_control_.pcl_filter_parameter.enabled_flying_pixel_filter                   = false;
+    gui_control_.pcl_filter_parameter.flying_pixel_filter_ratio                     = 0.05f;
+    gui_control_.pcl_filter_parameter.enabled_temporal_filter                       = false;
+    gui_control_.pcl_filter_parameter.temporal_filter_mode                          = 0;
+    gui_control_.pcl_filter_parameter.temporal_filter_alpha                         = 0.3f;
     gui_control_.pcl_filter_parameter.enabled_down_sampling                         = false;
     gui_control_.pcl_filter_parameter.down_sampling_boxel_size                      = 0.01f;
     gui_control_.pcl_filter_parameter.enabled_radius_outlier_removal                = false;
     gui_control_.pcl_filter_parameter.radius_outlier_removal_param.radius_search    = 0.15;
     gui_control_.pcl_filter_parameter.radius_outlier_removal_param.min_neighbors    = 100;
+    gui_control_.pcl_filter_parameter.radius_outlier_removal_param.exact            = false;
     gui_control_.pcl_filter_parameter.enabled_plane_detection                       = false;
     gui_control_.pcl_filter_parameter.plane_detection_threshold                     = 0.2;
+    gui_control_.pcl_filter_parameter.plane_detection_mode                          = 0;
+    gui_control_.pcl_filter_parameter.plane_detection_plane_count                   = 4;
+    gui_control_.pcl_filter_parameter.plane_detection_min_inliers                   = 1000;
+    gui_control_.pcl_filter_parameter.plane_detection_time_budget                   = 20.0f;
+    gui_control_.pcl_filter_parameter.enabled_normal_estimation                     = false;
+    gui_control_.pcl_filter_parameter.normal_estimation_window                      = 4;
+    gui_control_.pcl_filter_parameter.normal_estimation_color                       = true;
+    gui_control_.pcl_filter_parameter.enabled_quality_control                       = false;
+    gui_control_.pcl_filter_parameter.quality_control_budget                        = 33.0f;
+    gui_control_.pcl_filter_parameter.build_frames_in_flight                        = 2;
+    gui_control_.pcl_filter_parameter.lod_mode                                      = initialze_window_parameter->pcl_lod_mode;
+    gui_control_.pcl_filter_parameter.lod_step                                      = std::min(std::max(kPCL_LOD_STEP_MIN, initialze_window_parameter->pcl_lod_step), kPCL_LOD_STEP_MAX);
 
     input_args_;
     output_args_.pick_information.max_count = 4;
@@ -284,6 +343,12 @@ GLFWwindow* InitializeWindow(InitializeWindowParameter* initialze_window_paramet
         output_args_.pick_information.pick_data[i].y = 0.0f;
         output_args_.pick_information.pick_data[i].z = 0.0f;
     }
+    output_args_.quality_information.enabled = false;
+    output_args_.quality_information.level = 0;
+    output_args_.quality_information.frame_time = 0.0;
+    for (int i = 0; i < kPCL_FILTER_STAGE_COUNT; i++) {
+        output_args_.stage_information[i] = {};
+    }
 
     // initialize buufer
     image_buffers_.max_width = initialze_window_parameter->max_width;
@@ -406,6 +471,8 @@ int TerminateWindow()
         image_buffers_.draw_image[i].image = nullptr;
     }
 
+    TerminatePclFrames();
+
     return 0;
 }
 
@@ -539,6 +606,12 @@ int InitializeWindowCameraControl(const bool is_update, ImageState* image_state)
 
     }
 
+    // the images of the 3D view are exchanged with these buffers
+    int ret = InitializePclFrames(image_state);
+    if (ret != 0) {
+        printf("[ERROR]InitializePclFrames faild, the images are copied to the 3D view\n");
+    }
+
     return 0;
 }
 
@@ -569,6 +642,12 @@ int DrawWindow(ImageState* image_state)
     memcpy(&gui_control_previous, &gui_control_, sizeof(GuiControls));
     int ret = DrawControl(gui_control_, image_state);
 
+    // the level of detail is kept in the configuration file
+    if (gui_control_previous.pcl_filter_parameter.lod_mode != gui_control_.pcl_filter_parameter.lod_mode ||
+        gui_control_previous.pcl_filter_parameter.lod_step != gui_control_.pcl_filter_parameter.lod_step) {
+        SetPclLod(image_state, gui_control_.pcl_filter_parameter.lod_mode, gui_control_.pcl_filter_parameter.lod_step);
+    }
+
     // camera control
     ret = ProcedureControl(gui_control_previous, gui_control_, dpl_control_start_mode_, image_state);
 
@@ -834,6 +913,26 @@ int DrawControl(GuiControls& gui_control, ImageState* image_state)
         if (ImGui::TreeNode("PCL Filter")) {
             //ImGui::Text("PCL Filter");
 
+            const char* lod_items[] = { "Off", "Stride", "Block Average", "Block Min Disparity" };
+            ImGui::Combo("Level of Detail", &gui_control.pcl_filter_parameter.lod_mode, lod_items, IM_ARRAYSIZE(lod_items));
+            if (gui_control.pcl_filter_parameter.lod_mode != 0) {
+                ImGui::SliderInt("Step(pixel)", &gui_control.pcl_filter_parameter.lod_step, kPCL_LOD_STEP_MIN, kPCL_LOD_STEP_MAX);
+            }
+
+            ImGui::Checkbox("Flying Pixel Filter", &gui_control.pcl_filter_parameter.enabled_flying_pixel_filter);
+            if (gui_control.pcl_filter_parameter.enabled_flying_pixel_filter) {
+                ImGui::SliderFloat("Depth Ratio", &gui_control.pcl_filter_parameter.flying_pixel_filter_ratio, 0.01f, 0.3f);
+            }
+
+            ImGui::Checkbox("Temporal Filter", &gui_control.pcl_filter_parameter.enabled_temporal_filter);
+            if (gui_control.pcl_filter_parameter.enabled_temporal_filter) {
+                const char* temporal_mode_items[] = { "EMA", "Median" };
+                ImGui::Combo("Temporal Mode", &gui_control.pcl_filter_parameter.temporal_filter_mode, temporal_mode_items, IM_ARRAYSIZE(temporal_mode_items));
+                if (gui_control.pcl_filter_parameter.temporal_filter_mode == 0) {
+                    ImGui::SliderFloat("Alpha", &gui_control.pcl_filter_parameter.temporal_filter_alpha, 0.05f, 1.0f);
+                }
+            }
+
             ImGui::Checkbox("Pass Through Filter", &gui_control.pcl_filter_parameter.enabled_pass_through_filter);
             if (gui_control.pcl_filter_parameter.enabled_pass_through_filter) {
 
@@ -842,6 +941,11 @@ int DrawControl(GuiControls& gui_control, ImageState* image_state)
 
                 ImGui::SliderFloat("Min(m)", &gui_control.pcl_filter_parameter.pass_through_filter_range.min, min_distance, max_distance);
                 ImGui::SliderFloat("Max(m)", &gui_control.pcl_filter_parameter.pass_through_filter_range.max, min_distance, max_distance);
+
+                // the range is culled by the builder on the camera depth, whatever the output frame is
+                if (GetPclOutputFrame(image_state) != 0) {
+                    ImGui::Text("  Range is the camera distance, not the output Z");
+                }
             }
 
             ImGui::Checkbox("Down Sampling", &gui_control.pcl_filter_parameter.enabled_down_sampling);
@@ -855,6 +959,7 @@ int DrawControl(GuiControls& gui_control, ImageState* image_state)
                 ImGui::SliderFloat("Radius (m)", &temp_value, 0.01f, 0.5f);
                 gui_control.pcl_filter_parameter.radius_outlier_removal_param.radius_search = temp_value;
                 ImGui::SliderInt("Min Neighbors", &gui_control.pcl_filter_parameter.radius_outlier_removal_param.min_neighbors, 2, 1000);
+                ImGui::Checkbox("Exact (KdTree)", &gui_control.pcl_filter_parameter.radius_outlier_removal_param.exact);
             }
 
             ImGui::Checkbox("Plane Detection", &gui_control.pcl_filter_parameter.enabled_plane_detection);
@@ -862,6 +967,45 @@ int DrawControl(GuiControls& gui_control, ImageState* image_state)
                 float temp_value = (float)gui_control.pcl_filter_parameter.plane_detection_threshold;
                 ImGui::SliderFloat("Threshold", &temp_value, 0.1f, 0.9f);
                 gui_control.pcl_filter_parameter.plane_detection_threshold = temp_value;
+
+                const char* plane_mode_items[] = { "Single", "Multi" };
+                ImGui::Combo("Plane Mode", &gui_control.pcl_filter_parameter.plane_detection_mode, plane_mode_items, IM_ARRAYSIZE(plane_mode_items));
+                if (gui_control.pcl_filter_parameter.plane_detection_mode != 0) {
+                    ImGui::SliderInt("Max Planes", &gui_control.pcl_filter_parameter.plane_detection_plane_count, 2, 8);
+                    ImGui::SliderInt("Min Points", &gui_control.pcl_filter_parameter.plane_detection_min_inliers, 100, 100000);
+                    ImGui::SliderFloat("Budget(ms)", &gui_control.pcl_filter_parameter.plane_detection_time_budget, 1.0f, 100.0f);
+                }
+            }
+
+            ImGui::Checkbox("Normal Estimation", &gui_control.pcl_filter_parameter.enabled_normal_estimation);
+            if (gui_control.pcl_filter_parameter.enabled_normal_estimation) {
+                ImGui::SliderInt("Normal Window", &gui_control.pcl_filter_parameter.normal_estimation_window, 1, 16);
+                ImGui::Checkbox("Color by Normal", &gui_control.pcl_filter_parameter.normal_estimation_color);
+            }
+
+            ImGui::Checkbox("Auto Quality", &gui_control.pcl_filter_parameter.enabled_quality_control);
+            if (gui_control.pcl_filter_parameter.enabled_quality_control) {
+                ImGui::SliderFloat("Frame Budget(ms)", &gui_control.pcl_filter_parameter.quality_control_budget, 10.0f, 200.0f);
+                if (output_args_.quality_information.enabled) {
+                    ImGui::Text("Quality Level: %d (%.1f ms)", output_args_.quality_information.level, output_args_.quality_information.frame_time);
+                }
+            }
+
+            ImGui::SliderInt("Frames in Flight", &gui_control.pcl_filter_parameter.build_frames_in_flight, 1, 4);
+
+            // stages of the last frame, in the order of PclFilterPipeline::Stage
+            if (ImGui::TreeNode("Filter Stages")) {
+                const char* stage_names[kPCL_FILTER_STAGE_COUNT] = { "Build", "Down Sampling", "Outlier Removal", "Normal Estimation", "Plane Detection" };
+                for (int i = 0; i < kPCL_FILTER_STAGE_COUNT; i++) {
+                    const PclVizOutputArgs::StageInformation& stage_information = output_args_.stage_information[i];
+                    if (stage_information.cached) {
+                        ImGui::Text("%s: cached, %d points", stage_names[i], stage_information.output_count);
+                    }
+                    else if (stage_information.executed) {
+                        ImGui::Text("%s: %.1f ms, %d -> %d points", stage_names[i], stage_information.time, stage_information.input_count, stage_information.output_count);
+                    }
+                }
+                ImGui::TreePop();
             }
 
             ImGui::TreePop();
@@ -1941,6 +2085,185 @@ int DrawDplImages(GuiControls& gui_control_latest, ImageState* image_state, GLui
     return 0;
 }
 
+/**
+ * 3D表示に渡すフレームの画像を確保します.
+ *
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ *
+ * @retval 0 成功
+ * @retval other 失敗 (画像は RunPclViz でコピーされます)
+ *
+ * @details ImageState の画像を確保した時と同じ DplControl と大きさで確保します.
+ *  確保した時の画像を記録し、TerminatePclFrames で確保した側に戻してから解放します
+ */
+int InitializePclFrames(ImageState* image_state)
+{
+    if (pcl_frame_dpl_control_ != nullptr) {
+        return 0;
+    }
+
+    if (image_state->dpl_control == nullptr || image_state->width == 0 || image_state->height == 0) {
+        return -1;
+    }
+
+    int ret = pcl_frame_pool_.Initialize(kPCL_FRAME_COUNT);
+    if (ret != 0) {
+        return -1;
+    }
+
+    const size_t frame_size = image_state->width * image_state->height;
+    for (int i = 0; i < kPCL_FRAME_COUNT; i++) {
+        // same as the buffers of ImageState, they are exchanged with them
+        bool status = image_state->dpl_control->InitializeBuffers(&pcl_frame_buffers_[i].isc_image_Info, &pcl_frame_buffers_[i].isc_data_proc_result_data);
+        if (!status) {
+            for (int j = 0; j < i; j++) {
+                image_state->dpl_control->ReleaseBuffers(&pcl_frame_buffers_[j].isc_image_Info, &pcl_frame_buffers_[j].isc_data_proc_result_data);
+                delete[] pcl_frame_buffers_[j].bgra_image;
+                pcl_frame_buffers_[j].bgra_image = nullptr;
+            }
+            pcl_frame_pool_.Terminate();
+
+            return -1;
+        }
+        pcl_frame_buffers_[i].bgra_image = new unsigned char[frame_size * 4];
+
+        pcl_frame_owned_buffers_[i].camera_frame_data = pcl_frame_buffers_[i].isc_image_Info.frame_data[kISCIMAGEINFO_FRAMEDATA_LATEST];
+        pcl_frame_owned_buffers_[i].data_proc_frame_data = pcl_frame_buffers_[i].isc_data_proc_result_data.isc_image_info.frame_data[kISCIMAGEINFO_FRAMEDATA_LATEST];
+        pcl_frame_owned_buffers_[i].bgra_image = pcl_frame_buffers_[i].bgra_image;
+
+        pcl_frame_pool_.GetFrame(i)->user_data = &pcl_frame_buffers_[i];
+    }
+
+    pcl_frame_image_state_owned_buffers_.camera_frame_data = image_state->isc_image_Info.frame_data[kISCIMAGEINFO_FRAMEDATA_LATEST];
+    pcl_frame_image_state_owned_buffers_.data_proc_frame_data = image_state->isc_data_proc_result_data.isc_image_info.frame_data[kISCIMAGEINFO_FRAMEDATA_LATEST];
+    pcl_frame_image_state_owned_buffers_.bgra_image = image_state->bgra_image;
+
+    pcl_frame_dpl_control_ = image_state->dpl_control;
+    pcl_frame_image_state_ = image_state;
+    pcl_frame_width_ = image_state->width;
+    pcl_frame_height_ = image_state->height;
+
+    return 0;
+}
+
+/**
+ * 3D表示に渡すフレームの画像を解放します.
+ *
+ * @retval 0 成功
+ * @retval other 失敗
+ *
+ * @details TerminatePclViz の後、DplControl の終了前に呼び出します.
+ *  入れ替えた画像を確保した側 (ImageState と各フレーム) に戻してから、確保した DplControl で解放します
+ */
+int TerminatePclFrames()
+{
+    if (pcl_frame_dpl_control_ == nullptr) {
+        return 0;
+    }
+
+    // the 3D view has released every frame, the images are given back to the side which allocated them
+    const int fd_inex = kISCIMAGEINFO_FRAMEDATA_LATEST;
+    pcl_frame_image_state_->isc_image_Info.frame_data[fd_inex] = pcl_frame_image_state_owned_buffers_.camera_frame_data;
+    pcl_frame_image_state_->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex] = pcl_frame_image_state_owned_buffers_.data_proc_frame_data;
+    pcl_frame_image_state_->bgra_image = pcl_frame_image_state_owned_buffers_.bgra_image;
+    for (int i = 0; i < kPCL_FRAME_COUNT; i++) {
+        pcl_frame_buffers_[i].isc_image_Info.frame_data[fd_inex] = pcl_frame_owned_buffers_[i].camera_frame_data;
+        pcl_frame_buffers_[i].isc_data_proc_result_data.isc_image_info.frame_data[fd_inex] = pcl_frame_owned_buffers_[i].data_proc_frame_data;
+        pcl_frame_buffers_[i].bgra_image = pcl_frame_owned_buffers_[i].bgra_image;
+    }
+
+    for (int i = 0; i < kPCL_FRAME_COUNT; i++) {
+        pcl_frame_dpl_control_->ReleaseBuffers(&pcl_frame_buffers_[i].isc_image_Info, &pcl_frame_buffers_[i].isc_data_proc_result_data);
+        delete[] pcl_frame_buffers_[i].bgra_image;
+        pcl_frame_buffers_[i].bgra_image = nullptr;
+    }
+    pcl_frame_pool_.Terminate();
+
+    if (pcl_frame_copy_count_ != 0) {
+        printf("[INFO]HandOverPclFrame: %lld frames were copied to the 3D view\n", pcl_frame_copy_count_);
+    }
+
+    pcl_frame_dpl_control_ = nullptr;
+    pcl_frame_image_state_ = nullptr;
+
+    return 0;
+}
+
+/**
+ * 最新の画像をフレームに移して3D表示に渡します.
+ *
+ * @param[in] is_data_processing true:データ処理ライブラリの結果 false:カメラのデータ
+ * @param[in] image_state DPLControlを含むDPL制御用構造体
+ * @param[in] input_args 3D表示用設定 (画像は image_state のバッファーを指しています)
+ *
+ * @return 参照数 1 のフレーム. 空きが無い場合は nullptr (画像は RunPclViz でコピーされます)
+ *
+ * @details 画像はコピーせず、ImageState とフレームの間でバッファーを入れ替えます.
+ *  次の画像はフレームの持っていたバッファーに取得されます. input_args のポインタはそのままフレームの画像を指します.
+ *  ImageState の画像の大きさが確保した時と異なる場合は入れ替えません.
+ *  フレームを渡せない (画像がコピーされる) 場合は数を記録し、最初の1回を表示します
+ */
+PclFrame* HandOverPclFrame(const bool is_data_processing, ImageState* image_state, const PclVizInputArgs* input_args)
+{
+    if (pcl_frame_dpl_control_ == nullptr) {
+        return nullptr;
+    }
+
+    const char* copy_reason = nullptr;
+    PclFrame* frame = nullptr;
+    if (image_state != pcl_frame_image_state_ || image_state->dpl_control != pcl_frame_dpl_control_ ||
+        image_state->width != pcl_frame_width_ || image_state->height != pcl_frame_height_) {
+        // the buffers may not be the same size, they are not exchanged
+        copy_reason = "the image size is changed";
+    }
+    else {
+        frame = pcl_frame_pool_.Acquire();
+        if (frame == nullptr) {
+            // every frame is still in the 3D view or held by the consumers
+            copy_reason = "no free frame";
+        }
+    }
+
+    if (frame == nullptr) {
+        pcl_frame_copy_count_++;
+        if (pcl_frame_copy_count_ == 1) {
+            printf("[WARN]HandOverPclFrame: %s, the images are copied to the 3D view\n", copy_reason);
+        }
+        return nullptr;
+    }
+
+    PclFrameBuffers* frame_buffers = (PclFrameBuffers*)frame->user_data;
+    const int fd_inex = kISCIMAGEINFO_FRAMEDATA_LATEST;
+
+    if (is_data_processing) {
+        std::swap(image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex], frame_buffers->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex]);
+    }
+    else {
+        std::swap(image_state->isc_image_Info.frame_data[fd_inex], frame_buffers->isc_image_Info.frame_data[fd_inex]);
+    }
+
+    if (input_args->image_source_depth_heat) {
+        std::swap(image_state->bgra_image, frame_buffers->bgra_image);
+    }
+
+    frame->pcl_data.width                       = input_args->width;
+    frame->pcl_data.height                      = input_args->height;
+    frame->pcl_data.base_image_channel_count    = input_args->base_image_channel_count;
+    frame->pcl_data.image                       = input_args->image;
+
+    frame->pcl_data.depth_width                 = input_args->depth_width;
+    frame->pcl_data.depth_height                = input_args->depth_height;
+    frame->pcl_data.disparity_data              = input_args->disparity_data;
+
+    frame->pcl_data.disparity_image_bgra        = input_args->disparity_image_bgra;
+    frame->pcl_data.image_source_depth_heat     = input_args->image_source_depth_heat;
+
+    frame->pcl_data.frame_no                    = input_args->frame_no;
+    frame->pcl_data.frame_time                  = input_args->frame_time;
+
+    return frame;
+}
+
 /**
  * PCLのVisualizerを使った表示へのデータ提供.
  *
@@ -2030,27 +2353,11 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
                 input_args->image                       = image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex].p1.image;
             }
 
+            // the disparity is projected at its own resolution, for 4K cameras the image is sampled at the disparity pixels by the builder
             int width       = image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex].depth.width;
             int height      = image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex].depth.height;
             float* depth    = image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex].depth.image;
 
-            if (width != input_args->width) {
-                // 4Kカメラの場合は、視差が大きい
-                double ratio = (double)input_args->width / (double)width;
-
-                int new_width = (int)((double)width * ratio);
-                int new_height = (int)((double)height * ratio);
-
-                cv::Mat mat_depth(height, width, CV_32F, depth);
-                cv::Mat mat_depth_scale(new_height, new_width, CV_32F, image_buffers->buffer_depth[0].depth);
-
-                cv::resize(mat_depth, mat_depth_scale, cv::Size(), ratio, ratio, cv::INTER_NEAREST);
-
-                width = mat_depth_scale.cols;
-                height = mat_depth_scale.rows;
-                depth = image_buffers->buffer_depth[0].depth;
-            }
-
             if (gui_control_latest.viz_mode_3d_im_src_depth_heat) {
                 
                 const double min_distance = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.min;
@@ -2067,20 +2374,30 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
                 image_state->dpl_control->ConvertDisparityToImage(  image_state->b, image_state->angle, image_state->bf, image_state->dinf,
                                                                     width, height, depth, image_state->bgra_image);
 
-                // color image
+                // color is taken from the heat map (disparity_image_bgra)
                 input_args->width   = width;
                 input_args->height  = height;
-                input_args->base_image_channel_count = 4;
-                input_args->image   = image_state->bgra_image;
             }
 
             input_args->depth_width             = width;
             input_args->depth_height            = height;
             input_args->disparity_data          = depth;
             input_args->disparity_image_bgra    = image_state->bgra_image;
+            input_args->image_source_depth_heat = gui_control_latest.viz_mode_3d_im_src_depth_heat;
+
+            // the filtered point cloud is reused while the same frame is given
+            input_args->frame_no                = image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex].frameNo;
+            input_args->frame_time              = image_state->isc_data_proc_result_data.isc_image_info.frame_data[fd_inex].frame_time;
 
             input_args->pcl_filter_parameter.enabled_remove_nan             = gui_control_latest.pcl_filter_parameter.enabled_remove_nan;
 
+            input_args->pcl_filter_parameter.enabled_flying_pixel_filter    = gui_control_latest.pcl_filter_parameter.enabled_flying_pixel_filter;
+            input_args->pcl_filter_parameter.flying_pixel_filter_ratio      = gui_control_latest.pcl_filter_parameter.flying_pixel_filter_ratio;
+
+            input_args->pcl_filter_parameter.enabled_temporal_filter        = gui_control_latest.pcl_filter_parameter.enabled_temporal_filter;
+            input_args->pcl_filter_parameter.temporal_filter_mode           = gui_control_latest.pcl_filter_parameter.temporal_filter_mode;
+            input_args->pcl_filter_parameter.temporal_filter_alpha          = gui_control_latest.pcl_filter_parameter.temporal_filter_alpha;
+
             input_args->pcl_filter_parameter.enabled_pass_through_filter    = gui_control_latest.pcl_filter_parameter.enabled_pass_through_filter;
             input_args->pcl_filter_parameter.pass_through_filter_range.min  = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.min;
             input_args->pcl_filter_parameter.pass_through_filter_range.max  = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.max;
@@ -2091,13 +2408,30 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
             input_args->pcl_filter_parameter.enabled_radius_outlier_removal             = gui_control_latest.pcl_filter_parameter.enabled_radius_outlier_removal;
             input_args->pcl_filter_parameter.radius_outlier_removal_param.radius_search = gui_control_latest.pcl_filter_parameter.radius_outlier_removal_param.radius_search;
             input_args->pcl_filter_parameter.radius_outlier_removal_param.min_neighbors = gui_control_latest.pcl_filter_parameter.radius_outlier_removal_param.min_neighbors;
+            input_args->pcl_filter_parameter.radius_outlier_removal_param.exact         = gui_control_latest.pcl_filter_parameter.radius_outlier_removal_param.exact;
 
             input_args->pcl_filter_parameter.enabled_plane_detection        = gui_control_latest.pcl_filter_parameter.enabled_plane_detection;
             input_args->pcl_filter_parameter.plane_detection_threshold      = gui_control_latest.pcl_filter_parameter.plane_detection_threshold;
+            input_args->pcl_filter_parameter.plane_detection_mode           = gui_control_latest.pcl_filter_parameter.plane_detection_mode;
+            input_args->pcl_filter_parameter.plane_detection_plane_count    = gui_control_latest.pcl_filter_parameter.plane_detection_plane_count;
+            input_args->pcl_filter_parameter.plane_detection_min_inliers    = gui_control_latest.pcl_filter_parameter.plane_detection_min_inliers;
+            input_args->pcl_filter_parameter.plane_detection_time_budget    = gui_control_latest.pcl_filter_parameter.plane_detection_time_budget;
+
+            input_args->pcl_filter_parameter.enabled_normal_estimation      = gui_control_latest.pcl_filter_parameter.enabled_normal_estimation;
+            input_args->pcl_filter_parameter.normal_estimation_window       = gui_control_latest.pcl_filter_parameter.normal_estimation_window;
+            input_args->pcl_filter_parameter.normal_estimation_color        = gui_control_latest.pcl_filter_parameter.normal_estimation_color;
+
+            input_args->pcl_filter_parameter.enabled_quality_control        = gui_control_latest.pcl_filter_parameter.enabled_quality_control;
+            input_args->pcl_filter_parameter.quality_control_budget         = gui_control_latest.pcl_filter_parameter.quality_control_budget;
+            input_args->pcl_filter_parameter.build_frames_in_flight         = gui_control_latest.pcl_filter_parameter.build_frames_in_flight;
+
+            input_args->pcl_filter_parameter.lod_mode                       = gui_control_latest.pcl_filter_parameter.lod_mode;
+            input_args->pcl_filter_parameter.lod_step                       = gui_control_latest.pcl_filter_parameter.lod_step;
 
             input_args->base_length                                         = image_state->b;
             input_args->bf                                                  = image_state->bf;
             input_args->d_inf                                               = image_state->dinf;
+            input_args->angle                                               = image_state->angle;
 
             // one shot
             input_args->full_screen_request                                 = gui_control_latest.viz_mode_3d_full_screen_req;
@@ -2105,6 +2439,9 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
             gui_control_latest.viz_mode_3d_full_screen_req    = false;
             gui_control_latest.viz_mode_3d_restore_screen_req = false;
 
+            // the images are passed with the frame, they are not copied
+            input_args->frame = HandOverPclFrame(true, image_state, input_args);
+
             int viz_ret = RunPclViz(input_args, output_args);
         }
     }
@@ -2159,27 +2496,11 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
                 input_args->image                       = image_state->isc_image_Info.frame_data[fd_inex].p1.image;
             }
 
+            // the disparity is projected at its own resolution, for 4K cameras the image is sampled at the disparity pixels by the builder
             int width       = image_state->isc_image_Info.frame_data[fd_inex].depth.width;
             int height      = image_state->isc_image_Info.frame_data[fd_inex].depth.height;
             float* depth    = image_state->isc_image_Info.frame_data[fd_inex].depth.image;
 
-            if (width != input_args->width) {
-                // 4Kカメラの場合は、視差が大きい
-                double ratio = (double)input_args->width / (double)width;
-
-                int new_width = (int)((double)width * ratio);
-                int new_height = (int)((double)height * ratio);
-
-                cv::Mat mat_depth(height, width, CV_32F, depth);
-                cv::Mat mat_depth_scale(new_height, new_width, CV_32F, image_buffers->buffer_depth[0].depth);
-
-                cv::resize(mat_depth, mat_depth_scale, cv::Size(), ratio, ratio, cv::INTER_NEAREST);
-
-                width = mat_depth_scale.cols;
-                height = mat_depth_scale.rows;
-                depth = image_buffers->buffer_depth[0].depth;
-            }
-
             if (gui_control_latest.viz_mode_3d_im_src_depth_heat) {
                 const double min_distance = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.min;
                 const double max_distance = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.max;
@@ -2195,20 +2516,30 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
                 image_state->dpl_control->ConvertDisparityToImage(  image_state->b, image_state->angle, image_state->bf, image_state->dinf,
                                                                     width, height, depth, image_state->bgra_image);
 
-                // color image
+                // color is taken from the heat map (disparity_image_bgra)
                 input_args->width                    = width;
                 input_args->height                   = height;
-                input_args->base_image_channel_count = 4;
-                input_args->image                    = image_state->bgra_image;
             }
 
             input_args->depth_width             = width;
             input_args->depth_height            = height;
             input_args->disparity_data          = depth;
             input_args->disparity_image_bgra    = image_state->bgra_image;
+            input_args->image_source_depth_heat = gui_control_latest.viz_mode_3d_im_src_depth_heat;
+
+            // the filtered point cloud is reused while the same frame is given
+            input_args->frame_no                = image_state->isc_image_Info.frame_data[fd_inex].frameNo;
+            input_args->frame_time              = image_state->isc_image_Info.frame_data[fd_inex].frame_time;
 
             input_args->pcl_filter_parameter.enabled_remove_nan             = gui_control_latest.pcl_filter_parameter.enabled_remove_nan;
 
+            input_args->pcl_filter_parameter.enabled_flying_pixel_filter    = gui_control_latest.pcl_filter_parameter.enabled_flying_pixel_filter;
+            input_args->pcl_filter_parameter.flying_pixel_filter_ratio      = gui_control_latest.pcl_filter_parameter.flying_pixel_filter_ratio;
+
+            input_args->pcl_filter_parameter.enabled_temporal_filter        = gui_control_latest.pcl_filter_parameter.enabled_temporal_filter;
+            input_args->pcl_filter_parameter.temporal_filter_mode           = gui_control_latest.pcl_filter_parameter.temporal_filter_mode;
+            input_args->pcl_filter_parameter.temporal_filter_alpha          = gui_control_latest.pcl_filter_parameter.temporal_filter_alpha;
+
             input_args->pcl_filter_parameter.enabled_pass_through_filter    = gui_control_latest.pcl_filter_parameter.enabled_pass_through_filter;
             input_args->pcl_filter_parameter.pass_through_filter_range.min  = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.min;
             input_args->pcl_filter_parameter.pass_through_filter_range.max  = gui_control_latest.pcl_filter_parameter.pass_through_filter_range.max;
@@ -2219,13 +2550,30 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
             input_args->pcl_filter_parameter.enabled_radius_outlier_removal             = gui_control_latest.pcl_filter_parameter.enabled_radius_outlier_removal;
             input_args->pcl_filter_parameter.radius_outlier_removal_param.radius_search = gui_control_latest.pcl_filter_parameter.radius_outlier_removal_param.radius_search;
             input_args->pcl_filter_parameter.radius_outlier_removal_param.min_neighbors = gui_control_latest.pcl_filter_parameter.radius_outlier_removal_param.min_neighbors;
+            input_args->pcl_filter_parameter.radius_outlier_removal_param.exact         = gui_control_latest.pcl_filter_parameter.radius_outlier_removal_param.exact;
 
             input_args->pcl_filter_parameter.enabled_plane_detection        = gui_control_latest.pcl_filter_parameter.enabled_plane_detection;
             input_args->pcl_filter_parameter.plane_detection_threshold      = gui_control_latest.pcl_filter_parameter.plane_detection_threshold;
+            input_args->pcl_filter_parameter.plane_detection_mode           = gui_control_latest.pcl_filter_parameter.plane_detection_mode;
+            input_args->pcl_filter_parameter.plane_detection_plane_count    = gui_control_latest.pcl_filter_parameter.plane_detection_plane_count;
+            input_args->pcl_filter_parameter.plane_detection_min_inliers    = gui_control_latest.pcl_filter_parameter.plane_detection_min_inliers;
+            input_args->pcl_filter_parameter.plane_detection_time_budget    = gui_control_latest.pcl_filter_parameter.plane_detection_time_budget;
+
+            input_args->pcl_filter_parameter.enabled_normal_estimation      = gui_control_latest.pcl_filter_parameter.enabled_normal_estimation;
+            input_args->pcl_filter_parameter.normal_estimation_window       = gui_control_latest.pcl_filter_parameter.normal_estimation_window;
+            input_args->pcl_filter_parameter.normal_estimation_color        = gui_control_latest.pcl_filter_parameter.normal_estimation_color;
+
+            input_args->pcl_filter_parameter.enabled_quality_control        = gui_control_latest.pcl_filter_parameter.enabled_quality_control;
+            input_args->pcl_filter_parameter.quality_control_budget         = gui_control_latest.pcl_filter_parameter.quality_control_budget;
+            input_args->pcl_filter_parameter.build_frames_in_flight         = gui_control_latest.pcl_filter_parameter.build_frames_in_flight;
+
+            input_args->pcl_filter_parameter.lod_mode                       = gui_control_latest.pcl_filter_parameter.lod_mode;
+            input_args->pcl_filter_parameter.lod_step                       = gui_control_latest.pcl_filter_parameter.lod_step;
 
             input_args->base_length                                         = image_state->b;
             input_args->bf                                                  = image_state->bf;
             input_args->d_inf                                               = image_state->dinf;
+            input_args->angle                                               = image_state->angle;
 
             // one shot
             input_args->full_screen_request                                 = gui_control_latest.viz_mode_3d_full_screen_req;
@@ -2233,6 +2581,9 @@ int DrawPCLVizImage(GuiControls& gui_control_latest, DplControl::StartMode& dpl_
             gui_control_latest.viz_mode_3d_full_screen_req                  = false;
             gui_control_latest.viz_mode_3d_restore_screen_req               = false;
 
+            // the images are passed with the frame, they are not copied
+            input_args->frame = HandOverPclFrame(false, image_state, input_args);
+
             int viz_ret = RunPclViz(input_args, output_args);
         }
     }
@@ -33,6 +33,9 @@ struct InitializeWindowParameter {
 
 	double dra_min_distance;				/**< Minimum display distance */
 	double dra_max_distance;				/**< Maximum display distance */
+
+	int pcl_lod_mode;						/**< 3D level of detail 0:off 1:stride 2:block average 3:block min disparity */
+	int pcl_lod_step;						/**< 3D level of detail block size (pixels) */
 };
 
 /** @brief Creation and initialization of GLFW Window.
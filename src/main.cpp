@@ -97,6 +97,8 @@ int Initialize(const wchar_t* module_path, GLFWwindow** window, ImageState* imag
     initialze_window_parameter.enable_data_processing_library   = false;
     initialze_window_parameter.dra_min_distance                 = GetDrawMinDistance(image_state);
     initialze_window_parameter.dra_max_distance                 = GetDrawMaxDistance(image_state);
+    initialze_window_parameter.pcl_lod_mode                     = GetPclLodMode(image_state);
+    initialze_window_parameter.pcl_lod_step                     = GetPclLodStep(image_state);
 
     switch (camera_model) {
     case 0:// VM
@@ -127,8 +129,11 @@ int Initialize(const wchar_t* module_path, GLFWwindow** window, ImageState* imag
     viz_parameters.d_inf                = image_state->dinf;
     viz_parameters.base_length          = image_state->b;
     viz_parameters.bf                   = image_state->bf;
+    viz_parameters.angle                = image_state->angle;
     viz_parameters.min_distance         = GetDrawMinDistance(image_state);
     viz_parameters.max_distance         = GetDrawMaxDistance(image_state);
+    viz_parameters.output_frame         = GetPclOutputFrame(image_state);
+    GetPclExtrinsic(image_state, viz_parameters.extrinsic);
     viz_parameters.coordinate_system    = true;
     viz_parameters.full_screen_request  = false;
 
@@ -0,0 +1,178 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_build_slot_queue.cpp
+ * @brief Bounded queue to hand the build slots between the stage threads.
+ * @version 0.1
+ *
+ * @details The point cloud is built in stages on separate threads, and each frame in flight owns a slot
+ *  which holds its buffers. The slot numbers are passed through the queues, one queue between two threads,
+ *  so the frames stay in order. The queue holds no data and is bounded by the number of the slots,
+ *  a stage waits while its input is empty, and Close releases the waiting threads to stop them.
+ */
+
+#include <mutex>
+#include <condition_variable>
+
+#include "pcl_build_slot_queue.h"
+
+/**
+ * constructor
+ *
+ */
+PclBuildSlotQueue::PclBuildSlotQueue():
+	capacity_(0), slots_(nullptr), head_(0), count_(0), closed_(false)
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclBuildSlotQueue::~PclBuildSlotQueue()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] capacity 保持できるスロットの数
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclBuildSlotQueue::Initialize(const int capacity)
+{
+	if (capacity <= 0) {
+		return -1;
+	}
+
+	capacity_ = capacity;
+	slots_ = new int[capacity_];
+	head_ = 0;
+	count_ = 0;
+	closed_ = false;
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ *
+ * @details 待機しているスレッドが無い状態で呼び出します
+ */
+int PclBuildSlotQueue::Terminate()
+{
+	delete[] slots_;
+	slots_ = nullptr;
+	capacity_ = 0;
+	head_ = 0;
+	count_ = 0;
+
+	return 0;
+}
+
+/**
+ * 空にして、使用できる状態にします.
+ *
+ * @details Close の後、スレッドを開始する前に呼び出します
+ */
+void PclBuildSlotQueue::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	head_ = 0;
+	count_ = 0;
+	closed_ = false;
+
+	return;
+}
+
+/**
+ * 閉じます. 待機しているスレッドは -1 で戻ります
+ *
+ */
+void PclBuildSlotQueue::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+	}
+	condition_.notify_all();
+
+	return;
+}
+
+/**
+ * スロットを追加します. 一杯の場合は空くまで待機します
+ *
+ * @param[in] slot スロットの番号
+ *
+ * @retval 0 成功
+ * @retval -1 閉じられています
+ */
+int PclBuildSlotQueue::Push(const int slot)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		condition_.wait(lock, [this] { return closed_ || count_ < capacity_; });
+		if (closed_) {
+			return -1;
+		}
+
+		int tail = head_ + count_;
+		if (tail >= capacity_) {
+			tail -= capacity_;
+		}
+		slots_[tail] = slot;
+		count_++;
+	}
+	condition_.notify_all();
+
+	return 0;
+}
+
+/**
+ * 最も古いスロットを取り出します. 空の場合は追加されるまで待機します
+ *
+ * @param[out] slot スロットの番号
+ *
+ * @retval 0 成功
+ * @retval -1 閉じられています
+ */
+int PclBuildSlotQueue::Pop(int* slot)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+
+		condition_.wait(lock, [this] { return closed_ || count_ > 0; });
+		if (closed_) {
+			return -1;
+		}
+
+		*slot = slots_[head_];
+		head_++;
+		if (head_ >= capacity_) {
+			head_ = 0;
+		}
+		count_--;
+	}
+	condition_.notify_all();
+
+	return 0;
+}
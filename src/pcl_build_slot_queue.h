@@ -0,0 +1,55 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_build_slot_queue.h
+ * @brief Bounded queue to hand the build slots between the stage threads.
+ */
+
+#pragma once
+
+/**
+ * @class   PclBuildSlotQueue
+ * @brief   Queue class
+ * this class passes the slot numbers in order from one stage thread to the next, and waits while it is empty or full
+ */
+class PclBuildSlotQueue {
+public:
+
+	PclBuildSlotQueue();
+	~PclBuildSlotQueue();
+
+	int Initialize(const int capacity);
+
+	int Terminate();
+
+	void Clear();
+
+	void Close();
+
+	int Push(const int slot);
+
+	int Pop(int* slot);
+
+private:
+	std::mutex mutex_;
+	std::condition_variable condition_;		/**< notified when a slot is pushed or popped, and by Close */
+
+	int capacity_;
+	int* slots_;
+	int head_;								/**< the oldest slot */
+	int count_;
+	bool closed_;							/**< Push and Pop fail without waiting */
+
+};
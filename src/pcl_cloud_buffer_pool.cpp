@@ -0,0 +1,111 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_cloud_buffer_pool.cpp
+ * @brief Point cloud buffers shared by the builders of the build slots.
+ * @version 0.1
+ *
+ * @details A buffer is free when the pool holds its only reference, the viewer, the filter thread and the
+ *  build slots release it by dropping their pointer. Acquire takes the first free buffer, so with few frames
+ *  in flight only the first buffers are written and grow. The buffers are not reserved, a buffer grows to
+ *  the largest cloud written into it (the output of the level of detail, not the disparity size).
+ *  The pool is used by one thread (the build thread).
+ */
+
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "pcl_cloud_buffer_pool.h"
+
+/**
+ * constructor
+ *
+ */
+PclCloudBufferPool::PclCloudBufferPool():
+	buffers_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclCloudBufferPool::~PclCloudBufferPool()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] count バッファーの数
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclCloudBufferPool::Initialize(const int count)
+{
+	if (count <= 0) {
+		return -1;
+	}
+
+	buffers_.resize((size_t)count);
+	for (auto& buffer : buffers_) {
+		buffer.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+	}
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ *
+ * @details 参照中のバッファーは、最後の参照が解放された時に解放されます
+ */
+int PclCloudBufferPool::Terminate()
+{
+	buffers_.clear();
+	buffers_.shrink_to_fit();
+
+	return 0;
+}
+
+/**
+ * 書き込み対象の点群を取得します.
+ *
+ * @return 点群データ. 失敗した場合は nullptr
+ *
+ * @details 他から参照されていないバッファーです. すべて参照中の場合は、最後のバッファーを新しい点群に置き換えます.
+ *  置き換えた点群は、参照が解放された時に解放されます
+ */
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr PclCloudBufferPool::Acquire()
+{
+	if (buffers_.empty()) {
+		return nullptr;
+	}
+
+	for (auto& buffer : buffers_) {
+		if (buffer.use_count() == 1) {
+			return buffer;
+		}
+	}
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& buffer = buffers_.back();
+	buffer.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+
+	return buffer;
+}
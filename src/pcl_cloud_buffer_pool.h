@@ -0,0 +1,42 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_cloud_buffer_pool.h
+ * @brief Point cloud buffers shared by the builders of the build slots.
+ */
+
+#pragma once
+
+/**
+ * @class   PclCloudBufferPool
+ * @brief   Point cloud buffer pool class
+ * this class gives a buffer no one else references, the buffers grow to the size of the clouds written into them
+ */
+class PclCloudBufferPool {
+public:
+
+	PclCloudBufferPool();
+	~PclCloudBufferPool();
+
+	int Initialize(const int count);
+
+	int Terminate();
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr Acquire();
+
+private:
+	std::vector<pcl::PointCloud<pcl::PointXYZRGBA>::Ptr> buffers_;
+
+};
@@ -27,6 +27,8 @@
 #include <stdio.h>
 #include <time.h>
 #include <stdint.h>
+#include <cstdint>
+#include <mutex>
 
 #include "pcl_def.h"
 
@@ -37,7 +39,7 @@
  *
  */
 PclDataRingBuffer::PclDataRingBuffer():
-	flag_critical_(), last_mode_(false), allow_overwrite_(false), buffer_count_(0), width_(0), height_(0), channel_count_(0), buffer_data_(nullptr),
+	flag_mutex_(), last_mode_(false), allow_overwrite_(false), buffer_count_(0), width_(0), height_(0), channel_count_(0), buffer_data_(nullptr),
 	write_inex_(0), read_index_(0), put_index_(0), geted_inedx_(0),
 	buff_image_(nullptr), buff_disparity_image_bgra_(nullptr), buff_disparity_data_(nullptr)
 {
@@ -72,8 +74,6 @@ int PclDataRingBuffer::Initialize(const bool last_mpde, const bool allow_overwri
 	height_ = height_def;
 	write_inex_ = 0; read_index_ = 0; put_index_ = 0;  geted_inedx_ = 0;
 
-	InitializeCriticalSection(&flag_critical_);
-
 	buffer_data_ = new BufferData[buffer_count_];
 
 	const size_t one_frame_size = width_ * height_;
@@ -98,7 +98,11 @@ int PclDataRingBuffer::Initialize(const bool last_mpde, const bool allow_overwri
 		buffer_data_[i].pcl_data.depth_width = width_;
 		buffer_data_[i].pcl_data.depth_height = height_;
 
+		buffer_data_[i].pcl_data.frame_no = 0;
+		buffer_data_[i].pcl_data.frame_time = 0;
+
 		memset(&buffer_data_[i].pcl_filter_parameter, 0, sizeof(PclFilterParameter));
+		buffer_data_[i].frame = nullptr;
 
 		size_t unit = one_frame_size * 4;
 		buffer_data_[i].pcl_data.image = buff_image_ + (unit * i);
@@ -121,14 +125,14 @@ int PclDataRingBuffer::Initialize(const bool last_mpde, const bool allow_overwri
  */
 int PclDataRingBuffer::Clear()
 {
-	EnterCriticalSection(&flag_critical_);
+	flag_mutex_.lock();
 	write_inex_ = 0; read_index_ = 0; put_index_ = 0;  geted_inedx_ = 0;
 
 	for (int i = 0; i < buffer_count_; i++) {
 		buffer_data_[i].state = 0;
 		memset(&buffer_data_[i].pcl_filter_parameter, 0, sizeof(PclFilterParameter));
 	}
-	LeaveCriticalSection(&flag_critical_);
+	flag_mutex_.unlock();
 
 	const size_t one_frame_size = width_ * height_;
 
@@ -175,8 +179,6 @@ int PclDataRingBuffer::Terminate()
 	delete buffer_data_;
 	buffer_data_ = nullptr;
 
-	DeleteCriticalSection(&flag_critical_);
-
 	return 0;
 }
 
@@ -189,25 +191,25 @@ int PclDataRingBuffer::Terminate()
  * @retval >0 バッファーのIndex
  * @retval -1 失敗 空きバッファー無し
  */
-int PclDataRingBuffer::GetPutBuffer(BufferData** buffer_data, const ULONGLONG time)
+int PclDataRingBuffer::GetPutBuffer(BufferData** buffer_data, const std::uint64_t time)
 {
 	if (buffer_data_ == nullptr) {
 		return -1;
 	}
 
-	EnterCriticalSection(&flag_critical_);
+	flag_mutex_.lock();
 
 	int local_write_inex = write_inex_;
 
 	if (buffer_data_[local_write_inex].state == 3) {
 		// in use for Get...
-		LeaveCriticalSection(&flag_critical_);
+		flag_mutex_.unlock();
 		return -1;
 	}
 
 	if (!allow_overwrite_) {
 		if (buffer_data_[local_write_inex].state != 0) {
-			LeaveCriticalSection(&flag_critical_);
+			flag_mutex_.unlock();
 			return -1;
 		}
 	}
@@ -218,7 +220,7 @@ int PclDataRingBuffer::GetPutBuffer(BufferData** buffer_data, const ULONGLONG ti
 	buffer_data_[local_write_inex].state = 1;
 	put_index_ = local_write_inex;
 
-	LeaveCriticalSection(&flag_critical_);
+	flag_mutex_.unlock();
 
 	return put_index_;
 }
@@ -249,12 +251,12 @@ int PclDataRingBuffer::DonePutBuffer(const int index, const int status)
 		return -1;
 	}
 
-	EnterCriticalSection(&flag_critical_);
+	flag_mutex_.lock();
 
 	if (buffer_data_[index].state != 1) {
 		// error, this case should not exist
 		__debugbreak();
-		LeaveCriticalSection(&flag_critical_);
+		flag_mutex_.unlock();
 		return -1;
 	}
 
@@ -275,7 +277,7 @@ int PclDataRingBuffer::DonePutBuffer(const int index, const int status)
 		}
 	}
 
-	LeaveCriticalSection(&flag_critical_);
+	flag_mutex_.unlock();
 
 	return 0;
 }
@@ -289,17 +291,17 @@ int PclDataRingBuffer::DonePutBuffer(const int index, const int status)
  * @retval >0 バッファーのIndex
  * @retval -1 失敗 データ無し
  */
-int PclDataRingBuffer::GetGetBuffer(BufferData** buffer_data, ULONGLONG* time_get)
+int PclDataRingBuffer::GetGetBuffer(BufferData** buffer_data, std::uint64_t* time_get)
 {
 	if (buffer_data_ == nullptr) {
 		return -1;
 	}
 
-	EnterCriticalSection(&flag_critical_);
+	flag_mutex_.lock();
 	int local_read_index = read_index_;
 
 	if (buffer_data_[local_read_index].state != 2) {
-		LeaveCriticalSection(&flag_critical_);
+		flag_mutex_.unlock();
 		return -1;
 	}
 
@@ -340,7 +342,7 @@ int PclDataRingBuffer::GetGetBuffer(BufferData** buffer_data, ULONGLONG* time_ge
 		}
 	}
 
-	LeaveCriticalSection(&flag_critical_);
+	flag_mutex_.unlock();
 
 	return geted_inedx_;
 }
@@ -369,9 +371,9 @@ void PclDataRingBuffer::DoneGetBuffer(const int index)
 		return;
 	}
 
-	EnterCriticalSection(&flag_critical_);
+	flag_mutex_.lock();
 	buffer_data_[index].state = 0;
-	LeaveCriticalSection(&flag_critical_);
+	flag_mutex_.unlock();
 
 	return;
 }
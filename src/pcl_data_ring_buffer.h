@@ -38,16 +38,21 @@ public:
 		float* disparity_data;
 
 		unsigned char* disparity_image_bgra;
+		bool image_source_depth_heat;
+
+		int frame_no;
+		long long frame_time;
 	};
 	
 	struct BufferData {
 		int inedx;									/**< buffer number */
 		int state;									/**< 0:nothing 1:under write 2: write done 3:read/using */
-		ULONGLONG time;								/**< put time */
+		std::uint64_t time;							/**< put time */
 
 		PclFilterParameter pcl_filter_parameter;	/**< filter parameter for build Point cloud data */
 
 		PclData pcl_data;							/**< images */
+		PclFrame* frame;							/**< frame of the pool holding the images, used instead of pcl_data (nullptr: pcl_data) */
 	};
 
 	PclDataRingBuffer();
@@ -61,16 +66,16 @@ public:
 
 	int Terminate();
 
-	int GetPutBuffer(BufferData** buffer_data, const ULONGLONG time);
+	int GetPutBuffer(BufferData** buffer_data, const std::uint64_t time);
 
 	int DonePutBuffer(const int index, const int status);
 
-	int GetGetBuffer(BufferData** buffer_data, ULONGLONG* time_get);
+	int GetGetBuffer(BufferData** buffer_data, std::uint64_t* time_get);
 
 	void DoneGetBuffer(const int index);
 
 private:
-	CRITICAL_SECTION flag_critical_;
+	std::mutex flag_mutex_;
 	bool last_mode_;
 	bool allow_overwrite_;
 
@@ -19,6 +19,14 @@
 
 #pragma once
 
+constexpr int kPCL_LOD_STEP_MIN = 2;	/**< level of detail, minimum block size (pixels), 1 is the same as off */
+constexpr int kPCL_LOD_STEP_MAX = 8;	/**< level of detail, maximum block size (pixels) */
+
+constexpr int kPCL_FRAME_RING_DEPTH = 4;	/**< frames the broadcast ring keeps for a kLossless consumer */
+constexpr int kPCL_FRAME_CONSUMER_MAX = 2;	/**< consumers of the broadcast ring, each one holds a frame while it reads it */
+
+constexpr int kPCL_FILTER_STAGE_COUNT = 5;	/**< stages of the filter thread: build, down sampling, radius outlier removal, normal estimation, plane detection */
+
 /** @struct  PclFilterParameter
  *  @brief PCL Operation Mode Setting Parameters
  */
@@ -30,8 +38,18 @@ struct PclFilterParameter {
 	struct RadiusOuterParam {
 		double radius_search;
 		int min_neighbors;
+		bool exact;										/**< true: KdTree (pcl::RadiusOutlierRemoval) false: pixel window */
 	};
 
+	// flying pixel filter
+	bool enabled_flying_pixel_filter;					/**< removes the pixels of the disparity on the depth discontinuities, before projection */
+	float flying_pixel_filter_ratio;					/**< ratio of the depth difference to the depth (0.05: 5%) */
+
+	// temporal filter
+	bool enabled_temporal_filter;						/**< smooths the disparity of each pixel over the frames, before projection */
+	int temporal_filter_mode;							/**< 0:exponential moving average 1:median */
+	float temporal_filter_alpha;						/**< exponential moving average: weight of the current frame */
+
 	// it remove NAN
 	bool enabled_remove_nan;							/**< Removes points with x, y, or z equal to NaN */
 
@@ -47,9 +65,29 @@ struct PclFilterParameter {
 	bool enabled_radius_outlier_removal;				/**< filters points in a cloud based on the number of neighbors they have */
 	RadiusOuterParam radius_outlier_removal_param;		/**< radius(m) */
 
+	// level of detail
+	int lod_mode;										/**< 0:off 1:stride 2:block average 3:block min disparity */
+	int lod_step;										/**< block size (pixels) */
+
 	// plane detection
 	bool enabled_plane_detection;						/**< Palne detection by RANZAC */
 	double plane_detection_threshold;					/**< plane threshold */
+	int plane_detection_mode;							/**< 0:single plane 1:multi plane */
+	int plane_detection_plane_count;					/**< multi plane: maximum number of planes */
+	int plane_detection_min_inliers;					/**< multi plane: minimum number of points of a plane */
+	float plane_detection_time_budget;					/**< multi plane: time budget (ms) */
+
+	// normal estimation
+	bool enabled_normal_estimation;						/**< surface normal of each point, from the neighbors on the pixel grid */
+	int normal_estimation_window;						/**< half size of the window (blocks of the level of detail) */
+	bool normal_estimation_color;						/**< colors the points by the normal */
+
+	// quality control
+	bool enabled_quality_control;						/**< lowers the level of detail and the filter cost when the build exceeds the budget */
+	float quality_control_budget;						/**< frame time budget (ms) */
+
+	// pipeline
+	int build_frames_in_flight;							/**< frames built ahead of the filter stages 1:serial - 4 */
 
 };
 
@@ -67,8 +105,11 @@ struct VizParameters {
 	double d_inf;							/**< Camera Specific Parameters */
 	double base_length;						/**< Camera baseline length */
 	double bf;								/**< Camera Specific Parameters */
+	double angle;							/**< Camera setup angle (degree) */
 	double min_distance;					/**< Minimum display distance */
 	double max_distance;					/**< Indicates the maximum distance */
+	int output_frame;						/**< Coordinate frame 0:camera 1:ROS 2:Unity 3:extrinsic */
+	double extrinsic[16];					/**< Extrinsic (4x4 row major) camera frame to output frame */
 
 	// system
 	bool coordinate_system;					/**< Display axis */
@@ -77,6 +118,8 @@ struct VizParameters {
 	char pcd_file_write_folder[_MAX_PATH];	/**< Folder name for save pcd file */
 };
 
+struct PclFrame;
+
 /** @struct  PclVizInputArgs
  *  @brief Display Data
  */
@@ -84,6 +127,7 @@ struct PclVizInputArgs {
 	double d_inf;								/**< Camera Specific Parameters */
 	double base_length;							/**< Camera baseline length */
 	double bf;									/**< Camera Specific Parameters */
+	double angle;								/**< Camera setup angle (degree) */
 
 	int width;									/**< Image Width */
 	int height;									/**< Image Height */
@@ -95,6 +139,12 @@ struct PclVizInputArgs {
 	float* disparity_data;						/**< disparity data */
 
 	unsigned char* disparity_image_bgra;		/**< Color image */
+	bool image_source_depth_heat;				/**< Color source false:image true:disparity_image_bgra */
+
+	int frame_no;								/**< Frame number of the camera */
+	long long frame_time;						/**< Frame time (UTC msec) */
+
+	PclFrame* frame;							/**< frame holding the images above, passed with its reference (nullptr: the images are copied) */
 
 	bool full_screen_request;					/**< Request full screen display */
 	bool restore_screen_request;				/**< Exit full-screen display */
@@ -120,4 +170,21 @@ struct PclVizOutputArgs {
 		PickData pick_data[4];
 	};
 	PickInforamtion pick_information;	/**< Information about the location selected with the mouse */
+
+	// quality control information
+	struct QualityInformation {
+		bool enabled;
+		int level;						/**< 0:as configured, higher is lower quality */
+		double frame_time;				/**< average build time (ms) */
+	};
+	QualityInformation quality_information;	/**< State of the quality control of the build */
+
+	// filter stage information
+	struct StageInformation {
+		bool executed;					/**< the stage ran in the last frame */
+		bool cached;					/**< the output was taken from the cache */
+		double time;					/**< processing time (ms) */
+		int input_count, output_count;	/**< number of points */
+	};
+	StageInformation stage_information[kPCL_FILTER_STAGE_COUNT];	/**< Stages of the filter for the last frame, in the order of execution */
 };
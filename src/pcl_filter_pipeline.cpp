@@ -0,0 +1,432 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_filter_pipeline.cpp
+ * @brief Point cloud buffers, output cache and statistics for the filter stages.
+ * @version 0.1
+ *
+ * @details The stages write into persistent buffers, alternately, instead of a new point cloud for every stage and frame.
+ *  A buffer referenced by the viewer is not written, like PclPointCloudBuilder.
+ *  The buffers and the cache are not reserved, they grow to the clouds of the stages (after the level of detail).
+ *  While the same frame is given repeatedly (paused playback), the output of each stage is cached with a key of the frame
+ *  and the parameters, and only the stages after a changed parameter are run again.
+ */
+
+#include <chrono>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "pcl_filter_pipeline.h"
+
+/**
+ * constructor
+ *
+ */
+PclFilterPipeline::PclFilterPipeline():
+	buffer_(), buffer_index_(0), cloud_(), stage_output_(), pixel_index_(nullptr), cloud_cached_(false),
+	has_frame_key_(false), frame_key_(0), caching_(false), cache_(),
+	stage_(Stage::kCount), stage_key_(0), stage_start_(), statistics_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclFilterPipeline::~PclFilterPipeline()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @retval 0 成功
+ *
+ * @details バッファーは予約しません. 書き込んだ最大の点群の大きさになり、以降は再確保しません
+ */
+int PclFilterPipeline::Initialize()
+{
+	buffer_index_ = 0;
+
+	for (int i = 0; i < kBufferCount; i++) {
+		buffer_[i].reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+	}
+
+	cloud_.reset();
+	stage_output_.reset();
+	pixel_index_ = nullptr;
+	cloud_cached_ = false;
+
+	// the cache is allocated when it is used
+	has_frame_key_ = false;
+	caching_ = false;
+	for (int i = 0; i < (int)Stage::kCount; i++) {
+		cache_[i].valid = false;
+	}
+
+	stage_ = Stage::kCount;
+	for (int i = 0; i < (int)Stage::kCount; i++) {
+		statistics_[i] = {};
+	}
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclFilterPipeline::Terminate()
+{
+	for (int i = 0; i < kBufferCount; i++) {
+		buffer_[i].reset();
+	}
+
+	cloud_.reset();
+	stage_output_.reset();
+	pixel_index_ = nullptr;
+
+	has_frame_key_ = false;
+	caching_ = false;
+	for (int i = 0; i < (int)Stage::kCount; i++) {
+		cache_[i].valid = false;
+		cache_[i].cloud.reset();
+		cache_[i].has_pixel_index = false;
+		cache_[i].pixel_index.clear();
+		cache_[i].pixel_index.shrink_to_fit();
+	}
+
+	return 0;
+}
+
+/**
+ * キーにデータを加えます.
+ *
+ * @param[in] key これまでのキー
+ * @param[in] data データ
+ * @param[in] size データのバイト数
+ *
+ * @return キー
+ *
+ * @details FNV-1a です. 上流の段のキーに段のパラメータを加え、段のキーとします.
+ *  パディングを含む構造体ではなく、メンバーを個別に加えてください
+ */
+unsigned long long PclFilterPipeline::Hash(const unsigned long long key, const void* data, const size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	unsigned long long hash = key;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * フレームの処理を開始します.
+ *
+ * @param[in] frame_key フレームのキー (フレーム番号など)
+ *
+ * @details 統計をクリアします. 前のフレームと同じキーの場合は段の出力をキャッシュし、
+ *  異なる場合はキャッシュを破棄します. ライブ表示ではキャッシュへのコピーは行いません
+ */
+void PclFilterPipeline::Start(const unsigned long long frame_key)
+{
+	cloud_.reset();
+	stage_output_.reset();
+	pixel_index_ = nullptr;
+	cloud_cached_ = false;
+	stage_ = Stage::kCount;
+
+	caching_ = has_frame_key_ && (frame_key == frame_key_);
+	has_frame_key_ = true;
+	frame_key_ = frame_key;
+
+	if (!caching_) {
+		for (int i = 0; i < (int)Stage::kCount; i++) {
+			cache_[i].valid = false;
+		}
+	}
+
+	for (int i = 0; i < (int)Stage::kCount; i++) {
+		statistics_[i] = {};
+	}
+
+	return;
+}
+
+/**
+ * 段の出力をキャッシュから取得します.
+ *
+ * @param[in] stage 段
+ * @param[in] key 段のキー
+ *
+ * @retval true キャッシュを使用しました. 段を実行する必要はありません
+ * @retval false キャッシュがありません. 段を実行してください
+ *
+ * @details 点群はコピーせずに参照します. 直接更新する段 (BeginInPlaceStage) の前にコピーします
+ */
+bool PclFilterPipeline::Restore(const Stage stage, const unsigned long long key)
+{
+	CacheEntry& entry = cache_[(int)stage];
+
+	if (!caching_ || !entry.valid || entry.key != key) {
+		return false;
+	}
+
+	StageStatistics& statistics = statistics_[(int)stage];
+	statistics.input_count = (cloud_ != nullptr) ? (int)cloud_->points.size() : 0;
+
+	cloud_ = entry.cloud;
+	pixel_index_ = entry.has_pixel_index ? &entry.pixel_index : nullptr;
+	cloud_cached_ = true;
+
+	statistics.cached = true;
+	statistics.output_count = (int)cloud_->points.size();
+
+	return true;
+}
+
+/**
+ * 段の処理を開始します.
+ *
+ * @param[in] stage 段
+ * @param[in] key 段のキー
+ *
+ * @return 段の出力先の点群データ
+ *
+ * @details 出力先は入力 (GetCloud) と異なり、表示側が参照していないバッファーです.
+ *  3面を順に使用するため、通常は新しい点群を作成することはありません
+ */
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr PclFilterPipeline::BeginStage(const Stage stage, const unsigned long long key)
+{
+	stage_ = stage;
+	stage_key_ = key;
+	stage_output_ = SelectBuffer();
+
+	statistics_[(int)stage].input_count = (cloud_ != nullptr) ? (int)cloud_->points.size() : 0;
+	stage_start_ = std::chrono::steady_clock::now();
+
+	return stage_output_;
+}
+
+/**
+ * 入力を直接更新する段の処理を開始します.
+ *
+ * @param[in] stage 段
+ * @param[in] key 段のキー
+ *
+ * @details 段は GetCloud を直接更新します. 入力がキャッシュの場合は、バッファーにコピーします
+ */
+void PclFilterPipeline::BeginInPlaceStage(const Stage stage, const unsigned long long key)
+{
+	stage_ = stage;
+	stage_key_ = key;
+	stage_output_.reset();
+
+	if (cloud_cached_) {
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& buffer = SelectBuffer();
+		*buffer = *cloud_;
+		cloud_ = buffer;
+		cloud_cached_ = false;
+	}
+
+	statistics_[(int)stage].input_count = (cloud_ != nullptr) ? (int)cloud_->points.size() : 0;
+	stage_start_ = std::chrono::steady_clock::now();
+
+	return;
+}
+
+/**
+ * 段の処理を終了します.
+ *
+ * @details BeginStage の場合は、その出力が次の段の入力 (GetCloud) になります.
+ *  同じフレームが続いている場合は、出力をキャッシュにコピーします
+ */
+void PclFilterPipeline::EndStage()
+{
+	if (stage_ == Stage::kCount) {
+		return;
+	}
+
+	const auto end = std::chrono::steady_clock::now();
+
+	if (stage_output_ != nullptr) {
+		cloud_ = stage_output_;
+		cloud_cached_ = false;
+		stage_output_.reset();
+	}
+
+	StageStatistics& statistics = statistics_[(int)stage_];
+	statistics.executed = true;
+	statistics.time = std::chrono::duration<double, std::milli>(end - stage_start_).count();
+	statistics.output_count = (cloud_ != nullptr) ? (int)cloud_->points.size() : 0;
+
+	CacheEntry& entry = cache_[(int)stage_];
+	entry.valid = false;
+	if (caching_ && cloud_ != nullptr) {
+		// an entry referenced by the viewer is not written
+		if (entry.cloud == nullptr || entry.cloud.use_count() > 1) {
+			entry.cloud.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+		}
+		*entry.cloud = *cloud_;
+
+		entry.has_pixel_index = (pixel_index_ != nullptr);
+		if (entry.has_pixel_index) {
+			entry.pixel_index = *pixel_index_;
+		}
+		else {
+			entry.pixel_index.clear();
+		}
+
+		entry.key = stage_key_;
+		entry.valid = true;
+	}
+
+	stage_ = Stage::kCount;
+
+	return;
+}
+
+/**
+ * 失敗した段の処理を取り消します.
+ *
+ * @details 段の出力は破棄し、入力 (GetCloud) と点の画素がそのまま次の段の入力になります.
+ *  段は実行されなかったものとし、キャッシュもしません. BeginStage の段に使用してください
+ */
+void PclFilterPipeline::CancelStage()
+{
+	if (stage_ == Stage::kCount) {
+		return;
+	}
+
+	stage_output_.reset();
+	cache_[(int)stage_].valid = false;
+	statistics_[(int)stage_] = {};
+
+	stage_ = Stage::kCount;
+
+	return;
+}
+
+/**
+ * フレームの処理を終了します.
+ *
+ * @details 最後の段の出力 (GetCloud) の参照を解放します. 段のない場合は作成側 (kBuild) のバッファーのため、
+ *  参照を残すと作成側が次のフレームで新しい点群を作成することになります. 統計とキャッシュは残ります
+ */
+void PclFilterPipeline::Finish()
+{
+	cloud_.reset();
+	stage_output_.reset();
+	pixel_index_ = nullptr;
+	cloud_cached_ = false;
+	stage_ = Stage::kCount;
+
+	return;
+}
+
+/**
+ * 段の出力を設定します.
+ *
+ * @param[in] cloud 点群データ
+ * @param[in] shared true:表示側なども参照している点群. 直接更新する段の前にコピーします
+ *
+ * @details 自身のバッファーを持つ段 (kBuild) の出力を、次の段の入力とします
+ */
+void PclFilterPipeline::SetCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& cloud, const bool shared)
+{
+	cloud_ = cloud;
+	cloud_cached_ = shared;
+
+	return;
+}
+
+/**
+ * 点の画素を設定します.
+ *
+ * @param[in] pixel_index GetCloud の各点の画素. nullptr は不明. 次に設定するまで保持してください
+ */
+void PclFilterPipeline::SetPixelIndex(const std::vector<int>* pixel_index)
+{
+	pixel_index_ = pixel_index;
+
+	return;
+}
+
+/**
+ * 出力先のバッファーを選択します.
+ *
+ * @return バッファー
+ *
+ * @details 入力 (GetCloud) と異なり、表示側が参照していないバッファーです
+ */
+pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& PclFilterPipeline::SelectBuffer()
+{
+	for (int i = 0; i < kBufferCount; i++) {
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& buffer = buffer_[buffer_index_];
+
+		buffer_index_++;
+		if (buffer_index_ >= kBufferCount) {
+			buffer_index_ = 0;
+		}
+
+		if (buffer != cloud_ && buffer.use_count() == 1) {
+			return buffer;
+		}
+	}
+
+	// every buffer is in use, replace one, the old one is released when it is no longer referenced
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& buffer = (buffer_[buffer_index_] != cloud_) ? buffer_[buffer_index_] : buffer_[(buffer_index_ + 1) % kBufferCount];
+	buffer.reset(new pcl::PointCloud<pcl::PointXYZRGBA>);
+
+	return buffer;
+}
+
+/**
+ * 最後の段の出力を取得します.
+ *
+ * @return 点群データ
+ */
+const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& PclFilterPipeline::GetCloud() const
+{
+	return cloud_;
+}
+
+/**
+ * 最後の段の出力の点の画素を取得します.
+ *
+ * @return 各点の画素. nullptr は不明
+ */
+const std::vector<int>* PclFilterPipeline::GetPixelIndex() const
+{
+	return pixel_index_;
+}
+
+/**
+ * 段の統計を取得します.
+ *
+ * @param[in] stage 段
+ *
+ * @return 最後のフレームの統計 (実行しなかった段は executed が false)
+ */
+const PclFilterPipeline::StageStatistics& PclFilterPipeline::GetStatistics(const Stage stage) const
+{
+	return statistics_[(int)stage];
+}
@@ -0,0 +1,119 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_filter_pipeline.h
+ * @brief Point cloud buffers, output cache and statistics for the filter stages.
+ */
+
+#pragma once
+
+/**
+ * @class   PclFilterPipeline
+ * @brief   Filter pipeline class
+ * this class keeps the point cloud buffers of the filter stages and reuses them for every frame
+ */
+class PclFilterPipeline {
+public:
+
+	/** @enum  Stage
+	 *  @brief Filter stages, in the order of execution
+	 */
+	enum class Stage {
+		kBuild,
+		kDownSampling,
+		kRadiusOutlierRemoval,
+		kNormalEstimation,
+		kPlaneDetection,
+		kCount
+	};
+
+	/** @struct  StageStatistics
+	 *  @brief Statistics of a stage for the last frame
+	 */
+	struct StageStatistics {
+		bool executed;						/**< the stage ran in the last frame */
+		bool cached;						/**< the output was taken from the cache */
+		double time;						/**< processing time (ms) */
+		int input_count, output_count;		/**< number of points */
+	};
+
+	PclFilterPipeline();
+	~PclFilterPipeline();
+
+	int Initialize();
+
+	int Terminate();
+
+	static unsigned long long Hash(const unsigned long long key, const void* data, const size_t size);
+
+	void Start(const unsigned long long frame_key);
+
+	bool Restore(const Stage stage, const unsigned long long key);
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr BeginStage(const Stage stage, const unsigned long long key);
+
+	void BeginInPlaceStage(const Stage stage, const unsigned long long key);
+
+	void EndStage();
+
+	void CancelStage();
+
+	void Finish();
+
+	void SetCloud(const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& cloud, const bool shared);
+
+	void SetPixelIndex(const std::vector<int>* pixel_index);
+
+	const pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& GetCloud() const;
+
+	const std::vector<int>* GetPixelIndex() const;
+
+	const StageStatistics& GetStatistics(const Stage stage) const;
+
+private:
+	static constexpr int kBufferCount = 3;					/**< input and output of a stage, one for the viewer */
+
+	/** @struct  CacheEntry
+	 *  @brief Output of a stage kept for the same frame
+	 */
+	struct CacheEntry {
+		bool valid;
+		unsigned long long key;								/**< frame and the parameters of the stage and the upstream stages */
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+		bool has_pixel_index;								/**< false: the pixels are unknown (nullptr) */
+		std::vector<int> pixel_index;						/**< pixel of each point */
+	};
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr& SelectBuffer();
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr buffer_[kBufferCount];
+	int buffer_index_;										/**< next buffer to check */
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_;			/**< output of the last stage */
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr stage_output_;	/**< output of the running stage */
+	const std::vector<int>* pixel_index_;					/**< pixel of each point of cloud_, nullptr: unknown */
+	bool cloud_cached_;										/**< cloud_ is a cache entry or shared, it is not modified */
+
+	bool has_frame_key_;
+	unsigned long long frame_key_;							/**< frame of the last Start */
+	bool caching_;											/**< the frame is the same as the previous one, the outputs are cached */
+	CacheEntry cache_[(int)Stage::kCount];
+
+	Stage stage_;											/**< running stage */
+	unsigned long long stage_key_;							/**< key of the running stage */
+	std::chrono::steady_clock::time_point stage_start_;
+	StageStatistics statistics_[(int)Stage::kCount];
+
+};
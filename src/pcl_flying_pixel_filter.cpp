@@ -0,0 +1,230 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_flying_pixel_filter.cpp
+ * @brief Flying pixel (depth discontinuity) filter on the disparity.
+ * @version 0.1
+ *
+ * @details The stereo matching gives disparities between the foreground and the background along the edges of objects,
+ *  they are projected to points floating in the air. They are removed here, before the projection,
+ *  with a 3x3 stencil on the disparity instead of the filters on the point cloud.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_flying_pixel_filter.h"
+
+/**
+ * 画素が近傍と不連続かどうかを返します.
+ *
+ * @param[in] depth 画素の視差
+ * @param[in] neighbor 近傍の視差
+ * @param[in] d_inf カメラ固有パラメータ
+ * @param[in] threshold しきい値
+ *
+ * @retval true 不連続
+ * @retval false 連続、または近傍が無効
+ *
+ * @details SIMD版と同じ演算です
+ */
+static inline bool IsDiscontinuous(const float depth, const float neighbor, const float d_inf, const float threshold)
+{
+	return ((neighbor - d_inf) > 0) && (std::fabs(depth - neighbor) > threshold);
+}
+
+/**
+ * 1画素を判定します（参照実装）.
+ *
+ * @param[in] rows 前、現在、次の行 (画像の外は nullptr)
+ * @param[in] j 列
+ * @param[in] width 幅
+ * @param[in] d_inf カメラ固有パラメータ
+ * @param[in] ratio 距離の比のしきい値
+ * @param[in] margin 視差のしきい値への加算値
+ *
+ * @return 出力の視差 (除外した画素は d_inf)
+ */
+static inline float FilterPixel(const float* const rows[3], const int j, const int width, const float d_inf, const float ratio, const float margin)
+{
+	const float depth = rows[1][j];
+	const float value = depth - d_inf;
+	if (!(value > 0)) {
+		return depth;
+	}
+
+	const float threshold = (value * ratio) + margin;
+
+	for (int r = 0; r < 3; r++) {
+		const float* row = rows[r];
+		if (row == nullptr) {
+			continue;
+		}
+
+		for (int k = j - 1; k <= j + 1; k++) {
+			if (k < 0 || k >= width || (r == 1 && k == j)) {
+				continue;
+			}
+
+			if (IsDiscontinuous(depth, row[k], d_inf, threshold)) {
+				return d_inf;
+			}
+		}
+	}
+
+	return depth;
+}
+
+/**
+ * constructor
+ *
+ */
+PclFlyingPixelFilter::PclFlyingPixelFilter():
+	filtered_data_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclFlyingPixelFilter::~PclFlyingPixelFilter()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] width_max 最大データ幅
+ * @param[in] height_max 最大データ高さ
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclFlyingPixelFilter::Initialize(const int width_max, const int height_max)
+{
+	if (width_max <= 0 || height_max <= 0) {
+		return -1;
+	}
+
+	filtered_data_.create(height_max, width_max, CV_32F);
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclFlyingPixelFilter::Terminate()
+{
+	filtered_data_.release();
+
+	return 0;
+}
+
+/**
+ * 視差の不連続な画素を除外します.
+ *
+ * @param[in] d_inf カメラ固有パラメータ
+ * @param[in] ratio 距離の比のしきい値 (0.05: 5%)
+ * @param[in] depth_data 視差 (CV_32F)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 8近傍の有効な視差のいずれかとの差が (d - d_inf) * ratio + kDisparityMargin を超える画素を無効 (d_inf) とします.
+ *  視差の差 / 視差 は距離の差 / 距離 とほぼ等しいため、しきい値は距離に比例します.
+ *  結果は GetFilteredData で取得します. 行ごとに並列に処理し、内側の画素は SSE2 で4画素ずつ処理します
+ */
+int PclFlyingPixelFilter::Filter(const float d_inf, const float ratio, const cv::Mat& depth_data)
+{
+	if (depth_data.type() != CV_32F || depth_data.cols <= 0 || depth_data.rows <= 0) {
+		return -1;
+	}
+
+	const int width = depth_data.cols;
+	const int height = depth_data.rows;
+	const float margin = kDisparityMargin;
+
+	filtered_data_.create(height, width, CV_32F);
+
+	cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+		const __m128 d_inf_4 = _mm_set1_ps(d_inf);
+		const __m128 ratio_4 = _mm_set1_ps(ratio);
+		const __m128 margin_4 = _mm_set1_ps(margin);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 sign_mask = _mm_set1_ps(-0.0F);
+
+		for (int i = range.start; i < range.end; i++) {
+			const float* const rows[3] = {
+				(i > 0) ? depth_data.ptr<float>(i - 1) : nullptr,
+				depth_data.ptr<float>(i),
+				(i < height - 1) ? depth_data.ptr<float>(i + 1) : nullptr
+			};
+			float* dst = filtered_data_.ptr<float>(i);
+
+			int j = 0;
+			if (rows[0] != nullptr && rows[2] != nullptr) {
+				dst[0] = FilterPixel(rows, 0, width, d_inf, ratio, margin);
+				j = 1;
+
+				for (; j + 4 <= width - 1; j += 4) {
+					const __m128 depth = _mm_loadu_ps(rows[1] + j);
+					const __m128 value = _mm_sub_ps(depth, d_inf_4);
+					const __m128 valid = _mm_cmpgt_ps(value, zero);
+					const __m128 threshold = _mm_add_ps(_mm_mul_ps(value, ratio_4), margin_4);
+
+					__m128 reject = _mm_setzero_ps();
+					for (int r = 0; r < 3; r++) {
+						for (int k = -1; k <= 1; k++) {
+							if (r == 1 && k == 0) {
+								continue;
+							}
+
+							const __m128 neighbor = _mm_loadu_ps(rows[r] + j + k);
+							const __m128 neighbor_valid = _mm_cmpgt_ps(_mm_sub_ps(neighbor, d_inf_4), zero);
+							const __m128 difference = _mm_andnot_ps(sign_mask, _mm_sub_ps(depth, neighbor));
+							reject = _mm_or_ps(reject, _mm_and_ps(_mm_cmpgt_ps(difference, threshold), neighbor_valid));
+						}
+					}
+					reject = _mm_and_ps(reject, valid);
+
+					_mm_storeu_ps(dst + j, _mm_or_ps(_mm_and_ps(reject, d_inf_4), _mm_andnot_ps(reject, depth)));
+				}
+			}
+
+			for (; j < width; j++) {
+				dst[j] = FilterPixel(rows, j, width, d_inf, ratio, margin);
+			}
+		}
+	});
+
+	return 0;
+}
+
+/**
+ * 最後の結果を取得します.
+ *
+ * @return 視差 (CV_32F 入力と同じ大きさ)
+ */
+cv::Mat& PclFlyingPixelFilter::GetFilteredData()
+{
+	return filtered_data_;
+}
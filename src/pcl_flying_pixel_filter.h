@@ -0,0 +1,46 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_flying_pixel_filter.h
+ * @brief Flying pixel (depth discontinuity) filter on the disparity.
+ */
+
+#pragma once
+
+/**
+ * @class   PclFlyingPixelFilter
+ * @brief   Flying pixel filter class
+ * this class keeps the filtered disparity and reuses it for every frame
+ */
+class PclFlyingPixelFilter {
+public:
+
+	PclFlyingPixelFilter();
+	~PclFlyingPixelFilter();
+
+	int Initialize(const int width_max, const int height_max);
+
+	int Terminate();
+
+	int Filter(const float d_inf, const float ratio, const cv::Mat& depth_data);
+
+	cv::Mat& GetFilteredData();
+
+private:
+	static constexpr float kDisparityMargin = 0.5F;			/**< pixels, added to the threshold for the noise of the disparity */
+
+	cv::Mat filtered_data_;									/**< filtered disparity (CV_32F) */
+
+};
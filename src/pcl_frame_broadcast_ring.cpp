@@ -0,0 +1,362 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_frame_broadcast_ring.cpp
+ * @brief Ring to hand the frames of PclFramePool to several consumers.
+ * @version 0.1
+ *
+ * @details PclFrameTripleBuffer has one consumer, the build thread of the 3D view. A recorder or a publisher
+ *  attached to it would take frames away from the view, and a copy for each of them costs a memcpy of every image.
+ *  This ring stores a reference of the frame instead of the images, and each consumer reads it with its own cursor.
+ *  A kLossless consumer reads every frame in order, the slots are kept until every kLossless consumer has read them.
+ *  When the ring is full the producer does not wait, the consumer which lags behind drops its own oldest frame,
+ *  so a slow consumer never blocks the camera, the other consumers, or the frames of the pool.
+ *  A kLatestOnly consumer reads the latest frame and keeps only that slot. The consumer gets its own reference
+ *  and releases it with PclFramePool::Release, the slot is released by the ring independently.
+ *  The state is guarded by a mutex, it is held only to move the cursors and the references.
+ */
+
+#include <stdio.h>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#include "pcl_def.h"
+
+#include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
+#include "pcl_frame_broadcast_ring.h"
+
+/**
+ * constructor
+ *
+ */
+PclFrameBroadcastRing::PclFrameBroadcastRing():
+	slot_count_(0), slots_(nullptr), consumer_max_(0), consumers_(nullptr), consumer_count_(0),
+	write_sequence_(0), release_sequence_(0), dropped_count_(0)
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclFrameBroadcastRing::~PclFrameBroadcastRing()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] slot_count Ringの大きさ (kLossless の Consumer が遅れることのできるフレーム数)
+ * @param[in] consumer_max 登録できる Consumer の数
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclFrameBroadcastRing::Initialize(const int slot_count, const int consumer_max)
+{
+	if (slot_count < 2 || consumer_max <= 0) {
+		// the latest slot and the slot to be written
+		return -1;
+	}
+
+	slot_count_ = slot_count;
+	slots_ = new Slot[slot_count_];
+	for (int i = 0; i < slot_count_; i++) {
+		slots_[i].frame = nullptr;
+		slots_[i].sequence = -1;
+	}
+
+	consumer_max_ = consumer_max;
+	consumers_ = new Consumer[consumer_max_];
+	for (int i = 0; i < consumer_max_; i++) {
+		consumers_[i].registered = false;
+		consumers_[i].policy = Policy::kLatestOnly;
+		consumers_[i].cursor = 0;
+		consumers_[i].skipped_count = 0;
+	}
+	consumer_count_ = 0;
+
+	write_sequence_ = 0;
+	release_sequence_ = 0;
+	dropped_count_ = 0;
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ *
+ * @details Ringの保持するフレームの参照を解放します. Get で待機している Consumer が無い状態で呼び出します
+ */
+int PclFrameBroadcastRing::Terminate()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (int i = 0; i < slot_count_; i++) {
+			PclFramePool::Release(slots_[i].frame);
+			slots_[i].frame = nullptr;
+		}
+		release_sequence_ = write_sequence_;
+	}
+
+	delete[] slots_;
+	slots_ = nullptr;
+	slot_count_ = 0;
+
+	delete[] consumers_;
+	consumers_ = nullptr;
+	consumer_max_ = 0;
+	consumer_count_ = 0;
+
+	return 0;
+}
+
+/**
+ * Consumer を登録します.
+ *
+ * @param[in] policy 読み出し方法
+ *
+ * @return Consumer の番号. 空きが無い場合は -1
+ *
+ * @details 登録後に Put されたフレームから読み出します
+ */
+int PclFrameBroadcastRing::AddConsumer(const Policy policy)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (int i = 0; i < consumer_max_; i++) {
+		if (!consumers_[i].registered) {
+			consumers_[i].registered = true;
+			consumers_[i].policy = policy;
+			consumers_[i].cursor = write_sequence_;
+			consumers_[i].skipped_count = 0;
+			consumer_count_++;
+
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Consumer の登録を解除します.
+ *
+ * @param[in] consumer_id Consumer の番号
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details Get で待機している Consumer は -1 で戻ります. 読み出し済みのフレームの参照は Consumer が解放します
+ */
+int PclFrameBroadcastRing::RemoveConsumer(const int consumer_id)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (consumer_id < 0 || consumer_id >= consumer_max_ || !consumers_[consumer_id].registered) {
+			return -1;
+		}
+
+		consumers_[consumer_id].registered = false;
+		consumer_count_--;
+
+		// the slots kept for the consumer
+		ReleaseSlots();
+	}
+	put_condition_.notify_all();
+
+	return 0;
+}
+
+/**
+ * フレームを入力します.
+ *
+ * @param[in] frame フレーム. 呼び出し側の参照はそのまま残ります
+ *
+ * @retval 0 成功 (Consumer が無い場合を含む)
+ * @retval -1 フレームがプールのものではないため、破棄しました
+ *
+ * @details 書き込み側の1つのスレッドから呼び出します. 待機はしません.
+ *  Ringが一杯の場合は、最も古いスロットを読んでいない kLossless の Consumer がそのフレームを読み飛ばします
+ */
+int PclFrameBroadcastRing::Put(PclFrame* frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		if (consumer_count_ == 0) {
+			return 0;
+		}
+
+		if (frame == nullptr) {
+			// the images were not in a frame of the pool
+			dropped_count_++;
+			return -1;
+		}
+
+		ReleaseSlots();
+
+		if (write_sequence_ - release_sequence_ >= slot_count_) {
+			// the oldest slot is not read by a kLossless consumer yet, the consumer drops it
+			for (int i = 0; i < consumer_max_; i++) {
+				if (consumers_[i].registered && consumers_[i].policy == Policy::kLossless && consumers_[i].cursor <= release_sequence_) {
+					consumers_[i].skipped_count += release_sequence_ + 1 - consumers_[i].cursor;
+					consumers_[i].cursor = release_sequence_ + 1;
+				}
+			}
+			ReleaseSlots();
+		}
+
+		Slot* slot = &slots_[write_sequence_ % slot_count_];
+		PclFramePool::Release(slot->frame);
+
+		PclFramePool::AddReference(frame);
+		slot->frame = frame;
+		slot->sequence = write_sequence_;
+
+		write_sequence_++;
+	}
+	put_condition_.notify_all();
+
+	return 0;
+}
+
+/**
+ * Consumer の次のフレームを取得します.
+ *
+ * @param[in] consumer_id Consumer の番号
+ * @param[in] timeout 最大の待ち時間(ms) 0:待たない 負の値:無制限
+ * @param[out] frame フレーム. 使用後に PclFramePool::Release で解放します
+ *
+ * @retval 0 成功
+ * @retval -1 フレームが無い、または登録が解除されました
+ */
+int PclFrameBroadcastRing::Get(const int consumer_id, const int timeout, PclFrame** frame)
+{
+	*frame = nullptr;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	if (consumer_id < 0 || consumer_id >= consumer_max_ || !consumers_[consumer_id].registered) {
+		return -1;
+	}
+
+	Consumer* consumer = &consumers_[consumer_id];
+	auto is_ready = [this, consumer] { return !consumer->registered || consumer->cursor < write_sequence_; };
+
+	if (timeout < 0) {
+		put_condition_.wait(lock, is_ready);
+	}
+	else if (timeout > 0) {
+		put_condition_.wait_for(lock, std::chrono::milliseconds(timeout), is_ready);
+	}
+
+	if (!consumer->registered || consumer->cursor >= write_sequence_) {
+		return -1;
+	}
+
+	if (consumer->policy == Policy::kLatestOnly) {
+		consumer->skipped_count += (write_sequence_ - 1) - consumer->cursor;
+		consumer->cursor = write_sequence_ - 1;
+	}
+
+	Slot* slot = &slots_[consumer->cursor % slot_count_];
+	PclFramePool::AddReference(slot->frame);
+	*frame = slot->frame;
+	consumer->cursor++;
+
+	// the slot may be the last one kept for a kLossless consumer
+	ReleaseSlots();
+
+	return 0;
+}
+
+/**
+ * Consumer が読み飛ばしたフレーム数を取得します. kLossless の Consumer は遅れて破棄したフレーム数です
+ *
+ * @param[in] consumer_id Consumer の番号
+ *
+ * @return フレーム数. 登録されていない場合は -1
+ */
+long long PclFrameBroadcastRing::GetSkippedCount(const int consumer_id)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (consumer_id < 0 || consumer_id >= consumer_max_ || !consumers_[consumer_id].registered) {
+		return -1;
+	}
+
+	return consumers_[consumer_id].skipped_count;
+}
+
+/**
+ * プールのものではないため破棄したフレーム数を取得します.
+ *
+ * @return フレーム数
+ */
+long long PclFrameBroadcastRing::GetDroppedCount()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	return dropped_count_;
+}
+
+/**
+ * 全ての Consumer が必要としないスロットの参照を解放します.
+ *
+ * @details mutex_ を取得して呼び出します.
+ *  kLossless の Consumer の最も古いカーソルから後、kLatestOnly の Consumer がある場合は最新のスロットを残します
+ */
+void PclFrameBroadcastRing::ReleaseSlots()
+{
+	long long keep_sequence = write_sequence_;
+	bool has_latest_only = false;
+
+	for (int i = 0; i < consumer_max_; i++) {
+		if (!consumers_[i].registered) {
+			continue;
+		}
+
+		if (consumers_[i].policy == Policy::kLossless) {
+			keep_sequence = (std::min)(keep_sequence, consumers_[i].cursor);
+		}
+		else {
+			has_latest_only = true;
+		}
+	}
+
+	if (has_latest_only && write_sequence_ > 0) {
+		keep_sequence = (std::min)(keep_sequence, write_sequence_ - 1);
+	}
+
+	for (; release_sequence_ < keep_sequence; release_sequence_++) {
+		Slot* slot = &slots_[release_sequence_ % slot_count_];
+		if (slot->sequence == release_sequence_) {
+			PclFramePool::Release(slot->frame);
+			slot->frame = nullptr;
+		}
+	}
+
+	return;
+}
@@ -0,0 +1,92 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_frame_broadcast_ring.h
+ * @brief Ring to hand the frames of PclFramePool to several consumers.
+ */
+
+#pragma once
+
+/**
+ * @class   PclFrameBroadcastRing
+ * @brief   Buffer class
+ * this class passes every frame from one producer thread to the registered consumers, each consumer has its own read cursor
+ */
+class PclFrameBroadcastRing {
+public:
+
+	/** @enum  Policy
+	 *  @brief Reading policy of a consumer
+	 */
+	enum class Policy {
+		kLossless,				/**< every frame in order, the consumer drops its oldest frame when it lags the ring size behind */
+		kLatestOnly				/**< the latest frame, older frames are skipped */
+	};
+
+	PclFrameBroadcastRing();
+	~PclFrameBroadcastRing();
+
+	int Initialize(const int slot_count, const int consumer_max);
+
+	int Terminate();
+
+	int AddConsumer(const Policy policy);
+
+	int RemoveConsumer(const int consumer_id);
+
+	int Put(PclFrame* frame);
+
+	int Get(const int consumer_id, const int timeout, PclFrame** frame);
+
+	long long GetSkippedCount(const int consumer_id);
+
+	long long GetDroppedCount();
+
+private:
+	/** @struct  Slot
+	 *  @brief Frame in the ring
+	 */
+	struct Slot {
+		PclFrame* frame;					/**< the ring holds one reference, nullptr when released */
+		long long sequence;					/**< put number of the frame */
+	};
+
+	/** @struct  Consumer
+	 *  @brief Read cursor of a consumer
+	 */
+	struct Consumer {
+		bool registered;
+		Policy policy;
+		long long cursor;					/**< sequence of the next frame to read */
+		long long skipped_count;			/**< frames the consumer did not read (kLatestOnly: older frames, kLossless: dropped when it lagged) */
+	};
+
+	void ReleaseSlots();
+
+	std::mutex mutex_;
+	std::condition_variable put_condition_;	/**< notified by Put and RemoveConsumer */
+
+	int slot_count_;
+	Slot* slots_;
+
+	int consumer_max_;
+	Consumer* consumers_;
+	int consumer_count_;
+
+	long long write_sequence_;				/**< sequence of the next frame to put */
+	long long release_sequence_;			/**< the slots before this sequence are released */
+	long long dropped_count_;				/**< frames not put, they were not in a frame of the pool */
+
+};
@@ -0,0 +1,188 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_frame_pool.cpp
+ * @brief Pool of reference counted frames handed to the 3D view without a copy.
+ * @version 0.1
+ *
+ * @details The filling side (GUI thread) acquires a frame, moves the images of the camera into it and passes
+ *  the frame to RunPclViz, the frame buffer holds the reference until the build thread is done with it.
+ *  The pool does not allocate the images, the filling side attaches its buffers to each frame (user_data).
+ *  A frame with no reference is free, Acquire takes it with one atomic operation and Release returns it,
+ *  the frames are released by the thread which drops the last reference without a lock.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+#include "pcl_def.h"
+
+#include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
+
+/**
+ * constructor
+ *
+ */
+PclFramePool::PclFramePool():
+	frame_count_(0), frames_(nullptr), next_index_(0)
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclFramePool::~PclFramePool()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] count フレームの数
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclFramePool::Initialize(const int count)
+{
+	if (count <= 0) {
+		return -1;
+	}
+
+	frame_count_ = count;
+	frames_ = new PclFrame[frame_count_];
+	next_index_ = 0;
+
+	for (int i = 0; i < frame_count_; i++) {
+		frames_[i].reference_count.store(0, std::memory_order_relaxed);
+		frames_[i].index = i;
+		memset(&frames_[i].pcl_data, 0, sizeof(PclDataRingBuffer::PclData));
+		frames_[i].user_data = nullptr;
+	}
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ *
+ * @details 全ての参照が解放された後に呼び出します
+ */
+int PclFramePool::Terminate()
+{
+	for (int i = 0; i < frame_count_; i++) {
+		if (frames_[i].reference_count.load(std::memory_order_acquire) != 0) {
+			printf("[ERROR]PclFramePool: frame %d is still referenced\n", i);
+		}
+	}
+
+	delete[] frames_;
+	frames_ = nullptr;
+	frame_count_ = 0;
+
+	return 0;
+}
+
+/**
+ * フレームの数を取得します.
+ *
+ * @return フレームの数
+ */
+int PclFramePool::GetCount() const
+{
+	return frame_count_;
+}
+
+/**
+ * フレームを取得します. バッファーを設定するために使用します
+ *
+ * @param[in] index フレームの番号
+ *
+ * @return フレーム. 範囲外の場合は nullptr
+ */
+PclFrame* PclFramePool::GetFrame(const int index)
+{
+	if (index < 0 || index >= frame_count_) {
+		return nullptr;
+	}
+
+	return &frames_[index];
+}
+
+/**
+ * 空いているフレームを取得します.
+ *
+ * @return 参照数 1 のフレーム. 空きが無い場合は nullptr
+ *
+ * @details 書き込み側の1つのスレッドから呼び出します
+ */
+PclFrame* PclFramePool::Acquire()
+{
+	for (int i = 0; i < frame_count_; i++) {
+		int index = next_index_ + i;
+		if (index >= frame_count_) {
+			index -= frame_count_;
+		}
+
+		// acquire: the last reader is done with the buffers of the frame
+		int expected = 0;
+		if (frames_[index].reference_count.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+			next_index_ = (index + 1 < frame_count_) ? index + 1 : 0;
+			return &frames_[index];
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * フレームの参照を追加します.
+ *
+ * @param[in] frame フレーム
+ */
+void PclFramePool::AddReference(PclFrame* frame)
+{
+	if (frame == nullptr) {
+		return;
+	}
+
+	frame->reference_count.fetch_add(1, std::memory_order_relaxed);
+
+	return;
+}
+
+/**
+ * フレームの参照を解放します. 最後の参照の場合はプールに戻ります
+ *
+ * @param[in] frame フレーム
+ */
+void PclFramePool::Release(PclFrame* frame)
+{
+	if (frame == nullptr) {
+		return;
+	}
+
+	// release: the reads of this thread are done before the frame is acquired again
+	frame->reference_count.fetch_sub(1, std::memory_order_release);
+
+	return;
+}
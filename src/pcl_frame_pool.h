@@ -0,0 +1,63 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_frame_pool.h
+ * @brief Pool of reference counted frames handed to the 3D view without a copy.
+ */
+
+#pragma once
+
+/** @struct  PclFrame
+ *  @brief Frame of the pool
+ */
+struct PclFrame {
+	std::atomic<int> reference_count;			/**< 0:in the pool */
+	int index;									/**< frame number in the pool */
+
+	PclDataRingBuffer::PclData pcl_data;		/**< images, they point to the buffers attached by the filling side */
+	void* user_data;							/**< buffers attached by the filling side */
+};
+
+/**
+ * @class   PclFramePool
+ * @brief   Frame pool class
+ * this class recycles the frames when the last reference is released
+ */
+class PclFramePool {
+public:
+
+	PclFramePool();
+	~PclFramePool();
+
+	int Initialize(const int count);
+
+	int Terminate();
+
+	int GetCount() const;
+
+	PclFrame* GetFrame(const int index);
+
+	PclFrame* Acquire();
+
+	static void AddReference(PclFrame* frame);
+
+	static void Release(PclFrame* frame);
+
+private:
+	int frame_count_;
+	PclFrame* frames_;
+	int next_index_;							/**< the search of Acquire starts here (used by the filling thread) */
+
+};
@@ -0,0 +1,297 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_frame_triple_buffer.cpp
+ * @brief Lock-free triple buffer to hand the latest frame to the build thread.
+ * @version 0.1
+ *
+ * @details PclDataRingBuffer guards the state of the buffers with a lock, and in the last mode
+ *  the producer fails while the consumer holds the buffer to be written. Only the latest frame is built,
+ *  so three buffers are enough: one owned by the producer, one owned by the consumer and the latest one between them.
+ *  The producer publishes by exchanging its buffer with the latest one, and the consumer takes the latest one
+ *  by exchanging it with its buffer. Each exchange is one atomic operation, neither side waits or fails,
+ *  and the consumer always gets the newest complete frame. The interface is the same as PclDataRingBuffer.
+ *  A buffer can hold a frame of PclFramePool instead of the images, its reference is released by the producer
+ *  when the buffer is written again, the consumer has given the buffer back by then.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+#include "pcl_def.h"
+
+#include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
+#include "pcl_frame_triple_buffer.h"
+
+/**
+ * constructor
+ *
+ */
+PclFrameTripleBuffer::PclFrameTripleBuffer():
+	width_(0), height_(0), buffer_data_(nullptr),
+	put_index_(0), latest_(1), get_index_(2),
+	buff_image_(nullptr), buff_disparity_image_bgra_(nullptr), buff_disparity_data_(nullptr)
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclFrameTripleBuffer::~PclFrameTripleBuffer()
+{
+}
+
+/**
+ * バッファーを初期化します.
+ *
+ * @param[in] width_def データ幅
+ * @param[in] height_def データ高さ
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclFrameTripleBuffer::Initialize(const int width_def, const int height_def)
+{
+	if (width_def <= 0 || height_def <= 0) {
+		return -1;
+	}
+
+	width_ = width_def;
+	height_ = height_def;
+
+	// the producer, the latest and the consumer own one buffer each
+	put_index_ = 0;
+	latest_.store(1, std::memory_order_relaxed);
+	get_index_ = 2;
+
+	buffer_data_ = new BufferData[kBufferCount];
+
+	const size_t one_frame_size = (size_t)width_ * height_;
+
+	buff_image_					= new unsigned char[kBufferCount * one_frame_size * 4];
+	buff_disparity_data_		= new float[kBufferCount * one_frame_size];
+	buff_disparity_image_bgra_	= new unsigned char[kBufferCount * one_frame_size * 4];
+
+	memset(buff_image_,					0, kBufferCount * one_frame_size * 4);
+	memset(buff_disparity_data_,		0, kBufferCount * one_frame_size * sizeof(float));
+	memset(buff_disparity_image_bgra_,	0, kBufferCount * one_frame_size * 4);
+
+	for (int i = 0; i < kBufferCount; i++) {
+		buffer_data_[i].inedx = i;
+		buffer_data_[i].state = 0;
+		buffer_data_[i].time = 0;
+
+		buffer_data_[i].pcl_data.width = width_;
+		buffer_data_[i].pcl_data.height = height_;
+		buffer_data_[i].pcl_data.base_image_channel_count = 1;
+
+		buffer_data_[i].pcl_data.depth_width = width_;
+		buffer_data_[i].pcl_data.depth_height = height_;
+
+		buffer_data_[i].pcl_data.frame_no = 0;
+		buffer_data_[i].pcl_data.frame_time = 0;
+
+		memset(&buffer_data_[i].pcl_filter_parameter, 0, sizeof(PclFilterParameter));
+		buffer_data_[i].frame = nullptr;
+
+		size_t unit = one_frame_size * 4;
+		buffer_data_[i].pcl_data.image = buff_image_ + (unit * i);
+
+		unit = one_frame_size;
+		buffer_data_[i].pcl_data.disparity_data = buff_disparity_data_ + (unit * i);
+
+		unit = one_frame_size * 4;
+		buffer_data_[i].pcl_data.disparity_image_bgra = buff_disparity_image_bgra_ + (unit * i);
+	}
+
+	return 0;
+}
+
+/**
+ * 読み込まれていないフレームを破棄します.
+ *
+ * @retval 0 成功
+ *
+ * @details 各スレッドが使用中のバッファーはそのままです. 動作中に呼び出すことができます
+ */
+int PclFrameTripleBuffer::Clear()
+{
+	if (buffer_data_ == nullptr) {
+		return 0;
+	}
+
+	latest_.fetch_and(kIndexMask, std::memory_order_acq_rel);
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclFrameTripleBuffer::Terminate()
+{
+	if (buffer_data_ != nullptr) {
+		for (int i = 0; i < kBufferCount; i++) {
+			PclFramePool::Release(buffer_data_[i].frame);
+			buffer_data_[i].frame = nullptr;
+		}
+	}
+
+	delete[] buff_image_;
+	delete[] buff_disparity_data_;
+	delete[] buff_disparity_image_bgra_;
+
+	buff_image_ = nullptr;
+	buff_disparity_data_ = nullptr;
+	buff_disparity_image_bgra_ = nullptr;
+
+	delete[] buffer_data_;
+	buffer_data_ = nullptr;
+
+	return 0;
+}
+
+/**
+ * 書き込み対象のバッファーのポインタを取得します.
+ *
+ * @param[in/out] buffer_data バッファーのポインタを書き込みます
+ * @param[in] time 現在時間です
+ *
+ * @retval >=0 バッファーのIndex
+ * @retval -1 失敗 初期化されていません
+ *
+ * @details 書き込み用のバッファーは常に producer が所有しているため、失敗しません
+ */
+int PclFrameTripleBuffer::GetPutBuffer(BufferData** buffer_data, const std::uint64_t time)
+{
+	if (buffer_data_ == nullptr) {
+		return -1;
+	}
+
+	// the frame of the previous use is no longer read by the consumer
+	PclFramePool::Release(buffer_data_[put_index_].frame);
+	buffer_data_[put_index_].frame = nullptr;
+
+	*buffer_data = &buffer_data_[put_index_];
+
+	buffer_data_[put_index_].time = time;
+	buffer_data_[put_index_].state = 1;
+
+	return put_index_;
+}
+
+/**
+ * 書き込んだバッファーを公開します.
+ *
+ * @param[in] index バッファーのIndexです。取得時のものです
+ * @param[in] status 1:有効です
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 最新のバッファーと交換します. 読み込まれていない前のフレームは次の書き込みに使用されます
+ */
+int PclFrameTripleBuffer::DonePutBuffer(const int index, const int status)
+{
+	// status 0:This data is invalid 1:This data is valid
+
+	if (buffer_data_ == nullptr) {
+		return -1;
+	}
+
+	if (index != put_index_) {
+		// Get and Done must correspond one-to-one on the same Thread
+		return -1;
+	}
+
+	if (status == 0) {
+		// the buffer is written again by the next frame
+		PclFramePool::Release(buffer_data_[index].frame);
+		buffer_data_[index].frame = nullptr;
+		buffer_data_[index].state = 0;
+		return 0;
+	}
+
+	buffer_data_[index].state = 2;
+
+	// release: the data of the buffer is visible to the consumer which takes it
+	// acquire: the buffer taken back is no longer read by the consumer
+	put_index_ = latest_.exchange(index | kFreshFlag, std::memory_order_acq_rel) & kIndexMask;
+
+	return 0;
+}
+
+/**
+ * 最新のフレームのバッファーのポインタを取得します.
+ *
+ * @param[in/out] buffer_data バッファーのポインタを書き込みます
+ * @param[in] time_get 書き込み時間です
+ *
+ * @retval >=0 バッファーのIndex
+ * @retval -1 失敗 新しいデータ無し
+ */
+int PclFrameTripleBuffer::GetGetBuffer(BufferData** buffer_data, std::uint64_t* time_get)
+{
+	if (buffer_data_ == nullptr) {
+		return -1;
+	}
+
+	if ((latest_.load(std::memory_order_relaxed) & kFreshFlag) == 0) {
+		return -1;
+	}
+
+	// the producer only sets kFreshFlag, it is cleared by this thread and Clear (then the last frame is read again)
+	get_index_ = latest_.exchange(get_index_, std::memory_order_acq_rel) & kIndexMask;
+
+	*buffer_data = &buffer_data_[get_index_];
+
+	*time_get = buffer_data_[get_index_].time;
+	buffer_data_[get_index_].state = 3;
+
+	return get_index_;
+}
+
+/**
+ * 取得したバッファーの使用を終了します.
+ *
+ * @param[in] index バッファーのIndexです。取得時のものです
+ *
+ * @details バッファーは次の GetGetBuffer で交換されるまで consumer が所有します
+ */
+void PclFrameTripleBuffer::DoneGetBuffer(const int index)
+{
+	if (buffer_data_ == nullptr) {
+		return;
+	}
+
+	if (index != get_index_) {
+		// Get and Done must correspond one-to-one on the same Thread
+		printf("[ERROR]Get and Done must correspond one-to-one on the same Thread\n");
+		return;
+	}
+
+	buffer_data_[index].state = 0;
+
+	return;
+}
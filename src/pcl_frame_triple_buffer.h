@@ -0,0 +1,65 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_frame_triple_buffer.h
+ * @brief Lock-free triple buffer to hand the latest frame to the build thread.
+ */
+
+#pragma once
+
+/**
+ * @class   PclFrameTripleBuffer
+ * @brief   Buffer class
+ * this class passes the latest frame from one producer thread to one consumer thread without a lock
+ */
+class PclFrameTripleBuffer {
+public:
+	using BufferData = PclDataRingBuffer::BufferData;
+
+	PclFrameTripleBuffer();
+	~PclFrameTripleBuffer();
+
+	int Initialize(const int width_def, const int height_def);
+
+	int Clear();
+
+	int Terminate();
+
+	int GetPutBuffer(BufferData** buffer_data, const std::uint64_t time);
+
+	int DonePutBuffer(const int index, const int status);
+
+	int GetGetBuffer(BufferData** buffer_data, std::uint64_t* time_get);
+
+	void DoneGetBuffer(const int index);
+
+private:
+	static constexpr int kBufferCount = 3;					/**< write, latest and read */
+	static constexpr int kIndexMask = 0x03;					/**< buffer number in latest_ */
+	static constexpr int kFreshFlag = 0x04;					/**< latest_ has not been read */
+
+	int width_, height_;
+
+	BufferData* buffer_data_;
+
+	int put_index_;											/**< written by the producer, only the producer uses it */
+	std::atomic<int> latest_;								/**< latest written buffer | kFreshFlag, exchanged by both threads */
+	int get_index_;											/**< read by the consumer, only the consumer uses it */
+
+	unsigned char* buff_image_;
+	unsigned char* buff_disparity_image_bgra_;
+	float* buff_disparity_data_;
+
+};
@@ -0,0 +1,366 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_normal_estimator.cpp
+ * @brief Surface normal estimation on the pixel grid of the cloud.
+ * @version 0.1
+ *
+ * @details pcl::NormalEstimation searches the neighbors of every point with a KdTree, it is too slow for every frame.
+ *  The points of the cloud are on the pixel grid of the disparity, so the neighbors are the points in a pixel window.
+ *  The normal is the cross product of the horizontal and vertical gradients of the window,
+ *  the gradients are the differences of the mean positions of the window halves
+ *  (pcl::IntegralImageNormalEstimation AVERAGE_3D_GRADIENT). The means are taken from integral images,
+ *  the cost per point does not depend on the window size.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_point_cloud_builder.h"
+#include "pcl_normal_estimator.h"
+
+/**
+ * constructor
+ *
+ */
+PclNormalEstimator::PclNormalEstimator():
+	grid_(), integral_(), normals_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclNormalEstimator::~PclNormalEstimator()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] point_count_max 最大点数 (画素数)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclNormalEstimator::Initialize(const int point_count_max)
+{
+	if (point_count_max < 0) {
+		return -1;
+	}
+
+	grid_.reserve((size_t)point_count_max);
+	integral_.reserve((size_t)point_count_max * kChannelCount);
+	normals_.points.reserve((size_t)point_count_max);
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclNormalEstimator::Terminate()
+{
+	grid_.clear();
+	grid_.shrink_to_fit();
+	integral_.clear();
+	integral_.shrink_to_fit();
+	normals_.points.clear();
+	normals_.points.shrink_to_fit();
+
+	return 0;
+}
+
+/**
+ * 各点の法線を推定します.
+ *
+ * @param[in] window_size 窓の半径 (lod のブロック単位、窓は (2 * window_size + 1) 四方)
+ * @param[in] pixel_grid 画素の配置 (PclPointCloudBuilder::GetPixelGrid)
+ * @param[in] pixel_index 各点の画素の位置 (y * width + x, 点ごとに異なること)
+ * @param[in] cloud 点群データ
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 窓の右半分と左半分の点の平均位置の差を横方向、下半分と上半分の差を縦方向の勾配とし、その外積を法線とします.
+ *  法線はカメラの方向に向けます. 窓の半分に点が無い点、画素の無い点は NaN です.
+ *  結果は GetNormals で取得します (cloud と同じ順序). 行ごとに並列に処理します
+ */
+int PclNormalEstimator::Estimate(const int window_size, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+								const pcl::PointCloud<pcl::PointXYZRGBA>& cloud)
+{
+	if (window_size < 1) {
+		return -1;
+	}
+
+	const int point_count = (int)cloud.points.size();
+	if ((int)pixel_index.size() != point_count) {
+		return -1;
+	}
+
+	const int step = pixel_grid.step;
+	if (step < 1) {
+		return -1;
+	}
+
+	const int width = pixel_grid.width;
+	const int height = pixel_grid.height;
+	const int grid_width = width / step;
+	const int grid_height = height / step;
+	if (grid_width <= 0 || grid_height <= 0) {
+		return -1;
+	}
+
+	const int sample = step / 2;
+	const int integral_width = grid_width + 1;
+	const size_t integral_stride = (size_t)integral_width * kChannelCount;
+	const pcl::PointXYZRGBA* points = cloud.points.data();
+
+	const int chunk_count = (point_count + kChunkSize - 1) / kChunkSize;
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	pcl::Normal nan_normal;
+	nan_normal.normal_x = nan;
+	nan_normal.normal_y = nan;
+	nan_normal.normal_z = nan;
+	nan_normal.curvature = nan;
+
+	grid_.assign((size_t)grid_width * (size_t)grid_height, -1);
+	integral_.resize(integral_stride * ((size_t)grid_height + 1));
+	normals_.points.assign((size_t)point_count, nan_normal);
+	normals_.width = (uint32_t)point_count;
+	normals_.height = 1;
+	normals_.is_dense = false;
+	normals_.header = cloud.header;
+
+	// 1. put the points on the grid (lod block units)
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			for (int i = start; i < end; i++) {
+				const pcl::PointXYZRGBA& point = points[i];
+				if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) {
+					continue;
+				}
+
+				const int pixel = pixel_index[i];
+				if (pixel < 0 || pixel >= width * height) {
+					continue;
+				}
+
+				const int x = (pixel % width) - sample;
+				const int y = (pixel / width) - sample;
+				if (x < 0 || y < 0) {
+					continue;
+				}
+
+				const int gx = x / step;
+				const int gy = y / step;
+				if (gx < grid_width && gy < grid_height) {
+					grid_[((size_t)gy * grid_width) + gx] = i;
+				}
+			}
+		}
+	});
+
+	// 2. integral images of x, y, z and the count, sums of each row then of each column
+	std::fill(integral_.begin(), integral_.begin() + integral_stride, 0.0);
+
+	cv::parallel_for_(cv::Range(0, grid_height), [&](const cv::Range& range) {
+		for (int gy = range.start; gy < range.end; gy++) {
+			const int* cells = &grid_[(size_t)gy * grid_width];
+			double* row = &integral_[((size_t)gy + 1) * integral_stride];
+
+			double sum_x = 0, sum_y = 0, sum_z = 0, sum_count = 0;
+			row[0] = 0;
+			row[1] = 0;
+			row[2] = 0;
+			row[3] = 0;
+			for (int gx = 0; gx < grid_width; gx++) {
+				const int index = cells[gx];
+				if (index >= 0) {
+					sum_x += points[index].x;
+					sum_y += points[index].y;
+					sum_z += points[index].z;
+					sum_count += 1;
+				}
+
+				double* dst = &row[((size_t)gx + 1) * kChannelCount];
+				dst[0] = sum_x;
+				dst[1] = sum_y;
+				dst[2] = sum_z;
+				dst[3] = sum_count;
+			}
+		}
+	});
+
+	cv::parallel_for_(cv::Range(kChannelCount, (int)integral_stride), [&](const cv::Range& range) {
+		for (int gy = 1; gy <= grid_height; gy++) {
+			const double* above = &integral_[((size_t)gy - 1) * integral_stride];
+			double* row = &integral_[(size_t)gy * integral_stride];
+			for (int j = range.start; j < range.end; j++) {
+				row[j] += above[j];
+			}
+		}
+	});
+
+	// mean position of the points in a box (inclusive), false if it has no point
+	auto box_mean = [&](const int x0, const int y0, const int x1, const int y1, double mean[3]) {
+		if (x0 > x1 || y0 > y1) {
+			return false;
+		}
+
+		const double* top = &integral_[(size_t)y0 * integral_stride];
+		const double* bottom = &integral_[((size_t)y1 + 1) * integral_stride];
+		const size_t left = (size_t)x0 * kChannelCount;
+		const size_t right = ((size_t)x1 + 1) * kChannelCount;
+
+		double sum[kChannelCount];
+		for (int k = 0; k < kChannelCount; k++) {
+			sum[k] = bottom[right + k] - bottom[left + k] - top[right + k] + top[left + k];
+		}
+
+		// the sums of the counts are exact
+		if (sum[3] < 0.5) {
+			return false;
+		}
+
+		mean[0] = sum[0] / sum[3];
+		mean[1] = sum[1] / sum[3];
+		mean[2] = sum[2] / sum[3];
+
+		return true;
+	};
+
+	// 3. normal of each point from the gradients of its window
+	cv::parallel_for_(cv::Range(0, grid_height), [&](const cv::Range& range) {
+		for (int gy = range.start; gy < range.end; gy++) {
+			const int y0 = (std::max)(gy - window_size, 0);
+			const int y1 = (std::min)(gy + window_size, grid_height - 1);
+
+			for (int gx = 0; gx < grid_width; gx++) {
+				const int index = grid_[((size_t)gy * grid_width) + gx];
+				if (index < 0) {
+					continue;
+				}
+
+				const int x0 = (std::max)(gx - window_size, 0);
+				const int x1 = (std::min)(gx + window_size, grid_width - 1);
+
+				double left[3], right[3], top[3], bottom[3];
+				if (!box_mean(x0, y0, gx - 1, y1, left) || !box_mean(gx + 1, y0, x1, y1, right) ||
+					!box_mean(x0, y0, x1, gy - 1, top) || !box_mean(x0, gy + 1, x1, y1, bottom)) {
+					continue;
+				}
+
+				const double du[3] = { right[0] - left[0], right[1] - left[1], right[2] - left[2] };
+				const double dv[3] = { bottom[0] - top[0], bottom[1] - top[1], bottom[2] - top[2] };
+
+				double nx = (du[1] * dv[2]) - (du[2] * dv[1]);
+				double ny = (du[2] * dv[0]) - (du[0] * dv[2]);
+				double nz = (du[0] * dv[1]) - (du[1] * dv[0]);
+
+				const double length = std::sqrt((nx * nx) + (ny * ny) + (nz * nz));
+				if (!(length > 0)) {
+					continue;
+				}
+
+				// toward the camera
+				const pcl::PointXYZRGBA& point = points[index];
+				const double vx = (double)pixel_grid.origin_x - point.x;
+				const double vy = (double)pixel_grid.origin_y - point.y;
+				const double vz = (double)pixel_grid.origin_z - point.z;
+				const double scale = (((nx * vx) + (ny * vy) + (nz * vz)) < 0) ? (-1.0 / length) : (1.0 / length);
+
+				pcl::Normal& normal = normals_.points[index];
+				normal.normal_x = (float)(nx * scale);
+				normal.normal_y = (float)(ny * scale);
+				normal.normal_z = (float)(nz * scale);
+				normal.curvature = 0.0F;
+			}
+		}
+	});
+
+	return 0;
+}
+
+/**
+ * 点を法線の向きで着色します.
+ *
+ * @param[in,out] cloud 点群データ (Estimate と同じもの)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 法線の x, y, z を R, G, B とします ((n + 1) / 2). 法線の無い点の色は変更しません
+ */
+int PclNormalEstimator::ColorByNormal(pcl::PointCloud<pcl::PointXYZRGBA>* cloud) const
+{
+	if (cloud == nullptr) {
+		return -1;
+	}
+
+	const int point_count = (int)cloud->points.size();
+	if ((int)normals_.points.size() != point_count) {
+		return -1;
+	}
+
+	const int chunk_count = (point_count + kChunkSize - 1) / kChunkSize;
+
+	pcl::PointXYZRGBA* points = cloud->points.data();
+	const pcl::Normal* normals = normals_.points.data();
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			for (int i = start; i < end; i++) {
+				const pcl::Normal& normal = normals[i];
+				if (!std::isfinite(normal.normal_x)) {
+					continue;
+				}
+
+				points[i].r = (uint8_t)((normal.normal_x + 1.0F) * 127.5F);
+				points[i].g = (uint8_t)((normal.normal_y + 1.0F) * 127.5F);
+				points[i].b = (uint8_t)((normal.normal_z + 1.0F) * 127.5F);
+			}
+		}
+	});
+
+	return 0;
+}
+
+/**
+ * 最後の結果を取得します.
+ *
+ * @return 各点の法線 (Estimate の cloud と同じ順序、推定できない点は NaN)
+ */
+const pcl::PointCloud<pcl::Normal>& PclNormalEstimator::GetNormals() const
+{
+	return normals_;
+}
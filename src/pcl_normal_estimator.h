@@ -0,0 +1,52 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_normal_estimator.h
+ * @brief Surface normal estimation on the pixel grid of the cloud.
+ */
+
+#pragma once
+
+/**
+ * @class   PclNormalEstimator
+ * @brief   Normal estimation class for clouds made from the disparity
+ * this class keeps the work buffers and reuses them for every frame
+ */
+class PclNormalEstimator {
+public:
+
+	PclNormalEstimator();
+	~PclNormalEstimator();
+
+	int Initialize(const int point_count_max);
+
+	int Terminate();
+
+	int Estimate(const int window_size, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+				const pcl::PointCloud<pcl::PointXYZRGBA>& cloud);
+
+	int ColorByNormal(pcl::PointCloud<pcl::PointXYZRGBA>* cloud) const;
+
+	const pcl::PointCloud<pcl::Normal>& GetNormals() const;
+
+private:
+	static constexpr int kChunkSize = 16384;				/**< points per work unit */
+	static constexpr int kChannelCount = 4;					/**< x, y, z, count */
+
+	std::vector<int> grid_;									/**< point index of each cell, -1 for empty */
+	std::vector<double> integral_;							/**< integral image of the points ((width + 1) x (height + 1) x kChannelCount) */
+	pcl::PointCloud<pcl::Normal> normals_;					/**< normal of each point of the last cloud, NaN if it is not estimated */
+
+};
@@ -0,0 +1,721 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_plane_detector.cpp
+ * @brief RANSAC plane detection seeded by the plane of the previous frame.
+ * @version 0.1
+ *
+ * @details Replaces pcl::SACSegmentation (SACMODEL_PLANE, SAC_RANSAC, optimized coefficients).
+ *  The hypotheses are scored on the cloud as is (no copy) with SSE2, several of them in parallel.
+ *  The plane of the previous frame is verified first, when it still holds, the random search is skipped.
+ *  Several planes are extracted one after another from the remaining points, within a time budget.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <emmintrin.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_plane_detector.h"
+
+/**
+ * 点が平面のしきい値以内かどうかを返します.
+ *
+ * @param[in] point 点
+ * @param[in] plane 平面 (a, b, c, d)
+ * @param[in] threshold しきい値(m)
+ *
+ * @retval true しきい値以内
+ * @retval false しきい値外 (NaN を含む)
+ *
+ * @details SIMD版と同じ順序で演算するため、結果は同じです
+ */
+static inline bool IsInlier(const pcl::PointXYZRGBA& point, const float plane[4], const float threshold)
+{
+	const float distance = (((plane[0] * point.x) + (plane[1] * point.y)) + (plane[2] * point.z)) + plane[3];
+
+	return std::fabs(distance) <= threshold;
+}
+
+/**
+ * 4点が平面のしきい値以内かどうかのマスクを返します.
+ *
+ * @param[in] points 4点
+ * @param[in] a, b, c, d 平面
+ * @param[in] threshold しきい値
+ * @param[in] sign_mask 符号ビット
+ *
+ * @return マスク (しきい値以内の点は全ビット1)
+ */
+static inline __m128 InlierMask4(const pcl::PointXYZRGBA* points, const __m128 a, const __m128 b, const __m128 c, const __m128 d, const __m128 threshold, const __m128 sign_mask)
+{
+	// x, y, z, w of 4 points to x[4], y[4], z[4], w[4]
+	__m128 x = _mm_loadu_ps(points[0].data);
+	__m128 y = _mm_loadu_ps(points[1].data);
+	__m128 z = _mm_loadu_ps(points[2].data);
+	__m128 w = _mm_loadu_ps(points[3].data);
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)), _mm_mul_ps(c, z)), d);
+	distance = _mm_andnot_ps(sign_mask, distance);
+
+	// NaN is not less or equal
+	return _mm_cmple_ps(distance, threshold);
+}
+
+/**
+ * 平面のしきい値以内の点の数を数えます.
+ *
+ * @param[in] points 点
+ * @param[in] label 点のラベル (-1 の点のみ数えます)
+ * @param[in] count 点の数
+ * @param[in] plane 平面 (a, b, c, d)
+ * @param[in] threshold しきい値(m)
+ *
+ * @return 点の数
+ */
+static int CountInliers(const pcl::PointXYZRGBA* points, const int* label, const int count, const float plane[4], const float threshold)
+{
+	const __m128 a = _mm_set1_ps(plane[0]);
+	const __m128 b = _mm_set1_ps(plane[1]);
+	const __m128 c = _mm_set1_ps(plane[2]);
+	const __m128 d = _mm_set1_ps(plane[3]);
+	const __m128 threshold_4 = _mm_set1_ps(threshold);
+	const __m128 sign_mask = _mm_set1_ps(-0.0F);
+	const __m128i zero = _mm_setzero_si128();
+
+	// the mask is -1 for inliers, subtract it
+	__m128i total = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i unassigned = _mm_cmplt_epi32(_mm_loadu_si128((const __m128i*)(label + i)), zero);
+		const __m128i mask = _mm_and_si128(_mm_castps_si128(InlierMask4(points + i, a, b, c, d, threshold_4, sign_mask)), unassigned);
+		total = _mm_sub_epi32(total, mask);
+	}
+
+	alignas(16) int lanes[4];
+	_mm_store_si128((__m128i*)lanes, total);
+	int inlier_count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+	for (; i < count; i++) {
+		if (label[i] < 0 && IsInlier(points[i], plane, threshold)) {
+			inlier_count++;
+		}
+	}
+
+	return inlier_count;
+}
+
+/**
+ * constructor
+ *
+ */
+PclPlaneDetector::PclPlaneDetector():
+	seeds_(), previous_seeds_(), frames_since_search_(0), random_state_(0), chunk_sums_(), label_(), planes_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclPlaneDetector::~PclPlaneDetector()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] point_count_max 最大点数
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclPlaneDetector::Initialize(const int point_count_max)
+{
+	if (point_count_max < 0) {
+		return -1;
+	}
+
+	label_.reserve((size_t)point_count_max);
+	chunk_sums_.reserve(((size_t)point_count_max + kChunkSize - 1) / kChunkSize);
+	seeds_.reserve(kPlaneCountMax);
+	previous_seeds_.reserve(kPlaneCountMax);
+	planes_.reserve(kPlaneCountMax);
+
+	Reset();
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclPlaneDetector::Terminate()
+{
+	chunk_sums_.clear();
+	label_.clear();
+	planes_.clear();
+
+	Reset();
+
+	return 0;
+}
+
+/**
+ * 前のフレームの平面を破棄します.
+ *
+ * @details 次の Detect は乱数による探索から行います. 乱数の系列も初期化します
+ */
+void PclPlaneDetector::Reset()
+{
+	seeds_.clear();
+	previous_seeds_.clear();
+	frames_since_search_ = 0;
+	random_state_ = 0x853C49E6748FEA9BULL;
+
+	return;
+}
+
+/**
+ * 次の乱数を返します.
+ *
+ * @return 乱数
+ */
+uint64_t PclPlaneDetector::NextRandom()
+{
+	// splitmix64
+	random_state_ += 0x9E3779B97F4A7C15ULL;
+
+	uint64_t value = random_state_;
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+	return value ^ (value >> 31);
+}
+
+/**
+ * 3点から平面の仮説を作ります.
+ *
+ * @param[in] cloud 点群データ
+ * @param[out] hypothesis 平面 (a, b, c, d)
+ *
+ * @retval true 成功
+ * @retval false 有効な3点が見つからない
+ *
+ * @details NaN の点、平面に割り当て済みの点、3点が一直線に近い場合は選び直します (pcl::SampleConsensusModel と同じく最大1000回)
+ */
+bool PclPlaneDetector::SampleHypothesis(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, float hypothesis[4])
+{
+	const uint64_t point_count = (uint64_t)cloud.points.size();
+	if (point_count < 3) {
+		return false;
+	}
+
+	for (int retry = 0; retry < 1000; retry++) {
+		const size_t i0 = (size_t)(NextRandom() % point_count);
+		const size_t i1 = (size_t)(NextRandom() % point_count);
+		const size_t i2 = (size_t)(NextRandom() % point_count);
+		if (label_[i0] >= 0 || label_[i1] >= 0 || label_[i2] >= 0) {
+			continue;
+		}
+
+		const pcl::PointXYZRGBA& p0 = cloud.points[i0];
+		const pcl::PointXYZRGBA& p1 = cloud.points[i1];
+		const pcl::PointXYZRGBA& p2 = cloud.points[i2];
+		if (!std::isfinite(p0.x) || !std::isfinite(p1.x) || !std::isfinite(p2.x)) {
+			continue;
+		}
+
+		const double ux = (double)p1.x - p0.x, uy = (double)p1.y - p0.y, uz = (double)p1.z - p0.z;
+		const double vx = (double)p2.x - p0.x, vy = (double)p2.y - p0.y, vz = (double)p2.z - p0.z;
+		const double nx = (uy * vz) - (uz * vy);
+		const double ny = (uz * vx) - (ux * vz);
+		const double nz = (ux * vy) - (uy * vx);
+
+		const double norm = std::sqrt((nx * nx) + (ny * ny) + (nz * nz));
+		const double span = ((ux * ux) + (uy * uy) + (uz * uz)) * ((vx * vx) + (vy * vy) + (vz * vz));
+		if (!(norm > 0) || (norm * norm) < span * 1e-8) {
+			continue;
+		}
+
+		hypothesis[0] = (float)(nx / norm);
+		hypothesis[1] = (float)(ny / norm);
+		hypothesis[2] = (float)(nz / norm);
+		hypothesis[3] = (float)(-((nx * p0.x) + (ny * p0.y) + (nz * p0.z)) / norm);
+
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * 平面のしきい値以内の点の数と最小二乗平面のための和を求めます.
+ *
+ * @param[in] cloud 点群データ
+ * @param[in] plane 平面 (a, b, c, d)
+ * @param[in] threshold しきい値(m)
+ *
+ * @return 点の数と和
+ *
+ * @details 平面に割り当て済みの点は除きます.
+ *  点の数で決まる単位ごとに並列に加算し、単位の順に合計するため、結果はスレッド数によらず同じです
+ */
+PclPlaneDetector::PlaneSums PclPlaneDetector::AccumulateInliers(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, const float plane[4], const float threshold)
+{
+	const int point_count = (int)cloud.points.size();
+	const pcl::PointXYZRGBA* points = cloud.points.data();
+	const int chunk_count = (point_count + kChunkSize - 1) / kChunkSize;
+
+	chunk_sums_.resize((size_t)chunk_count);
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			PlaneSums sums = {};
+			for (int i = start; i < end; i++) {
+				const pcl::PointXYZRGBA& point = points[i];
+				if (label_[i] >= 0 || !IsInlier(point, plane, threshold)) {
+					continue;
+				}
+
+				const double x = point.x, y = point.y, z = point.z;
+				sums.count++;
+				sums.x += x;
+				sums.y += y;
+				sums.z += z;
+				sums.xx += x * x;
+				sums.xy += x * y;
+				sums.xz += x * z;
+				sums.yy += y * y;
+				sums.yz += y * z;
+				sums.zz += z * z;
+			}
+			chunk_sums_[c] = sums;
+		}
+	});
+
+	PlaneSums total = {};
+	for (int c = 0; c < chunk_count; c++) {
+		const PlaneSums& sums = chunk_sums_[c];
+		total.count += sums.count;
+		total.x += sums.x;
+		total.y += sums.y;
+		total.z += sums.z;
+		total.xx += sums.xx;
+		total.xy += sums.xy;
+		total.xz += sums.xz;
+		total.yy += sums.yy;
+		total.yz += sums.yz;
+		total.zz += sums.zz;
+	}
+
+	return total;
+}
+
+/**
+ * 平面のしきい値以内の点を選択します.
+ *
+ * @param[in] cloud 点群データ
+ * @param[in] plane 平面 (a, b, c, d)
+ * @param[in] threshold しきい値(m)
+ * @param[in] plane_number 平面の番号
+ *
+ * @return 点の数
+ *
+ * @details 平面に割り当てられていない点のうち、しきい値以内の点の label_ を plane_number とします
+ */
+int PclPlaneDetector::SelectInliers(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, const float plane[4], const float threshold, const int plane_number)
+{
+	const int point_count = (int)cloud.points.size();
+	const pcl::PointXYZRGBA* points = cloud.points.data();
+	const int chunk_count = (point_count + kChunkSize - 1) / kChunkSize;
+
+	chunk_sums_.resize((size_t)chunk_count);
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		const __m128 a = _mm_set1_ps(plane[0]);
+		const __m128 b = _mm_set1_ps(plane[1]);
+		const __m128 c = _mm_set1_ps(plane[2]);
+		const __m128 d = _mm_set1_ps(plane[3]);
+		const __m128 threshold_4 = _mm_set1_ps(threshold);
+		const __m128 sign_mask = _mm_set1_ps(-0.0F);
+
+		for (int chunk = range.start; chunk < range.end; chunk++) {
+			const int start = chunk * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			int count = 0;
+			int i = start;
+			for (; i + 4 <= end; i += 4) {
+				const int bits = _mm_movemask_ps(InlierMask4(points + i, a, b, c, d, threshold_4, sign_mask));
+				if (bits == 0) {
+					continue;
+				}
+				for (int k = 0; k < 4; k++) {
+					int& label = label_[(size_t)i + k];
+					if (((bits >> k) & 1) != 0 && label < 0) {
+						label = plane_number;
+						count++;
+					}
+				}
+			}
+			for (; i < end; i++) {
+				if (label_[i] < 0 && IsInlier(points[i], plane, threshold)) {
+					label_[i] = plane_number;
+					count++;
+				}
+			}
+			chunk_sums_[chunk].count = count;
+		}
+	});
+
+	int total = 0;
+	for (int c = 0; c < chunk_count; c++) {
+		total += chunk_sums_[c].count;
+	}
+
+	return total;
+}
+
+/**
+ * 最小二乗平面を求めます.
+ *
+ * @param[in] sums 点の数と和
+ * @param[in] reference 向きを合わせる平面 (a, b, c, d)
+ * @param[out] plane 平面 (a, b, c, d)
+ *
+ * @retval true 成功
+ * @retval false 点が不足
+ *
+ * @details 共分散行列の最小固有値の固有ベクトルを法線とします (pcl::SampleConsensusModelPlane::optimizeModelCoefficients と同じ).
+ *  法線の向きは reference に合わせます
+ */
+bool PclPlaneDetector::FitPlane(const PlaneSums& sums, const float reference[4], float plane[4]) const
+{
+	if (sums.count < 3) {
+		return false;
+	}
+
+	const double count = sums.count;
+	const double mx = sums.x / count, my = sums.y / count, mz = sums.z / count;
+
+	const double cxx = (sums.xx / count) - (mx * mx);
+	const double cxy = (sums.xy / count) - (mx * my);
+	const double cxz = (sums.xz / count) - (mx * mz);
+	const double cyy = (sums.yy / count) - (my * my);
+	const double cyz = (sums.yz / count) - (my * mz);
+	const double czz = (sums.zz / count) - (mz * mz);
+	const cv::Matx33d covariance(
+		cxx, cxy, cxz,
+		cxy, cyy, cyz,
+		cxz, cyz, czz);
+
+	cv::Mat eigen_values, eigen_vectors;
+	if (!cv::eigen(covariance, eigen_values, eigen_vectors)) {
+		return false;
+	}
+
+	// descending order, the last one is the normal
+	double nx = eigen_vectors.at<double>(2, 0);
+	double ny = eigen_vectors.at<double>(2, 1);
+	double nz = eigen_vectors.at<double>(2, 2);
+	const double norm = std::sqrt((nx * nx) + (ny * ny) + (nz * nz));
+	if (!(norm > 0)) {
+		return false;
+	}
+
+	if ((nx * reference[0]) + (ny * reference[1]) + (nz * reference[2]) < 0) {
+		nx = -nx;
+		ny = -ny;
+		nz = -nz;
+	}
+
+	plane[0] = (float)(nx / norm);
+	plane[1] = (float)(ny / norm);
+	plane[2] = (float)(nz / norm);
+	plane[3] = (float)(-((nx * mx) + (ny * my) + (nz * mz)) / norm);
+
+	return true;
+}
+
+/**
+ * 平面を1つ探索します.
+ *
+ * @param[in] cloud 点群データ
+ * @param[in] threshold しきい値(m)
+ * @param[in] remaining_count 平面に割り当てられていない点の数
+ * @param[in] seed 前のフレームの平面 (nullptr:なし)
+ * @param[in] search true:前のフレームの平面が有効でも探索する
+ * @param[in] deadline 探索を打ち切る時刻 (has_deadline が true の場合)
+ * @param[in] has_deadline 時刻による打ち切りの有無
+ * @param[out] plane 平面 (a, b, c, d) 最小二乗平面の前のもの
+ * @param[out] sums plane の点の数と和
+ * @param[out] searched 探索したかどうか
+ *
+ * @details 1. 前のフレームの平面の点の数を数えます. 前のフレームの点の割合の kConfirmRatio 以上であれば、その平面を使用します
+ *  2. そうでなければ RANSAC で探索します. 仮説は kBatchSize ずつ並列に評価し、
+ *     最良の仮説の点の割合から必要な回数 (確率 kProbability) に達した時点で終了します. 前のフレームの平面も候補とします.
+ *     打ち切りの時刻を過ぎた場合はその時点の最良の仮説とします
+ */
+void PclPlaneDetector::FindPlane(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, const float threshold, const int remaining_count, const Seed* seed, const bool search,
+									const std::chrono::steady_clock::time_point deadline, const bool has_deadline, float plane[4], PlaneSums* sums, bool* searched)
+{
+	const int point_count = (int)cloud.points.size();
+	const pcl::PointXYZRGBA* points = cloud.points.data();
+	const int* label = label_.data();
+
+	int best_count = 0;
+	bool best_has_sums = false;
+	*sums = {};
+	*searched = false;
+
+	// 1. verify the plane of the previous frame
+	if (seed != nullptr) {
+		*sums = AccumulateInliers(cloud, seed->plane, threshold);
+		best_has_sums = true;
+		best_count = sums->count;
+		std::copy(seed->plane, seed->plane + 4, plane);
+
+		const double ratio = (double)best_count / remaining_count;
+		if (!search && (best_count >= 3) && (ratio >= seed->inlier_ratio * kConfirmRatio)) {
+			return;
+		}
+	}
+
+	// 2. search
+	*searched = true;
+
+	float hypotheses[kBatchSize][4];
+	int counts[kBatchSize];
+
+	int iterations = 0;
+	int iterations_required = kMaxIterations;
+	while (iterations < iterations_required) {
+		const int batch = (std::min)(kBatchSize, iterations_required - iterations);
+
+		// the samples are drawn here, in order, so the result does not depend on the threads
+		int hypothesis_count = 0;
+		for (int h = 0; h < batch; h++) {
+			if (SampleHypothesis(cloud, hypotheses[hypothesis_count])) {
+				hypothesis_count++;
+			}
+		}
+		if (hypothesis_count == 0) {
+			break;
+		}
+
+		cv::parallel_for_(cv::Range(0, hypothesis_count), [&](const cv::Range& range) {
+			for (int h = range.start; h < range.end; h++) {
+				counts[h] = CountInliers(points, label, point_count, hypotheses[h], threshold);
+			}
+		});
+
+		for (int h = 0; h < hypothesis_count; h++) {
+			if (counts[h] > best_count) {
+				best_count = counts[h];
+				std::copy(hypotheses[h], hypotheses[h] + 4, plane);
+				best_has_sums = false;
+			}
+		}
+		iterations += batch;
+
+		if (has_deadline && std::chrono::steady_clock::now() >= deadline) {
+			break;
+		}
+
+		// adaptive number of iterations, log(1 - p) / log(1 - w^3)
+		const double inlier_ratio = (double)best_count / remaining_count;
+		const double all_inlier = inlier_ratio * inlier_ratio * inlier_ratio;
+		if (all_inlier >= 1.0) {
+			break;
+		}
+		if (all_inlier > 0) {
+			const double required = std::log(1.0 - kProbability) / std::log(1.0 - all_inlier);
+			if (required < kMaxIterations) {
+				iterations_required = (std::max)(1, (int)std::ceil(required));
+			}
+		}
+	}
+
+	if (!best_has_sums) {
+		if (best_count > 0) {
+			*sums = AccumulateInliers(cloud, plane, threshold);
+		}
+		else {
+			*sums = {};
+		}
+	}
+
+	return;
+}
+
+/**
+ * 平面を検出します.
+ *
+ * @param[in] threshold 平面とするしきい値(m)
+ * @param[in] cloud 点群データ (コピーせずに参照します)
+ * @param[out] plane 平面
+ *
+ * @retval 0 成功
+ * @retval -1 失敗 (平面が見つからない)
+ *
+ * @details 平面の数が1で時間の制限のない DetectPlanes です. GetLabel は 0:平面 -1:その他 です
+ */
+int PclPlaneDetector::Detect(const double threshold, const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, Plane* plane)
+{
+	if (plane == nullptr) {
+		return -1;
+	}
+
+	int ret = DetectPlanes(threshold, 1, 0, 0, cloud, &planes_);
+	if (ret != 0) {
+		return ret;
+	}
+
+	*plane = planes_[0];
+
+	return 0;
+}
+
+/**
+ * 複数の平面を順に検出します.
+ *
+ * @param[in] threshold 平面とするしきい値(m)
+ * @param[in] plane_count_max 最大の平面の数 (最大 kPlaneCountMax)
+ * @param[in] min_inlier_count 平面の最小の点の数 (3未満は3)
+ * @param[in] time_budget 時間の制限(ms) 0以下は制限なし
+ * @param[in] cloud 点群データ (コピーせずに参照します)
+ * @param[out] planes 平面 (検出した順)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗 (平面が見つからない)
+ *
+ * @details 平面ごとに、平面に割り当てられていない点から FindPlane で探索し、
+ *  最良の平面の点から最小二乗平面を求め、その平面で点を選択します (GetLabel に平面の番号を設定します).
+ *  残りの点が min_inlier_count 未満、見つかった平面の点が min_inlier_count 未満、
+ *  または time_budget を過ぎた場合に終了します. time_budget を過ぎた場合も探索中の平面は出力します.
+ *  前のフレームの平面は同じ番号の平面の初期値とします.
+ *  前のフレームの平面を使用し続けると、より大きな平面が現れた場合に見つからないため、kSearchInterval ごとに探索します.
+ *  乱数の系列はフレームごとに続くため、結果はスレッド数によらず同じです (時間の制限で打ち切った場合を除く)
+ */
+int PclPlaneDetector::DetectPlanes(const double threshold, const int plane_count_max, const int min_inlier_count, const double time_budget,
+									const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, std::vector<Plane>* planes)
+{
+	if (planes == nullptr) {
+		return -1;
+	}
+	planes->clear();
+
+	const auto start_time = std::chrono::steady_clock::now();
+	const bool has_deadline = time_budget > 0;
+	const auto deadline = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(has_deadline ? time_budget : 0));
+
+	const int point_count = (int)cloud.points.size();
+	const float threshold_f = (float)threshold;
+	const int plane_count = (std::min)(plane_count_max, kPlaneCountMax);
+	const int min_count = (std::max)(3, min_inlier_count);
+
+	label_.assign((size_t)point_count, -1);
+
+	previous_seeds_.swap(seeds_);
+	seeds_.clear();
+
+	if (point_count < 3 || !(threshold > 0)) {
+		return -1;
+	}
+
+	const bool search = (frames_since_search_ >= kSearchInterval);
+	bool searched_any = false;
+
+	int remaining_count = point_count;
+	for (int k = 0; k < plane_count; k++) {
+		if (remaining_count < min_count) {
+			break;
+		}
+		if (k > 0 && has_deadline && std::chrono::steady_clock::now() >= deadline) {
+			break;
+		}
+
+		const Seed* seed = (k < (int)previous_seeds_.size()) ? &previous_seeds_[k] : nullptr;
+
+		float best[4] = {};
+		PlaneSums best_sums = {};
+		bool searched = false;
+		FindPlane(cloud, threshold_f, remaining_count, seed, search, deadline, has_deadline, best, &best_sums, &searched);
+		searched_any = searched_any || searched;
+
+		if (best_sums.count < min_count) {
+			break;
+		}
+
+		// least squares plane of the inliers, then the inliers of it
+		float refined[4] = {};
+		if (!FitPlane(best_sums, best, refined)) {
+			std::copy(best, best + 4, refined);
+		}
+
+		const int inlier_count = SelectInliers(cloud, refined, threshold_f, k);
+		if (inlier_count == 0) {
+			break;
+		}
+
+		Plane plane = {};
+		plane.a = refined[0];
+		plane.b = refined[1];
+		plane.c = refined[2];
+		plane.d = refined[3];
+		plane.inlier_count = inlier_count;
+		planes->push_back(plane);
+
+		// seed for the next frame
+		Seed next_seed = {};
+		std::copy(refined, refined + 4, next_seed.plane);
+		next_seed.inlier_ratio = (double)inlier_count / remaining_count;
+		seeds_.push_back(next_seed);
+
+		remaining_count -= inlier_count;
+	}
+
+	frames_since_search_ = searched_any ? 0 : (frames_since_search_ + 1);
+
+	if (planes->empty()) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * 最後の Detect / DetectPlanes の各点のラベルを取得します.
+ *
+ * @return ラベル (平面の番号 -1:その他)
+ */
+const std::vector<int>& PclPlaneDetector::GetLabel() const
+{
+	return label_;
+}
@@ -0,0 +1,104 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_plane_detector.h
+ * @brief RANSAC plane detection seeded by the plane of the previous frame.
+ */
+
+#pragma once
+
+/**
+ * @class   PclPlaneDetector
+ * @brief   Plane detector class
+ * this class keeps the plane of the previous frame and the work buffers
+ */
+class PclPlaneDetector {
+public:
+
+	/** @struct  Plane
+	 *  @brief Detected plane, a * x + b * y + c * z + d = 0 (|(a, b, c)| = 1)
+	 */
+	struct Plane {
+		float a, b, c, d;
+		int inlier_count;
+	};
+
+	PclPlaneDetector();
+	~PclPlaneDetector();
+
+	int Initialize(const int point_count_max);
+
+	int Terminate();
+
+	void Reset();
+
+	int Detect(const double threshold, const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, Plane* plane);
+
+	int DetectPlanes(const double threshold, const int plane_count_max, const int min_inlier_count, const double time_budget,
+						const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, std::vector<Plane>* planes);
+
+	const std::vector<int>& GetLabel() const;
+
+	static constexpr int kPlaneCountMax = 8;				/**< planes of DetectPlanes */
+
+private:
+	static constexpr int kChunkSize = 16384;				/**< points per work unit for the passes over the cloud */
+	static constexpr int kBatchSize = 16;					/**< hypotheses evaluated in parallel */
+	static constexpr int kMaxIterations = 128;				/**< hypotheses per frame */
+	static constexpr double kProbability = 0.99;			/**< probability to draw one sample of inliers only */
+	static constexpr double kConfirmRatio = 0.9;			/**< the seed is kept when it has this ratio of the previous inliers */
+	static constexpr int kSearchInterval = 30;				/**< frames, a full search is done at least at this interval */
+
+	/** @struct  PlaneSums
+	 *  @brief Sums of the inliers for the least squares plane
+	 */
+	struct PlaneSums {
+		int count;
+		double x, y, z;
+		double xx, xy, xz, yy, yz, zz;
+	};
+
+	/** @struct  Seed
+	 *  @brief Plane of the previous frame
+	 */
+	struct Seed {
+		float plane[4];
+		double inlier_ratio;								/**< inliers / remaining points */
+	};
+
+	std::vector<Seed> seeds_;								/**< planes of the last frame, in order */
+	std::vector<Seed> previous_seeds_;
+	int frames_since_search_;
+
+	uint64_t random_state_;
+
+	std::vector<PlaneSums> chunk_sums_;
+	std::vector<int> label_;								/**< plane number of each point, -1: other */
+	std::vector<Plane> planes_;								/**< result of Detect */
+
+	uint64_t NextRandom();
+
+	bool SampleHypothesis(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, float hypothesis[4]);
+
+	PlaneSums AccumulateInliers(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, const float plane[4], const float threshold);
+
+	int SelectInliers(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, const float plane[4], const float threshold, const int plane_number);
+
+	bool FitPlane(const PlaneSums& sums, const float reference[4], float plane[4]) const;
+
+	void FindPlane(const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, const float threshold, const int remaining_count, const Seed* seed, const bool search,
+					const std::chrono::steady_clock::time_point deadline, const bool has_deadline, float plane[4], PlaneSums* sums, bool* searched);
+
+};
@@ -0,0 +1,1390 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_point_cloud_builder.cpp
+ * @brief Builds an organized point cloud from disparity data.
+ * @version 0.1
+ *
+ * @details Converts the disparity into an organized point cloud (width x height points).
+ *  The point cloud buffers are kept by this class (or shared by the builders, SetCloudBufferPool) and reused for every frame.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_cloud_buffer_pool.h"
+#include "pcl_point_cloud_builder.h"
+
+// the scalar and SIMD kernels must give the same result, a * b + c must not be fused into FMA
+// (gcc: -ffp-contract=off is set for this file in CMakeLists.txt)
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+/** @struct  ProjectionRowArgs
+ *  @brief 1行分の投影処理の入出力
+ *
+ *  入力は180度回転した向きのため、行の末尾から逆順に読み出します
+ */
+struct ProjectionRowArgs {
+	int width;						/**< data width */
+	const float* depth_last;		/**< disparity, last element of the source row */
+	const unsigned char* image_last;/**< image, last pixel of the source row */
+	const unsigned char* heat_last;	/**< heat map (BGRA), last pixel of the source row */
+	const unsigned char* color_row0;/**< scaled image: source row of the sampling position (bilinear: the row above) */
+	const unsigned char* color_row1;/**< scaled image, bilinear: the row below */
+	int color_row_weight;			/**< scaled image, bilinear: weight of color_row1 (0 - 256) */
+	const int* color_column0_last;	/**< scaled image: source column of each element (bilinear: the left one), last element of the row */
+	const int* color_column1_last;	/**< scaled image, bilinear: the right one */
+	const int* color_column_weight_last;/**< scaled image, bilinear: weight of color_column1 (0 - 256) */
+	const float* column_x;			/**< column tables, x = (column_x + row_x) / (d - d_inf) + translation_x */
+	const float* column_y;
+	const float* column_z;
+	float row_x, row_y, row_z;		/**< row table values */
+	float translation_x, translation_y, translation_z;
+	float row_depth;				/**< row table value, camera frame z = row_depth / (d - d_inf) */
+	float d_inf;					/**< camera specific parameter */
+	float value_min;				/**< culling by disparity, value_min <= d - d_inf (widened) */
+	float value_max;				/**< culling by disparity, d - d_inf <= value_max (widened) */
+	float z_min;					/**< culling by distance, z_min <= z */
+	float z_max_exclusive;			/**< culling by distance, z < z_max_exclusive */
+	float z_max_inclusive;			/**< culling by distance, z <= z_max_inclusive */
+	pcl::PointXYZRGBA* dst;			/**< output points (1 row) */
+	int* pixel_index;				/**< dense: source pixel index of each output point */
+	int pixel_index_last;			/**< dense: source pixel index of the last element of the row */
+	int pixel_index_step;			/**< dense: source pixel index step for each element (lod step) */
+};
+
+/** @enum  ColorSource
+ *  @brief Source of the point color, fixed for the frame
+ */
+enum class ColorSource {
+	kImage,				/**< image at the disparity resolution */
+	kHeatMap,			/**< heat map (BGRA) */
+	kImageNearest,		/**< image of another size (4K), nearest pixel */
+	kImageBilinear		/**< image of another size (4K), bilinear interpolation */
+};
+
+typedef int (*ProjectRowFunction)(const ProjectionRowArgs& args);
+
+static void SetCullingRange(const PclPointCloudBuilder::BuildParameter& build_parameter, ProjectionRowArgs* args);
+
+static void SetRowCullingRange(const float row_depth, ProjectionRowArgs* args);
+
+static void GetOutputTransform(const PclPointCloudBuilder::BuildParameter& build_parameter, double transform[12]);
+
+static int CountRowValid(const ProjectionRowArgs& args);
+
+static inline void BlendColor(const unsigned char* row0, const unsigned char* row1, const int row_weight, const int column0, const int column1, const int column_weight, const int channel_count, unsigned char* dst_pixel);
+
+static ProjectRowFunction SelectProjectRowFunction(const bool simd, const bool dense, const int channel_count, const ColorSource color_source);
+
+/**
+ * constructor
+ *
+ */
+PclPointCloudBuilder::PclPointCloudBuilder():
+	width_max_(0), height_max_(0), own_cloud_pool_(), cloud_pool_(&own_cloud_pool_), projection_kernel_(ProjectionKernel::kSimd), projection_tables_(),
+	lod_depth_(), lod_color_(), row_offset_(), pixel_index_(), pixel_grid_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclPointCloudBuilder::~PclPointCloudBuilder()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] width_max 最大データ幅
+ * @param[in] height_max 最大データ高さ
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclPointCloudBuilder::Initialize(const int width_max, const int height_max)
+{
+	width_max_ = width_max;
+	height_max_ = height_max;
+
+	projection_tables_.width = 0;
+	projection_tables_.height = 0;
+	projection_tables_.base_length = 0;
+	projection_tables_.bf = 0;
+	projection_tables_.angle = 0;
+	std::fill(projection_tables_.transform, projection_tables_.transform + 12, 0.0);
+	projection_tables_.lod_step = 0;
+	projection_tables_.lod_center = 0;
+	projection_tables_.column_x.reserve(width_max_);
+	projection_tables_.column_y.reserve(width_max_);
+	projection_tables_.column_z.reserve(width_max_);
+	projection_tables_.row_x.reserve(height_max_);
+	projection_tables_.row_y.reserve(height_max_);
+	projection_tables_.row_z.reserve(height_max_);
+	projection_tables_.row_depth.reserve(height_max_);
+	projection_tables_.color_width = 0;
+	projection_tables_.color_height = 0;
+	projection_tables_.color_sampling = ColorSampling::kNearest;
+	projection_tables_.color_column0.reserve(width_max_);
+	projection_tables_.color_column1.reserve(width_max_);
+	projection_tables_.color_column_weight.reserve(width_max_);
+	projection_tables_.color_row0.reserve(height_max_);
+	projection_tables_.color_row1.reserve(height_max_);
+	projection_tables_.color_row_weight.reserve(height_max_);
+
+	// the points and the pixel index are not reserved, they grow to the output of the level of detail
+	row_offset_.reserve((size_t)height_max_ + 1);
+
+	own_cloud_pool_.Initialize(kCloudCount);
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclPointCloudBuilder::Terminate()
+{
+	own_cloud_pool_.Terminate();
+
+	projection_tables_.column_x.clear();
+	projection_tables_.column_y.clear();
+	projection_tables_.column_z.clear();
+	projection_tables_.row_x.clear();
+	projection_tables_.row_y.clear();
+	projection_tables_.row_z.clear();
+	projection_tables_.row_depth.clear();
+	projection_tables_.width = 0;
+	projection_tables_.height = 0;
+	projection_tables_.color_column0.clear();
+	projection_tables_.color_column1.clear();
+	projection_tables_.color_column_weight.clear();
+	projection_tables_.color_row0.clear();
+	projection_tables_.color_row1.clear();
+	projection_tables_.color_row_weight.clear();
+	projection_tables_.color_width = 0;
+	projection_tables_.color_height = 0;
+
+	lod_depth_.release();
+	lod_color_.release();
+
+	row_offset_.clear();
+	pixel_index_.clear();
+
+	return 0;
+}
+
+/**
+ * 投影処理の実装を選択します.
+ *
+ * @param[in] projection_kernel kScalar:参照実装 kSimd:SIMD実装
+ *
+ * @return none.
+ */
+void PclPointCloudBuilder::SetProjectionKernel(const ProjectionKernel projection_kernel)
+{
+	projection_kernel_ = projection_kernel;
+
+	return;
+}
+
+/**
+ * 点群を書き込むバッファーを設定します.
+ *
+ * @param[in] cloud_pool 複数の builder で共有するバッファー. nullptr の場合は自身のバッファー (2面)
+ *
+ * @return none.
+ *
+ * @details 表示側などが参照中のバッファーには書き込みません. 共有するバッファーは builder より後に終了してください
+ */
+void PclPointCloudBuilder::SetCloudBufferPool(PclCloudBufferPool* cloud_pool)
+{
+	cloud_pool_ = (cloud_pool != nullptr) ? cloud_pool : &own_cloud_pool_;
+
+	return;
+}
+
+/**
+ * 投影用のテーブルを更新します.
+ *
+ * @param[in] width データ幅
+ * @param[in] height データ高さ
+ * @param[in] base_length カメラ基線長
+ * @param[in] bf カメラ固有パラメータ
+ * @param[in] angle カメラ設置角度(度) x軸回り 上向きが正
+ * @param[in] transform カメラ座標系から出力座標系への変換 (3x4)
+ * @param[in] lod_step LODのブロックの大きさ (1:LODなし)
+ * @param[in] lod_center ブロック内の代表位置
+ *
+ * @return none.
+ *
+ * @details x = -(j - xc) * B / d, y = (yc - i) * B / d, z = bf / d の分子を列/行ごとに計算しておきます.
+ *  カメラの傾きはx軸回りの回転 (y' = y * cos + z * sin, z' = -y * sin + z * cos) で、
+ *  分子の回転は行ごとに決まるため、画素ごとの演算は傾きのない場合と同じです.
+ *  出力座標系への変換 (R, t) も、x は列, y と z は行のみに依存するため、
+ *  R の各要素を分子に掛けたものを列と行に分けて持ち、(column + row) / d + t とします.
+ *  LODの場合、テーブルは間引き後の列/行ごとで、j, i はブロックの代表位置です
+ */
+void PclPointCloudBuilder::UpdateProjectionTables(const int width, const int height, const double base_length, const double bf, const double angle, const double transform[12], const int lod_step, const double lod_center)
+{
+	if (projection_tables_.width == width && projection_tables_.height == height && projection_tables_.base_length == base_length &&
+		projection_tables_.bf == bf && projection_tables_.angle == angle && std::equal(transform, transform + 12, projection_tables_.transform) &&
+		projection_tables_.lod_step == lod_step && projection_tables_.lod_center == lod_center) {
+		return;
+	}
+
+	constexpr double pi = 3.1415926535;
+	const double rad = angle * pi / 180.0;
+	const double cos_angle = cos(rad);
+	const double sin_angle = sin(rad);
+
+	const int yc = height / 2;
+	const int xc = width / 2;
+
+	const int table_width = width / lod_step;
+	const int table_height = height / lod_step;
+
+	// output column j is source column (table_width - 1 - j) (rotate 180 degrees)
+	projection_tables_.column_x.resize(table_width);
+	projection_tables_.column_y.resize(table_width);
+	projection_tables_.column_z.resize(table_width);
+	for (int j = 0; j < table_width; j++) {
+		const double jf = (width - 1) - (((table_width - 1 - j) * lod_step) + lod_center);
+
+		// x is mirrored for display
+		const double x = -1 * base_length * (jf - xc);
+
+		projection_tables_.column_x[j] = (float)(transform[0] * x);
+		projection_tables_.column_y[j] = (float)(transform[4] * x);
+		projection_tables_.column_z[j] = (float)(transform[8] * x);
+	}
+
+	projection_tables_.row_x.resize(table_height);
+	projection_tables_.row_y.resize(table_height);
+	projection_tables_.row_z.resize(table_height);
+	projection_tables_.row_depth.resize(table_height);
+	for (int i = 0; i < table_height; i++) {
+		const double yf = (height - 1) - (((table_height - 1 - i) * lod_step) + lod_center);
+		const double y0 = base_length * (yc - yf);
+
+		// tilt
+		const double y = (y0 * cos_angle) + (bf * sin_angle);
+		const double z = (bf * cos_angle) - (y0 * sin_angle);
+
+		projection_tables_.row_x[i] = (float)((transform[1] * y) + (transform[2] * z));
+		projection_tables_.row_y[i] = (float)((transform[5] * y) + (transform[6] * z));
+		projection_tables_.row_z[i] = (float)((transform[9] * y) + (transform[10] * z));
+		projection_tables_.row_depth[i] = (float)z;
+	}
+
+	projection_tables_.width = width;
+	projection_tables_.height = height;
+	projection_tables_.base_length = base_length;
+	projection_tables_.bf = bf;
+	projection_tables_.angle = angle;
+	std::copy(transform, transform + 12, projection_tables_.transform);
+	projection_tables_.lod_step = lod_step;
+	projection_tables_.lod_center = lod_center;
+
+	return;
+}
+
+/**
+ * 大きさの異なる画像から色を取得するためのテーブルを更新します.
+ *
+ * @param[in] width 視差の幅
+ * @param[in] height 視差の高さ
+ * @param[in] color_width 画像の幅
+ * @param[in] color_height 画像の高さ
+ * @param[in] color_sampling 最近傍/バイリニア
+ *
+ * @return none.
+ *
+ * @details 視差の画素中心 (x + 0.5) * scale に対応する画像の列/行をカメラの向きのまま持ちます.
+ *  バイリニアの場合は隣の列/行と重み (0 - 256) も持ちます. 最近傍の場合、隣は同じ位置で重みは 0 です.
+ *  投影時に画像を直接読み出すため、フレームごとの縮小は不要です
+ */
+void PclPointCloudBuilder::UpdateColorTables(const int width, const int height, const int color_width, const int color_height, const ColorSampling color_sampling)
+{
+	if (projection_tables_.color_width == color_width && projection_tables_.color_height == color_height && projection_tables_.color_sampling == color_sampling &&
+		(int)projection_tables_.color_column0.size() == width && (int)projection_tables_.color_row0.size() == height) {
+		return;
+	}
+
+	auto make_table = [color_sampling](const int size, const int color_size, std::vector<int>* index0, std::vector<int>* index1, std::vector<int>* weight) {
+		const double scale = (double)color_size / size;
+
+		index0->resize(size);
+		index1->resize(size);
+		weight->resize(size);
+		for (int k = 0; k < size; k++) {
+			const double position = (k + 0.5) * scale;
+
+			if (color_sampling == ColorSampling::kBilinear) {
+				const double position0 = (std::max)(position - 0.5, 0.0);
+				const int k0 = (std::min)((int)position0, color_size - 1);
+
+				(*index0)[k] = k0;
+				(*index1)[k] = (std::min)(k0 + 1, color_size - 1);
+				(*weight)[k] = (int)(((position0 - k0) * 256.0) + 0.5);
+			}
+			else {
+				(*index0)[k] = (std::min)((int)position, color_size - 1);
+				(*index1)[k] = (*index0)[k];
+				(*weight)[k] = 0;
+			}
+		}
+	};
+
+	make_table(width, color_width, &projection_tables_.color_column0, &projection_tables_.color_column1, &projection_tables_.color_column_weight);
+	make_table(height, color_height, &projection_tables_.color_row0, &projection_tables_.color_row1, &projection_tables_.color_row_weight);
+
+	projection_tables_.color_width = color_width;
+	projection_tables_.color_height = color_height;
+	projection_tables_.color_sampling = color_sampling;
+
+	return;
+}
+
+/**
+ * LODのため視差と色の取得元を間引きます.
+ *
+ * @param[in] lod_mode LOD
+ * @param[in] lod_step ブロックの大きさ
+ * @param[in] d_inf カメラ固有パラメータ
+ * @param[in] depth_data 視差 (CV_32F)
+ * @param[in] color_source 色の取得元 (CV_8UC1/CV_8UC3/CV_8UC4)
+ * @param[in] scaled_color true:色の取得元の大きさが視差と異なる (UpdateColorTables のテーブルで取得します)
+ *
+ * @return none.
+ *
+ * @details 結果は lod_depth_, lod_color_ (width / lod_step x height / lod_step, カメラの向きのまま) です.
+ *  色はブロックの中央の画素です. 有効な視差 (d > d_inf) のないブロックの視差は NaN とします
+ */
+void PclPointCloudBuilder::DecimateInput(const LodMode lod_mode, const int lod_step, const float d_inf, const cv::Mat& depth_data, const cv::Mat& color_source, const bool scaled_color)
+{
+	const int width = depth_data.cols / lod_step;
+	const int height = depth_data.rows / lod_step;
+	const int channel_count = color_source.channels();
+	const int sample = lod_step / 2;
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	lod_depth_.create(height, width, CV_32F);
+	lod_color_.create(height, width, color_source.type());
+
+	cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; i++) {
+			const int src_row = i * lod_step;
+
+			float* dst_depth = lod_depth_.ptr<float>(i);
+			unsigned char* dst_color = lod_color_.ptr<unsigned char>(i);
+			const unsigned char* src_color = nullptr;
+			const unsigned char* src_color_below = nullptr;
+			int src_color_row_weight = 0;
+			if (scaled_color) {
+				src_color = color_source.ptr<unsigned char>(projection_tables_.color_row0[src_row + sample]);
+				src_color_below = color_source.ptr<unsigned char>(projection_tables_.color_row1[src_row + sample]);
+				src_color_row_weight = projection_tables_.color_row_weight[src_row + sample];
+			}
+			else {
+				src_color = color_source.ptr<unsigned char>(src_row + sample);
+			}
+
+			for (int j = 0; j < width; j++) {
+				const int src_col = j * lod_step;
+
+				if (scaled_color) {
+					const int x = src_col + sample;
+					BlendColor(src_color, src_color_below, src_color_row_weight, projection_tables_.color_column0[x], projection_tables_.color_column1[x], projection_tables_.color_column_weight[x],
+						channel_count, dst_color + (j * channel_count));
+				}
+				else {
+					memcpy(dst_color + (j * channel_count), src_color + ((src_col + sample) * channel_count), channel_count);
+				}
+
+				if (lod_mode == LodMode::kStride) {
+					dst_depth[j] = depth_data.ptr<float>(src_row + sample)[src_col + sample];
+					continue;
+				}
+
+				float sum = 0;
+				float min_value = std::numeric_limits<float>::max();
+				int count = 0;
+				for (int k = 0; k < lod_step; k++) {
+					const float* src_depth = depth_data.ptr<float>(src_row + k) + src_col;
+					for (int l = 0; l < lod_step; l++) {
+						const float value = src_depth[l];
+						if (value > d_inf) {
+							sum += value;
+							min_value = (std::min)(min_value, value);
+							count++;
+						}
+					}
+				}
+
+				if (count == 0) {
+					dst_depth[j] = nan;
+				}
+				else if (lod_mode == LodMode::kBlockAverage) {
+					dst_depth[j] = sum / count;
+				}
+				else {
+					dst_depth[j] = min_value;
+				}
+			}
+		}
+	});
+
+	return;
+}
+
+/**
+ * 視差データより点群(Point Cloud:XYZRGBA)を作成します.
+ *
+ * @param[in] build_parameter 作成パラメータ
+ * @param[in] base_image 画像 (CV_8UC1/CV_8UC3/CV_8UC4 カメラの向きのまま)
+ * @param[in] heat_image 距離のHeat Map画像 (CV_8UC4 カメラの向きのまま)
+ * @param[in] depth_data 視差 (CV_32F カメラの向きのまま)
+ * @param[out] cloud 点群データ (dense:有効な点のみ その他:organized point cloud)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 入力は180度回転して読み出すため、事前のflipは不要です.
+ *  Mono画像は輝度をそのままRGBへ展開します. 画像形式ごとの投影関数はフレームごとに1回だけ選択します.
+ *  pass_through が有効な場合は pcl::PassThrough("z") と同じ範囲外の点を NaN とします.
+ *  dense の場合は行ごとの有効な点の数の累積和から書き込み位置を求め、有効な点のみを並列に書き込みます.
+ *  点の順序は organized の場合から NaN を除いたものと同じです.
+ *  lod_mode が有効な場合は lod_step x lod_step のブロックごとに1点とします (width / lod_step x height / lod_step)
+ *  angle (カメラ設置角度) はx軸回りの回転として行ごとのテーブルに含めます. z は回転後の値で判定します.
+ *  点は output_frame の座標系で出力します. 距離の範囲の判定は出力座標系によらずカメラ座標系の z で行います.
+ *  投影は視差の解像度 (width x height) で行います. base_image のサイズが異なる場合 (4K) は
+ *  視差の画素中心に対応する位置の色を color_sampling (最近傍/バイリニア) で取得します.
+ */
+int PclPointCloudBuilder::Build(const BuildParameter& build_parameter, cv::Mat& base_image, cv::Mat& heat_image, cv::Mat& depth_data, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr* cloud)
+{
+
+	/*
+		座標系について
+		 Camera	: 右手系 x:左 y:上 z:前方 (表示の向き)
+		 ROS	: 右手系
+		 Unity	: 左手系
+
+		 ROSではロボットの進行方向がx軸、左方向がy軸、上方向がz軸の正方向
+
+		変換方法
+		 Camera -> ROS
+		  Position: Camera(x,y,z) -> ROS(z,x,y)
+
+		 Camera -> Unity
+		  Position: Camera(x,y,z) -> Unity(-x,y,z)
+
+		 Unity -> ROS
+		  Position: Unity(x,y,z) -> ROS(z,-x,y)
+		  Quaternion: Unity(x,y,z,w) -> ROS(z,-x,y,-w)
+
+		 ROS -> Unity
+		  Position: ROS(x,y,z) -> Unity(-y,z,x)
+		  Quaternion: ROS(x,y,z,w) -> Unity(-y,z,x,-w)
+
+		出力座標系への変換は投影のテーブルに含めるため、点群を再度変換する処理はありません
+	*/
+
+	if (cloud == nullptr) {
+		return -1;
+	}
+
+	const int width						= build_parameter.width;
+	const int height					= build_parameter.height;
+	const bool image_source_depth_heat	= build_parameter.image_source_depth_heat;
+
+	if (depth_data.type() != CV_32F || depth_data.cols != width || depth_data.rows != height) {
+		return -1;
+	}
+
+	int channel_count = 0;
+	if (image_source_depth_heat) {
+		if (heat_image.type() != CV_8UC4 || heat_image.cols != width || heat_image.rows != height) {
+			return -1;
+		}
+		channel_count = 4;
+	}
+	else {
+		switch (base_image.type()) {
+		case CV_8UC1:
+			channel_count = 1;
+			break;
+		case CV_8UC3:
+			channel_count = 3;
+			break;
+		case CV_8UC4:
+			channel_count = 4;
+			break;
+		default:
+			return -1;
+		}
+
+		if (base_image.cols <= 0 || base_image.rows <= 0) {
+			return -1;
+		}
+	}
+
+	// level of detail
+	// the disparity is decimated before projection, the full resolution point cloud is not made
+	int lod_step = 1;
+	double lod_center = 0;
+	if (build_parameter.lod_mode != LodMode::kOff && build_parameter.lod_step > 1) {
+		lod_step = build_parameter.lod_step;
+		lod_center = (build_parameter.lod_mode == LodMode::kStride) ? (double)(lod_step / 2) : ((lod_step - 1) / 2.0);
+	}
+	const int lod_sample = lod_step / 2;
+
+	const cv::Mat* src_depth = &depth_data;
+	const cv::Mat* src_color = image_source_depth_heat ? &heat_image : &base_image;
+	ColorSource color_source = image_source_depth_heat ? ColorSource::kHeatMap : ColorSource::kImage;
+	if (!image_source_depth_heat && (base_image.cols != width || base_image.rows != height)) {
+		// the image is larger than the disparity (4K), it is read at the pixel centers of the disparity through the color tables
+		UpdateColorTables(width, height, base_image.cols, base_image.rows, build_parameter.color_sampling);
+		color_source = (build_parameter.color_sampling == ColorSampling::kBilinear) ? ColorSource::kImageBilinear : ColorSource::kImageNearest;
+	}
+	if (lod_step > 1) {
+		const bool scaled_color = (color_source == ColorSource::kImageNearest || color_source == ColorSource::kImageBilinear);
+		DecimateInput(build_parameter.lod_mode, lod_step, (float)build_parameter.d_inf, depth_data, *src_color, scaled_color);
+		src_depth = &lod_depth_;
+		src_color = &lod_color_;
+		if (scaled_color) {
+			color_source = ColorSource::kImage;
+		}
+	}
+
+	const int out_width = src_depth->cols;
+	const int out_height = src_depth->rows;
+	if (out_width <= 0 || out_height <= 0) {
+		return -1;
+	}
+
+	double transform[12] = {};
+	GetOutputTransform(build_parameter, transform);
+
+	UpdateProjectionTables(width, height, build_parameter.base_length, build_parameter.bf, build_parameter.angle, transform, lod_step, lod_center);
+
+	// the source is read rotated, x = -(jf - xc) * B / d with jf = (width - 1) - x
+	pixel_grid_.width			= width;
+	pixel_grid_.height			= height;
+	pixel_grid_.step			= lod_step;
+	pixel_grid_.focal_length	= build_parameter.bf / build_parameter.base_length;
+	pixel_grid_.center_x		= (double)((width - 1) - (width / 2));
+	pixel_grid_.center_y		= (double)((height - 1) - (height / 2));
+	pixel_grid_.origin_x		= (float)transform[3];
+	pixel_grid_.origin_y		= (float)transform[7];
+	pixel_grid_.origin_z		= (float)transform[11];
+
+	const bool dense = build_parameter.dense;
+
+	// the format is fixed for the frame, so the kernel is selected here and not per pixel
+	const ProjectRowFunction project_row = SelectProjectRowFunction(projection_kernel_ == ProjectionKernel::kSimd, dense, channel_count, color_source);
+
+	ProjectionRowArgs args = {};
+	args.width				= out_width;
+	args.column_x			= projection_tables_.column_x.data();
+	args.column_y			= projection_tables_.column_y.data();
+	args.column_z			= projection_tables_.column_z.data();
+	args.translation_x		= (float)transform[3];
+	args.translation_y		= (float)transform[7];
+	args.translation_z		= (float)transform[11];
+	args.d_inf				= (float)build_parameter.d_inf;
+	args.pixel_index_step	= lod_step;
+	if (color_source == ColorSource::kImageNearest || color_source == ColorSource::kImageBilinear) {
+		args.color_column0_last			= projection_tables_.color_column0.data() + (out_width - 1);
+		args.color_column1_last			= projection_tables_.color_column1.data() + (out_width - 1);
+		args.color_column_weight_last	= projection_tables_.color_column_weight.data() + (out_width - 1);
+	}
+	SetCullingRange(build_parameter, &args);
+
+	// rotate 180 degrees: output row i is source row (out_height - 1 - i), read from its end
+	auto set_row_args = [&](const int i, ProjectionRowArgs* row_args) {
+		const int src_row = out_height - 1 - i;
+
+		row_args->depth_last = src_depth->ptr<float>(src_row) + (out_width - 1);
+		if (color_source == ColorSource::kHeatMap) {
+			row_args->heat_last = src_color->ptr<unsigned char>(src_row) + ((out_width - 1) * 4);
+		}
+		else if (color_source == ColorSource::kImage) {
+			row_args->image_last = src_color->ptr<unsigned char>(src_row) + ((out_width - 1) * channel_count);
+		}
+		else {
+			row_args->color_row0 = src_color->ptr<unsigned char>(projection_tables_.color_row0[src_row]);
+			row_args->color_row1 = src_color->ptr<unsigned char>(projection_tables_.color_row1[src_row]);
+			row_args->color_row_weight = projection_tables_.color_row_weight[src_row];
+		}
+		row_args->row_x = projection_tables_.row_x[i];
+		row_args->row_y = projection_tables_.row_y[i];
+		row_args->row_z = projection_tables_.row_z[i];
+		row_args->row_depth = projection_tables_.row_depth[i];
+		SetRowCullingRange(row_args->row_depth, row_args);
+		row_args->pixel_index_last = (((src_row * lod_step) + lod_sample) * width) + (((out_width - 1) * lod_step) + lod_sample);
+	};
+
+	// a buffer no one else references
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr write_cloud = cloud_pool_->Acquire();
+	if (write_cloud == nullptr) {
+		return -1;
+	}
+
+	// ポイントクラウドの大きさをセット
+	// the buffer keeps its capacity, it is reallocated only when a larger cloud is written into it
+	if (dense) {
+		// count the valid points of each row, then the prefix sum gives the output position of each row
+		row_offset_.resize((size_t)out_height + 1);
+		row_offset_[0] = 0;
+
+		cv::parallel_for_(cv::Range(0, out_height), [&](const cv::Range& range) {
+			ProjectionRowArgs row_args = args;
+			for (int i = range.start; i < range.end; i++) {
+				set_row_args(i, &row_args);
+				row_offset_[(size_t)i + 1] = CountRowValid(row_args);
+			}
+		});
+
+		for (int i = 0; i < out_height; i++) {
+			row_offset_[(size_t)i + 1] += row_offset_[i];
+		}
+		const size_t point_count = (size_t)row_offset_[out_height];
+
+		write_cloud->width = (uint32_t)point_count;
+		write_cloud->height = 1;
+		write_cloud->is_dense = true;
+		write_cloud->points.resize(point_count);
+		pixel_index_.resize(point_count);
+	}
+	else {
+		write_cloud->width = out_width;
+		write_cloud->height = out_height;
+		write_cloud->is_dense = false;
+		write_cloud->points.resize((size_t)out_width * (size_t)out_height);
+		pixel_index_.clear();
+	}
+
+	pcl::PointXYZRGBA* points = write_cloud->points.data();
+	int* pixel_index = pixel_index_.data();
+
+	cv::parallel_for_(cv::Range(0, out_height), [&](const cv::Range& range) {
+		ProjectionRowArgs row_args = args;
+		for (int i = range.start; i < range.end; i++) {
+			set_row_args(i, &row_args);
+
+			if (dense) {
+				row_args.dst			= points + row_offset_[i];
+				row_args.pixel_index	= pixel_index + row_offset_[i];
+			}
+			else {
+				row_args.dst			= points + ((size_t)i * (size_t)out_width);
+			}
+
+			project_row(row_args);
+		}
+	});
+
+	*cloud = write_cloud;
+
+	return 0;
+}
+
+/**
+ * 最後に作成した点群の各点に対応する画素の位置を取得します.
+ *
+ * @return 画素の位置 (カメラの向きの y * width + x). dense で作成した場合のみ有効です
+ */
+const std::vector<int>& PclPointCloudBuilder::GetPixelIndex() const
+{
+	return pixel_index_;
+}
+
+/**
+ * 最後に作成した点群の画素の配置を取得します.
+ *
+ * @return 画素の配置 (GetPixelIndex の画素の大きさ, LODの間隔, 焦点距離, 光学中心, 出力座標系でのカメラの位置)
+ */
+const PclPointCloudBuilder::PixelGrid& PclPointCloudBuilder::GetPixelGrid() const
+{
+	return pixel_grid_;
+}
+
+/**
+ * 投影時のカリング範囲を設定します.
+ *
+ * @param[in] build_parameter 作成パラメータ
+ * @param[out] args 投影処理の入出力
+ *
+ * @return none.
+ *
+ * @details 距離 z の範囲を設定します. 視差の範囲は行ごとに SetRowCullingRange で設定します
+ */
+static void SetCullingRange(const PclPointCloudBuilder::BuildParameter& build_parameter, ProjectionRowArgs* args)
+{
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// z, compared in float as pcl::PassThrough does
+	float z_min = (float)build_parameter.min_distance;
+	float z_max_inclusive = infinity;
+	if (build_parameter.pass_through) {
+		z_min = (std::max)(z_min, (float)build_parameter.pass_through_min);
+		z_max_inclusive = (float)build_parameter.pass_through_max;
+	}
+	args->z_min				= z_min;
+	args->z_max_exclusive	= (float)build_parameter.max_distance;
+	args->z_max_inclusive	= z_max_inclusive;
+
+	return;
+}
+
+/**
+ * 1行分の視差によるカリング範囲を設定します.
+ *
+ * @param[in] row_depth 行のテーブルの値 (カメラ座標系の z = row_depth / (d - d_inf))
+ * @param[inout] args 投影処理の入出力 (z の範囲は設定済み)
+ *
+ * @return none.
+ *
+ * @details 距離の範囲は z = row_depth / (d - d_inf) より視差の範囲に変換できるため、
+ *  範囲外の画素はXYZを計算する前に視差だけで除外します.
+ *  視差の範囲は丸め誤差を考慮して少し広げておき、範囲内の画素は z で厳密に判定するため、
+ *  結果は z で判定した場合と一致します. 傾きにより row_depth <= 0 の行は z > 0 の点がありません
+ */
+static void SetRowCullingRange(const float row_depth, ProjectionRowArgs* args)
+{
+	const float infinity = std::numeric_limits<float>::infinity();
+
+	// d - d_inf
+	constexpr double margin = 1.0E-4;
+	const double z_min = args->z_min;
+	const double z_max = (std::min)((double)args->z_max_exclusive, (double)args->z_max_inclusive);
+
+	args->value_min = -infinity;
+	args->value_max = infinity;
+	if (row_depth > 0) {
+		if (z_max > 0 && z_max < infinity) {
+			args->value_min = (float)((row_depth / z_max) * (1.0 - margin));
+		}
+		if (z_min > 0) {
+			args->value_max = (float)((row_depth / z_min) * (1.0 + margin));
+		}
+	}
+	else if (z_min > 0) {
+		// no point in range
+		args->value_min = infinity;
+		args->value_max = -infinity;
+	}
+
+	return;
+}
+
+/**
+ * カメラ座標系から出力座標系への変換を取得します.
+ *
+ * @param[in] build_parameter 作成パラメータ
+ * @param[out] transform 変換 (3x4 row major)
+ *
+ * @return none.
+ *
+ * @details カメラ座標系は x:左 y:上 z:前方 (右手系, 表示の向き) です.
+ *  ROS (x:前方 y:左 z:上) は (z, x, y)、Unity (x:右 y:上 z:前方) は (-x, y, z) です
+ */
+static void GetOutputTransform(const PclPointCloudBuilder::BuildParameter& build_parameter, double transform[12])
+{
+	static const double kCamera[12]	= { 1, 0, 0, 0,		0, 1, 0, 0,		0, 0, 1, 0 };
+	static const double kRos[12]	= { 0, 0, 1, 0,		1, 0, 0, 0,		0, 1, 0, 0 };
+	static const double kUnity[12]	= { -1, 0, 0, 0,	0, 1, 0, 0,		0, 0, 1, 0 };
+
+	switch (build_parameter.output_frame) {
+	case PclPointCloudBuilder::OutputFrame::kRos:
+		std::copy(kRos, kRos + 12, transform);
+		break;
+	case PclPointCloudBuilder::OutputFrame::kUnity:
+		std::copy(kUnity, kUnity + 12, transform);
+		break;
+	case PclPointCloudBuilder::OutputFrame::kExtrinsic:
+		// the last row (0, 0, 0, 1) is not used
+		std::copy(build_parameter.extrinsic, build_parameter.extrinsic + 12, transform);
+		break;
+	case PclPointCloudBuilder::OutputFrame::kCamera:
+	default:
+		std::copy(kCamera, kCamera + 12, transform);
+		break;
+	}
+
+	return;
+}
+
+/**
+ * 画素の色を点へ書き込みます.
+ *
+ * @param[in] src_pixel 画素 (kChannelCount 1:mono 3:BGR 4:BGRA)
+ * @param[out] point 点
+ *
+ * @return none.
+ *
+ * @details kChannelCount はコンパイル時に決まるため、画素ごとの分岐はありません.
+ *  PointXYZRGBA の色はメモリ上 B,G,R,A の順のため、BGRAは4byteをそのまま書き込みます
+ */
+template <int kChannelCount>
+static inline void SetPointColor(const unsigned char* src_pixel, pcl::PointXYZRGBA& point)
+{
+	if (kChannelCount == 1) {
+		point.rgba = 0xFF000000 | ((uint32_t)src_pixel[0] * 0x00010101);
+	}
+	else if (kChannelCount == 3) {
+		point.rgba = 0xFF000000 | ((uint32_t)src_pixel[2] << 16) | ((uint32_t)src_pixel[1] << 8) | (uint32_t)src_pixel[0];
+	}
+	else {
+		uint32_t bgra = 0;
+		memcpy(&bgra, src_pixel, sizeof(bgra));
+		point.rgba = 0xFF000000 | bgra;
+	}
+
+	return;
+}
+
+/**
+ * 2x2画素の色を重みで補間します.
+ *
+ * @param[in] row0 上の行
+ * @param[in] row1 下の行
+ * @param[in] row_weight 下の行の重み (0 - 256)
+ * @param[in] column0 左の列
+ * @param[in] column1 右の列
+ * @param[in] column_weight 右の列の重み (0 - 256)
+ * @param[in] channel_count 1:mono 3:BGR 4:BGRA
+ * @param[out] dst_pixel 補間した色
+ *
+ * @return none.
+ */
+static inline void BlendColor(const unsigned char* row0, const unsigned char* row1, const int row_weight, const int column0, const int column1, const int column_weight, const int channel_count, unsigned char* dst_pixel)
+{
+	const unsigned char* p00 = row0 + (column0 * channel_count);
+	const unsigned char* p01 = row0 + (column1 * channel_count);
+	const unsigned char* p10 = row1 + (column0 * channel_count);
+	const unsigned char* p11 = row1 + (column1 * channel_count);
+
+	for (int c = 0; c < channel_count; c++) {
+		const int top = (p00[c] * (256 - column_weight)) + (p01[c] * column_weight);
+		const int bottom = (p10[c] * (256 - column_weight)) + (p11[c] * column_weight);
+		dst_pixel[c] = (unsigned char)(((top * (256 - row_weight)) + (bottom * row_weight) + 32768) >> 16);
+	}
+
+	return;
+}
+
+/**
+ * 1点分の色を取得元から書き込みます.
+ *
+ * @param[in] args 入出力
+ * @param[in] j 入力位置
+ * @param[out] point 点
+ *
+ * @return none.
+ *
+ * @details 大きさの異なる画像 (4K) は列/行のテーブルの位置を直接読み出します
+ */
+template <int kChannelCount, ColorSource kColorSource>
+static inline void SetPointColorAt(const ProjectionRowArgs& args, const int j, pcl::PointXYZRGBA& point)
+{
+	static_assert(kColorSource != ColorSource::kHeatMap || kChannelCount == 4, "heat map is BGRA");
+
+	if (kColorSource == ColorSource::kImage) {
+		SetPointColor<kChannelCount>(args.image_last - (j * kChannelCount), point);
+	}
+	else if (kColorSource == ColorSource::kHeatMap) {
+		SetPointColor<kChannelCount>(args.heat_last - (j * kChannelCount), point);
+	}
+	else if (kColorSource == ColorSource::kImageNearest) {
+		SetPointColor<kChannelCount>(args.color_row0 + (*(args.color_column0_last - j) * kChannelCount), point);
+	}
+	else {
+		unsigned char pixel[4] = {};
+		BlendColor(args.color_row0, args.color_row1, args.color_row_weight, *(args.color_column0_last - j), *(args.color_column1_last - j), *(args.color_column_weight_last - j), kChannelCount, pixel);
+		SetPointColor<kChannelCount>(pixel, point);
+	}
+
+	return;
+}
+
+/**
+ * 視差から投影の可否を判定します.
+ *
+ * @param[in] value 視差 - d_inf
+ * @param[in] args 入出力
+ * @param[out] inv_value 1 / value
+ * @param[out] z Z
+ *
+ * @retval true 有効
+ * @retval false 無効
+ *
+ * @details 範囲外の画素は除算の前に視差だけで除外します
+ */
+static inline bool ProjectValue(const float value, const ProjectionRowArgs& args, float* inv_value, float* z)
+{
+	// culling by disparity, before XYZ
+	if (!(value >= args.value_min && value <= args.value_max)) {
+		return false;
+	}
+
+	*inv_value = 1.0F / value;
+	*z = args.row_depth * (*inv_value);	// m
+
+	return (value > 0 && *z >= args.z_min && *z < args.z_max_exclusive && *z <= args.z_max_inclusive);
+}
+
+/**
+ * 1行分の視差を点群へ投影します（参照実装）.
+ *
+ * @param[in] args 入出力
+ * @param[in] start 開始位置
+ * @param[in] end 終了位置（この位置は含まない）
+ * @param[in] count 書き込み済みの点数
+ *
+ * @return 書き込み済みの点数
+ *
+ * @details SIMD実装と同じ演算順序で計算するため、結果は一致します.
+ *  kDense の場合は有効な点のみを詰めて書き込み、画素の位置を pixel_index へ書き込みます
+ */
+template <int kChannelCount, ColorSource kColorSource, bool kDense>
+static int ProjectRowScalar(const ProjectionRowArgs& args, const int start, const int end, int count)
+{
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+
+	for (int j = start; j < end; j++) {
+		float inv_value = 0, z = 0;
+		const bool valid = ProjectValue(*(args.depth_last - j) - args.d_inf, args, &inv_value, &z);
+
+		if (valid) {
+			pcl::PointXYZRGBA& point = kDense ? args.dst[count] : args.dst[j];
+
+			point.x = ((args.column_x[j] + args.row_x) * inv_value) + args.translation_x;	// m
+			point.y = ((args.column_y[j] + args.row_y) * inv_value) + args.translation_y;	// m
+			point.z = ((args.column_z[j] + args.row_z) * inv_value) + args.translation_z;	// m
+			point.data[3] = 1.0F;
+
+			SetPointColorAt<kChannelCount, kColorSource>(args, j, point);
+
+			if (kDense) {
+				args.pixel_index[count] = args.pixel_index_last - (j * args.pixel_index_step);
+				count++;
+			}
+		}
+		else if (!kDense) {
+			pcl::PointXYZRGBA& point = args.dst[j];
+
+			point.x = nan;
+			point.y = nan;
+			point.z = nan;
+			point.data[3] = 1.0F;
+			point.rgba = 0xFF000000;
+		}
+	}
+
+	return kDense ? count : end;
+}
+
+/**
+ * 1行分の視差を点群へ投影します（参照実装, 1行全体）.
+ *
+ * @param[in] args 入出力
+ *
+ * @return 書き込んだ点数
+ */
+template <int kChannelCount, ColorSource kColorSource, bool kDense>
+static int ProjectRowScalarAll(const ProjectionRowArgs& args)
+{
+	return ProjectRowScalar<kChannelCount, kColorSource, kDense>(args, 0, args.width, 0);
+}
+
+/**
+ * 4点分のXYZを点群へ書き込みます.
+ *
+ * @param[in] x X
+ * @param[in] y Y
+ * @param[in] z Z
+ * @param[in] valid_mask 有効なLaneのmask
+ * @param[in] args 入出力
+ * @param[in] j 書き込み位置
+ *
+ * @return none.
+ */
+template <int kChannelCount, ColorSource kColorSource>
+static inline void StoreProjectedPoints4(__m128 x, __m128 y, __m128 z, const int valid_mask, const ProjectionRowArgs& args, const int j)
+{
+	__m128 w = _mm_set1_ps(1.0F);
+
+	// SoA -> AoS(x, y, z, 1)
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	pcl::PointXYZRGBA* dst = args.dst + j;
+	_mm_storeu_ps(dst[0].data, x);
+	_mm_storeu_ps(dst[1].data, y);
+	_mm_storeu_ps(dst[2].data, z);
+	_mm_storeu_ps(dst[3].data, w);
+
+	for (int k = 0; k < 4; k++) {
+		if (valid_mask & (1 << k)) {
+			SetPointColorAt<kChannelCount, kColorSource>(args, j + k, dst[k]);
+		}
+		else {
+			dst[k].rgba = 0xFF000000;
+		}
+	}
+
+	return;
+}
+
+/**
+ * 4点分のXYZのうち有効な点のみを詰めて書き込みます.
+ *
+ * @param[in] x X
+ * @param[in] y Y
+ * @param[in] z Z
+ * @param[in] valid_mask 有効なLaneのmask
+ * @param[in] args 入出力
+ * @param[in] j 入力位置
+ * @param[in] count 書き込み済みの点数
+ *
+ * @return 書き込み済みの点数
+ */
+template <int kChannelCount, ColorSource kColorSource>
+static inline int StoreProjectedPointsDense4(__m128 x, __m128 y, __m128 z, const int valid_mask, const ProjectionRowArgs& args, const int j, int count)
+{
+	if (valid_mask == 0) {
+		return count;
+	}
+
+	__m128 w = _mm_set1_ps(1.0F);
+
+	// SoA -> AoS(x, y, z, 1)
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	const __m128 xyzw[4] = { x, y, z, w };
+
+	for (int k = 0; k < 4; k++) {
+		if (valid_mask & (1 << k)) {
+			pcl::PointXYZRGBA& point = args.dst[count];
+
+			_mm_storeu_ps(point.data, xyzw[k]);
+			SetPointColorAt<kChannelCount, kColorSource>(args, j + k, point);
+			args.pixel_index[count] = args.pixel_index_last - ((j + k) * args.pixel_index_step);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * 4点分の無効な点を書き込みます.
+ *
+ * @param[in] args 入出力
+ * @param[in] j 書き込み位置
+ *
+ * @return none.
+ */
+static inline void StoreInvalidPoints4(const ProjectionRowArgs& args, const int j)
+{
+	const __m128 invalid = _mm_setr_ps(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN(), 1.0F);
+
+	pcl::PointXYZRGBA* dst = args.dst + j;
+	for (int k = 0; k < 4; k++) {
+		_mm_storeu_ps(dst[k].data, invalid);
+		dst[k].rgba = 0xFF000000;
+	}
+
+	return;
+}
+
+/**
+ * 1行分の視差を点群へ投影します（SIMD実装）.
+ *
+ * @param[in] args 入出力
+ *
+ * @return 書き込んだ点数
+ *
+ * @details 1画素あたりの除算は視差の逆数1回のみです. 全Laneが視差の範囲外の場合は除算を行いません.
+ *  端数は参照実装で処理します
+ */
+template <int kChannelCount, ColorSource kColorSource, bool kDense>
+static int ProjectRowSimd(const ProjectionRowArgs& args)
+{
+	const __m128 zero			= _mm_setzero_ps();
+	const __m128 one			= _mm_set1_ps(1.0F);
+	const __m128 nan			= _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
+	const __m128 d_inf			= _mm_set1_ps(args.d_inf);
+	const __m128 row_depth		= _mm_set1_ps(args.row_depth);
+	const __m128 row_x			= _mm_set1_ps(args.row_x);
+	const __m128 row_y			= _mm_set1_ps(args.row_y);
+	const __m128 row_z			= _mm_set1_ps(args.row_z);
+	const __m128 translation_x	= _mm_set1_ps(args.translation_x);
+	const __m128 translation_y	= _mm_set1_ps(args.translation_y);
+	const __m128 translation_z	= _mm_set1_ps(args.translation_z);
+	const __m128 value_min		= _mm_set1_ps(args.value_min);
+	const __m128 value_max		= _mm_set1_ps(args.value_max);
+	const __m128 z_min			= _mm_set1_ps(args.z_min);
+	const __m128 z_max_ex		= _mm_set1_ps(args.z_max_exclusive);
+	const __m128 z_max_in		= _mm_set1_ps(args.z_max_inclusive);
+
+	int j = 0;
+	int count = 0;
+
+#if defined(__AVX2__)
+	{
+		const __m256 zero8			= _mm256_setzero_ps();
+		const __m256 one8			= _mm256_set1_ps(1.0F);
+		const __m256 nan8			= _mm256_set1_ps(std::numeric_limits<float>::quiet_NaN());
+		const __m256 d_inf8			= _mm256_set1_ps(args.d_inf);
+		const __m256 row_depth8		= _mm256_set1_ps(args.row_depth);
+		const __m256 row_x8			= _mm256_set1_ps(args.row_x);
+		const __m256 row_y8			= _mm256_set1_ps(args.row_y);
+		const __m256 row_z8			= _mm256_set1_ps(args.row_z);
+		const __m256 translation_x8	= _mm256_set1_ps(args.translation_x);
+		const __m256 translation_y8	= _mm256_set1_ps(args.translation_y);
+		const __m256 translation_z8	= _mm256_set1_ps(args.translation_z);
+		const __m256 value_min8		= _mm256_set1_ps(args.value_min);
+		const __m256 value_max8		= _mm256_set1_ps(args.value_max);
+		const __m256 z_min8			= _mm256_set1_ps(args.z_min);
+		const __m256 z_max_ex8		= _mm256_set1_ps(args.z_max_exclusive);
+		const __m256 z_max_in8		= _mm256_set1_ps(args.z_max_inclusive);
+		const __m256i reverse8		= _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+		for (; j + 8 <= args.width; j += 8) {
+			const __m256 depth		= _mm256_permutevar8x32_ps(_mm256_loadu_ps(args.depth_last - j - 7), reverse8);
+			const __m256 value		= _mm256_sub_ps(depth, d_inf8);
+
+			const __m256 in_range	= _mm256_and_ps(_mm256_cmp_ps(value, value_min8, _CMP_GE_OQ), _mm256_cmp_ps(value, value_max8, _CMP_LE_OQ));
+			if (_mm256_movemask_ps(in_range) == 0) {
+				if (!kDense) {
+					StoreInvalidPoints4(args, j);
+					StoreInvalidPoints4(args, j + 4);
+				}
+				continue;
+			}
+
+			const __m256 inv_value	= _mm256_div_ps(one8, value);
+			const __m256 depth_z	= _mm256_mul_ps(row_depth8, inv_value);
+
+			__m256 valid = _mm256_and_ps(in_range, _mm256_cmp_ps(value, zero8, _CMP_GT_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(depth_z, z_min8, _CMP_GE_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(depth_z, z_max_ex8, _CMP_LT_OQ));
+			valid = _mm256_and_ps(valid, _mm256_cmp_ps(depth_z, z_max_in8, _CMP_LE_OQ));
+			const int valid_mask = _mm256_movemask_ps(valid);
+
+			// output frame
+			const __m256 x			= _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(args.column_x + j), row_x8), inv_value), translation_x8);
+			const __m256 y			= _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(args.column_y + j), row_y8), inv_value), translation_y8);
+			const __m256 z			= _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(args.column_z + j), row_z8), inv_value), translation_z8);
+
+			if (kDense) {
+				count = StoreProjectedPointsDense4<kChannelCount, kColorSource>(_mm256_castps256_ps128(x), _mm256_castps256_ps128(y), _mm256_castps256_ps128(z), valid_mask & 0x0F, args, j, count);
+				count = StoreProjectedPointsDense4<kChannelCount, kColorSource>(_mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1), valid_mask >> 4, args, j + 4, count);
+			}
+			else {
+				const __m256 xo = _mm256_blendv_ps(nan8, x, valid);
+				const __m256 yo = _mm256_blendv_ps(nan8, y, valid);
+				const __m256 zo = _mm256_blendv_ps(nan8, z, valid);
+
+				StoreProjectedPoints4<kChannelCount, kColorSource>(_mm256_castps256_ps128(xo), _mm256_castps256_ps128(yo), _mm256_castps256_ps128(zo), valid_mask & 0x0F, args, j);
+				StoreProjectedPoints4<kChannelCount, kColorSource>(_mm256_extractf128_ps(xo, 1), _mm256_extractf128_ps(yo, 1), _mm256_extractf128_ps(zo, 1), valid_mask >> 4, args, j + 4);
+			}
+		}
+	}
+#endif
+
+	for (; j + 4 <= args.width; j += 4) {
+		__m128 depth = _mm_loadu_ps(args.depth_last - j - 3);
+		depth = _mm_shuffle_ps(depth, depth, _MM_SHUFFLE(0, 1, 2, 3));
+
+		const __m128 value		= _mm_sub_ps(depth, d_inf);
+
+		const __m128 in_range	= _mm_and_ps(_mm_cmpge_ps(value, value_min), _mm_cmple_ps(value, value_max));
+		if (_mm_movemask_ps(in_range) == 0) {
+			if (!kDense) {
+				StoreInvalidPoints4(args, j);
+			}
+			continue;
+		}
+
+		const __m128 inv_value	= _mm_div_ps(one, value);
+		const __m128 depth_z	= _mm_mul_ps(row_depth, inv_value);
+
+		__m128 valid = _mm_and_ps(in_range, _mm_cmpgt_ps(value, zero));
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(depth_z, z_min));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(depth_z, z_max_ex));
+		valid = _mm_and_ps(valid, _mm_cmple_ps(depth_z, z_max_in));
+
+		// output frame
+		const __m128 x			= _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(args.column_x + j), row_x), inv_value), translation_x);
+		const __m128 y			= _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(args.column_y + j), row_y), inv_value), translation_y);
+		const __m128 z			= _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(args.column_z + j), row_z), inv_value), translation_z);
+
+		if (kDense) {
+			count = StoreProjectedPointsDense4<kChannelCount, kColorSource>(x, y, z, _mm_movemask_ps(valid), args, j, count);
+		}
+		else {
+			const __m128 xo = _mm_or_ps(_mm_and_ps(valid, x), _mm_andnot_ps(valid, nan));
+			const __m128 yo = _mm_or_ps(_mm_and_ps(valid, y), _mm_andnot_ps(valid, nan));
+			const __m128 zo = _mm_or_ps(_mm_and_ps(valid, z), _mm_andnot_ps(valid, nan));
+
+			StoreProjectedPoints4<kChannelCount, kColorSource>(xo, yo, zo, _mm_movemask_ps(valid), args, j);
+		}
+	}
+
+	// remainder
+	return ProjectRowScalar<kChannelCount, kColorSource, kDense>(args, j, args.width, count);
+}
+
+/**
+ * 1行分の有効な点の数を数えます.
+ *
+ * @param[in] args 入出力
+ *
+ * @return 有効な点の数
+ *
+ * @details 判定は投影処理と同じです. XYZと色は計算しません
+ */
+static int CountRowValid(const ProjectionRowArgs& args)
+{
+	static const int kBitCount4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+	const __m128 zero			= _mm_setzero_ps();
+	const __m128 one			= _mm_set1_ps(1.0F);
+	const __m128 d_inf			= _mm_set1_ps(args.d_inf);
+	const __m128 row_depth		= _mm_set1_ps(args.row_depth);
+	const __m128 value_min		= _mm_set1_ps(args.value_min);
+	const __m128 value_max		= _mm_set1_ps(args.value_max);
+	const __m128 z_min			= _mm_set1_ps(args.z_min);
+	const __m128 z_max_ex		= _mm_set1_ps(args.z_max_exclusive);
+	const __m128 z_max_in		= _mm_set1_ps(args.z_max_inclusive);
+
+	int j = 0;
+	int count = 0;
+
+	// the order of lanes does not matter for counting
+	for (; j + 4 <= args.width; j += 4) {
+		const __m128 value		= _mm_sub_ps(_mm_loadu_ps(args.depth_last - j - 3), d_inf);
+
+		const __m128 in_range	= _mm_and_ps(_mm_cmpge_ps(value, value_min), _mm_cmple_ps(value, value_max));
+		if (_mm_movemask_ps(in_range) == 0) {
+			continue;
+		}
+
+		const __m128 z			= _mm_mul_ps(row_depth, _mm_div_ps(one, value));
+
+		__m128 valid = _mm_and_ps(in_range, _mm_cmpgt_ps(value, zero));
+		valid = _mm_and_ps(valid, _mm_cmpge_ps(z, z_min));
+		valid = _mm_and_ps(valid, _mm_cmplt_ps(z, z_max_ex));
+		valid = _mm_and_ps(valid, _mm_cmple_ps(z, z_max_in));
+
+		count += kBitCount4[_mm_movemask_ps(valid)];
+	}
+
+	// remainder
+	for (; j < args.width; j++) {
+		float inv_value = 0, z = 0;
+		if (ProjectValue(*(args.depth_last - j) - args.d_inf, args, &inv_value, &z)) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * 画像形式に対応した投影関数を選択します.
+ *
+ * @param[in] simd true:SIMD実装 false:参照実装
+ * @param[in] channel_count 1:mono 3:BGR 4:BGRA
+ *
+ * @return 投影関数
+ */
+template <bool kDense, ColorSource kColorSource>
+static ProjectRowFunction SelectProjectRowFunction(const bool simd, const int channel_count)
+{
+	switch (channel_count) {
+	case 1:
+		return simd ? ProjectRowSimd<1, kColorSource, kDense> : ProjectRowScalarAll<1, kColorSource, kDense>;
+	case 3:
+		return simd ? ProjectRowSimd<3, kColorSource, kDense> : ProjectRowScalarAll<3, kColorSource, kDense>;
+	default:
+		return simd ? ProjectRowSimd<4, kColorSource, kDense> : ProjectRowScalarAll<4, kColorSource, kDense>;
+	}
+}
+
+/**
+ * 色の取得元と画像形式に対応した投影関数を選択します.
+ *
+ * @param[in] simd true:SIMD実装 false:参照実装
+ * @param[in] channel_count 1:mono 3:BGR 4:BGRA
+ * @param[in] color_source 色の取得元
+ *
+ * @return 投影関数
+ */
+template <bool kDense>
+static ProjectRowFunction SelectProjectRowFunction(const bool simd, const int channel_count, const ColorSource color_source)
+{
+	switch (color_source) {
+	case ColorSource::kHeatMap:
+		return simd ? ProjectRowSimd<4, ColorSource::kHeatMap, kDense> : ProjectRowScalarAll<4, ColorSource::kHeatMap, kDense>;
+	case ColorSource::kImageNearest:
+		return SelectProjectRowFunction<kDense, ColorSource::kImageNearest>(simd, channel_count);
+	case ColorSource::kImageBilinear:
+		return SelectProjectRowFunction<kDense, ColorSource::kImageBilinear>(simd, channel_count);
+	default:
+		return SelectProjectRowFunction<kDense, ColorSource::kImage>(simd, channel_count);
+	}
+}
+
+/**
+ * 色の取得元, 画像形式と出力形式に対応した投影関数を選択します.
+ *
+ * @param[in] simd true:SIMD実装 false:参照実装
+ * @param[in] dense true:有効な点のみ false:organized
+ * @param[in] channel_count 1:mono 3:BGR 4:BGRA
+ * @param[in] color_source 色の取得元
+ *
+ * @return 投影関数
+ */
+static ProjectRowFunction SelectProjectRowFunction(const bool simd, const bool dense, const int channel_count, const ColorSource color_source)
+{
+	if (dense) {
+		return SelectProjectRowFunction<true>(simd, channel_count, color_source);
+	}
+
+	return SelectProjectRowFunction<false>(simd, channel_count, color_source);
+}
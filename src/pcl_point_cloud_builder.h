@@ -0,0 +1,166 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_point_cloud_builder.h
+ * @brief Builds an organized point cloud from disparity data.
+ */
+
+#pragma once
+
+/**
+ * @class   PclPointCloudBuilder
+ * @brief   Point cloud builder class
+ * this class keeps the point cloud buffers and reuses them for every frame
+ */
+class PclPointCloudBuilder {
+public:
+
+	/** @enum  ProjectionKernel
+	 *  @brief Implementation used for the disparity to XYZ projection
+	 */
+	enum class ProjectionKernel {
+		kScalar,	/**< reference implementation */
+		kSimd		/**< SSE2 (AVX2 if enabled at compile time) */
+	};
+
+	/** @enum  LodMode
+	 *  @brief Level of detail, the disparity is decimated by lod_step x lod_step blocks before projection
+	 */
+	enum class LodMode {
+		kOff,					/**< all pixels */
+		kStride,				/**< one pixel (block center) per block */
+		kBlockAverage,			/**< average of the valid disparities in the block */
+		kBlockMinDisparity		/**< minimum valid disparity (farthest) in the block */
+	};
+
+	/** @enum  ColorSampling
+	 *  @brief Sampling of base_image when its size differs from the disparity
+	 */
+	enum class ColorSampling {
+		kNearest,				/**< nearest pixel */
+		kBilinear				/**< bilinear interpolation */
+	};
+
+	/** @enum  OutputFrame
+	 *  @brief Coordinate frame of the point cloud
+	 */
+	enum class OutputFrame {
+		kCamera,				/**< x:left y:up z:forward (right-handed, as displayed) */
+		kRos,					/**< x:forward y:left z:up (right-handed) */
+		kUnity,					/**< x:right y:up z:forward (left-handed) */
+		kExtrinsic				/**< extrinsic x camera frame */
+	};
+
+	/** @struct  BuildParameter
+	 *  @brief Parameters for Build
+	 */
+	struct BuildParameter {
+		int width, height;							/**< disparity size, the projection runs at this resolution */
+		double d_inf;								/**< camera specific parameter */
+		double base_length;							/**< camera baseline length */
+		double bf;									/**< camera specific parameter */
+		double angle;								/**< camera setup angle (degree), tilt around the x axis, upward is positive */
+		double min_distance, max_distance;			/**< display range(m) min <= z < max */
+
+		bool pass_through;							/**< cull by pass_through_min/max as well */
+		double pass_through_min, pass_through_max;	/**< range(m) min <= z <= max, same as pcl::PassThrough on "z" */
+
+		bool image_source_depth_heat;				/**< color source false:base_image true:heat_image */
+		ColorSampling color_sampling;				/**< base_image sampling when its size is not width x height */
+
+		bool dense;									/**< false:organized (invalid points are NaN) true:valid points only */
+
+		OutputFrame output_frame;					/**< coordinate frame of the output */
+		double extrinsic[16];						/**< kExtrinsic: 4x4 row major, camera frame to output frame */
+
+		LodMode lod_mode;							/**< level of detail */
+		int lod_step;								/**< block size (pixels) for lod_mode */
+	};
+
+	/** @struct  PixelGrid
+	 *  @brief Pixel positions of the last build, GetPixelIndex is on this grid
+	 */
+	struct PixelGrid {
+		int width, height;							/**< disparity size */
+		int step;									/**< lod step (1:off), the points are at block * step + step / 2 */
+		double focal_length;						/**< bf / base_length (pixels) */
+		double center_x, center_y;					/**< optical center (pixels) */
+		float origin_x, origin_y, origin_z;			/**< camera position in the output frame */
+	};
+
+	PclPointCloudBuilder();
+	~PclPointCloudBuilder();
+
+	int Initialize(const int width_max, const int height_max);
+
+	int Terminate();
+
+	void SetProjectionKernel(const ProjectionKernel projection_kernel);
+
+	void SetCloudBufferPool(PclCloudBufferPool* cloud_pool);
+
+	int Build(const BuildParameter& build_parameter, cv::Mat& base_image, cv::Mat& heat_image, cv::Mat& depth_data, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr* cloud);
+
+	const std::vector<int>& GetPixelIndex() const;
+
+	const PixelGrid& GetPixelGrid() const;
+
+private:
+	static constexpr int kCloudCount = 2;					/**< one for build, one for the viewer */
+
+	int width_max_, height_max_;
+
+	PclCloudBufferPool own_cloud_pool_;						/**< buffers of this builder, used without SetCloudBufferPool */
+	PclCloudBufferPool* cloud_pool_;						/**< buffers the points are written into */
+
+	ProjectionKernel projection_kernel_;					/**< kernel for projection */
+
+	// projection tables
+	struct ProjectionTables {
+		int width, height;
+		double base_length;
+		double bf;
+		double angle;
+		double transform[12];								/**< camera frame to output frame (3x4 row major) */
+		int lod_step;
+		double lod_center;
+		std::vector<float> column_x, column_y, column_z;	/**< output = (column + row) / d + translation */
+		std::vector<float> row_x, row_y, row_z;
+		std::vector<float> row_depth;						/**< camera frame z = row_depth / d, bf * cos - (yc - i) * B * sin */
+		int color_width, color_height;						/**< base_image size of the color tables */
+		ColorSampling color_sampling;
+		std::vector<int> color_column0, color_column1;		/**< base_image column of each disparity column (bilinear: left and right) */
+		std::vector<int> color_column_weight;				/**< bilinear: weight of color_column1 (0 - 256) */
+		std::vector<int> color_row0, color_row1;			/**< base_image row of each disparity row (bilinear: above and below) */
+		std::vector<int> color_row_weight;					/**< bilinear: weight of color_row1 (0 - 256) */
+	};
+	ProjectionTables projection_tables_;
+
+	// level of detail
+	cv::Mat lod_depth_;										/**< decimated disparity */
+	cv::Mat lod_color_;										/**< decimated color source */
+
+	// dense build
+	std::vector<int> row_offset_;							/**< output position of each row (height + 1) */
+	std::vector<int> pixel_index_;							/**< source pixel index (y * width + x) of each point */
+	PixelGrid pixel_grid_;
+
+	void UpdateProjectionTables(const int width, const int height, const double base_length, const double bf, const double angle, const double transform[12], const int lod_step, const double lod_center);
+
+	void UpdateColorTables(const int width, const int height, const int color_width, const int color_height, const ColorSampling color_sampling);
+
+	void DecimateInput(const LodMode lod_mode, const int lod_step, const float d_inf, const cv::Mat& depth_data, const cv::Mat& color_source, const bool scaled_color);
+
+};
@@ -0,0 +1,186 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_quality_controller.cpp
+ * @brief Adapts the cost of the point cloud build to a frame time budget.
+ * @version 0.1
+ *
+ * @details When the build thread takes longer than the frame interval, the frames in PclFrameTripleBuffer are dropped
+ *  and the view falls behind. The level is raised by one when the average frame time exceeds the budget,
+ *  and lowered by one after a longer period with headroom, the different periods keep it from oscillating.
+ *  Each level reduces the parameters given by the GUI, the most effective reduction first.
+ */
+
+#include <algorithm>
+#include <Windows.h>
+
+#include "pcl_def.h"
+#include "pcl_quality_controller.h"
+
+/**
+ * constructor
+ *
+ */
+PclQualityController::PclQualityController():
+	level_(0), has_frame_time_(false), frame_time_(0), frames_since_change_(0), relaxed_(false), relax_frames_()
+{
+	for (int i = 0; i <= kLevelMax; i++) {
+		relax_frames_[i] = kRelaxFrames;
+	}
+}
+
+/**
+ * destructor
+ *
+ */
+PclQualityController::~PclQualityController()
+{
+}
+
+/**
+ * 設定どおりの品質に戻します.
+ *
+ */
+void PclQualityController::Reset()
+{
+	level_ = 0;
+	has_frame_time_ = false;
+	frame_time_ = 0;
+	frames_since_change_ = 0;
+	relaxed_ = false;
+	for (int i = 0; i <= kLevelMax; i++) {
+		relax_frames_[i] = kRelaxFrames;
+	}
+
+	return;
+}
+
+/**
+ * フレームの処理時間から品質を更新します.
+ *
+ * @param[in] budget 1フレームの処理時間の目標 (ms)
+ * @param[in] frame_time 最後のフレームの処理時間 (ms)
+ *
+ * @details 次のフレームから Apply に反映されます.
+ *  品質を上げた直後に予算を超えた場合は、そのレベルに上げるまでの期間を2倍にし、レベルの往復を抑えます
+ */
+void PclQualityController::Update(const double budget, const double frame_time)
+{
+	if (has_frame_time_) {
+		frame_time_ += kSmoothing * (frame_time - frame_time_);
+	}
+	else {
+		frame_time_ = frame_time;
+		has_frame_time_ = true;
+	}
+
+	frames_since_change_ = (std::min)(frames_since_change_ + 1, kRelaxFramesMax);
+
+	if (frame_time_ > budget) {
+		if (level_ < kLevelMax && frames_since_change_ >= kDegradeFrames) {
+			if (relaxed_ && frames_since_change_ < kRelaxFrames) {
+				// the raised quality does not fit
+				relax_frames_[level_] = (std::min)(relax_frames_[level_] * 2, kRelaxFramesMax);
+			}
+
+			level_++;
+			frames_since_change_ = 0;
+			relaxed_ = false;
+		}
+	}
+	else if (frame_time_ < budget * kRelaxRatio) {
+		if (level_ > 0 && frames_since_change_ >= relax_frames_[level_ - 1]) {
+			level_--;
+			frames_since_change_ = 0;
+			relaxed_ = true;
+		}
+	}
+	else {
+		// in the band, it is kept
+		frames_since_change_ = (std::min)(frames_since_change_, kDegradeFrames);
+	}
+
+	return;
+}
+
+/**
+ * 品質に合わせてパラメータを変更します.
+ *
+ * @param[in,out] pcl_filter_parameter GUI のパラメータ. 変更後のパラメータ
+ *
+ * @details 投影の間引き (点数が減るため全ての段が軽くなる) > ボクセルの拡大 > KdTree の外れ値除去を画素グリッドに変更 > 外れ値除去を省略 の順に適用します
+ *
+ *  | level | projection step | voxel size | radius outlier removal |
+ *  |-------|-----------------|------------|------------------------|
+ *  | 0     | as configured   | x1         | as configured          |
+ *  | 1     | >= 2            | x1         | as configured          |
+ *  | 2     | >= 2            | x2         | as configured          |
+ *  | 3     | >= 3            | x2         | pixel grid             |
+ *  | 4     | >= 4            | x4         | skipped                |
+ */
+void PclQualityController::Apply(PclFilterParameter* pcl_filter_parameter) const
+{
+	static const int kStepMin[kLevelMax + 1] = { 1, 2, 2, 3, 4 };
+	static const float kVoxelScale[kLevelMax + 1] = { 1.0F, 1.0F, 2.0F, 2.0F, 4.0F };
+
+	if (level_ <= 0) {
+		return;
+	}
+
+	// projection
+	if (pcl_filter_parameter->lod_mode == 0) {
+		// block average keeps the surface, stride would alias
+		pcl_filter_parameter->lod_mode = 2;
+		pcl_filter_parameter->lod_step = kStepMin[level_];
+	}
+	else {
+		pcl_filter_parameter->lod_step = (std::max)(pcl_filter_parameter->lod_step, kStepMin[level_]);
+	}
+
+	// down sampling
+	if (pcl_filter_parameter->enabled_down_sampling) {
+		pcl_filter_parameter->down_sampling_boxel_size *= kVoxelScale[level_];
+	}
+
+	// radius outlier removal
+	if (level_ >= 3) {
+		pcl_filter_parameter->radius_outlier_removal_param.exact = false;
+	}
+	if (level_ >= 4) {
+		pcl_filter_parameter->enabled_radius_outlier_removal = false;
+	}
+
+	return;
+}
+
+/**
+ * 品質のレベルを取得します.
+ *
+ * @return 0:設定どおり - kLevelMax
+ */
+int PclQualityController::GetLevel() const
+{
+	return level_;
+}
+
+/**
+ * 平均の処理時間を取得します.
+ *
+ * @return 処理時間 (ms)
+ */
+double PclQualityController::GetFrameTime() const
+{
+	return frame_time_;
+}
@@ -0,0 +1,58 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_quality_controller.h
+ * @brief Adapts the cost of the point cloud build to a frame time budget.
+ */
+
+#pragma once
+
+/**
+ * @class   PclQualityController
+ * @brief   Quality controller class
+ * this class lowers the quality of the build when it does not finish in the budget, and restores it when there is headroom
+ */
+class PclQualityController {
+public:
+	static constexpr int kLevelMax = 4;						/**< lowest quality */
+
+	PclQualityController();
+	~PclQualityController();
+
+	void Reset();
+
+	void Update(const double budget, const double frame_time);
+
+	void Apply(PclFilterParameter* pcl_filter_parameter) const;
+
+	int GetLevel() const;
+
+	double GetFrameTime() const;
+
+private:
+	static constexpr double kSmoothing = 0.2;				/**< weight of the last frame in the average frame time */
+	static constexpr double kRelaxRatio = 0.6;				/**< the quality is raised when the average is below budget * this ratio */
+	static constexpr int kDegradeFrames = 5;				/**< frames after a level change before the quality is lowered again */
+	static constexpr int kRelaxFrames = 30;					/**< frames after a level change before the quality is raised */
+	static constexpr int kRelaxFramesMax = 960;				/**< kRelaxFrames is doubled up to this, when the raised quality does not fit */
+
+	int level_;												/**< 0:as configured - kLevelMax */
+	bool has_frame_time_;
+	double frame_time_;										/**< average frame time (ms) */
+	int frames_since_change_;
+	bool relaxed_;											/**< the last change raised the quality */
+	int relax_frames_[kLevelMax + 1];						/**< frames before the quality is raised to each level */
+
+};
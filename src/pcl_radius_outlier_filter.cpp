@@ -0,0 +1,374 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_radius_outlier_filter.cpp
+ * @brief Radius outlier removal on the pixel grid of the point cloud.
+ * @version 0.1
+ *
+ * @details Replaces pcl::RadiusOutlierRemoval for clouds made from the disparity.
+ *  The neighbors of a point are searched in a pixel window around it instead of a KdTree,
+ *  the window is the size of the search radius at the depth of the point.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_point_cloud_builder.h"
+#include "pcl_radius_outlier_filter.h"
+
+/**
+ * constructor
+ *
+ */
+PclRadiusOutlierFilter::PclRadiusOutlierFilter():
+	grid_(), integral_(), inlier_(), chunk_output_offset_(), pixel_index_()
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclRadiusOutlierFilter::~PclRadiusOutlierFilter()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] point_count_max 最大点数 (視差の画素数)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclRadiusOutlierFilter::Initialize(const int point_count_max)
+{
+	if (point_count_max < 0) {
+		return -1;
+	}
+
+	const size_t point_count = (size_t)point_count_max;
+
+	grid_.reserve(point_count);
+	inlier_.reserve(point_count);
+	pixel_index_.reserve(point_count);
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclRadiusOutlierFilter::Terminate()
+{
+	grid_.clear();
+	integral_.clear();
+	inlier_.clear();
+	chunk_output_offset_.clear();
+	pixel_index_.clear();
+
+	return 0;
+}
+
+/**
+ * 半径に基づく外れ値除去を画素の配置を使用して行います.
+ *
+ * @param[in] radius_search 検索半径(m)
+ * @param[in] min_neighbors ポイントが外れ値としてラベル付けされるのを避けるべき最小の近傍点数
+ * @param[in] pixel_grid 画素の配置 (PclPointCloudBuilder::GetPixelGrid)
+ * @param[in] pixel_index 各点の画素の位置 (y * width + x, 点ごとに異なること)
+ * @param[in] cloud 入力点群データ
+ * @param[out] filtered_cloud フィルター後の点群データ (cloud とは別のもの)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 近傍点の数え方は pcl::RadiusOutlierRemoval と同じく、自身を除いて距離が radius_search 以下の点の数です.
+ *  探索範囲はKdTreeの代わりに画素の窓で、点の光軸方向の距離 z で radius_search が占める画素数 (radius_search * f / z) とします.
+ *  窓の外の点は数えないため、画面上で離れた近傍点 (奥行き方向に並んだ点) は数えません.
+ *  窓内の点の数 (積分画像) が min_neighbors に満たない点は距離を計算せずに除き、
+ *  距離の計算は中心の行から外側へ行い、min_neighbors に達した時点で打ち切ります.
+ *  行ごとに並列に処理します. 出力の順序は入力と同じで、NaN の点は出力しません
+ */
+int PclRadiusOutlierFilter::Filter(const double radius_search, const int min_neighbors, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+									const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, pcl::PointCloud<pcl::PointXYZRGBA>* filtered_cloud)
+{
+	if (filtered_cloud == nullptr || filtered_cloud == &cloud) {
+		return -1;
+	}
+
+	if (!(radius_search > 0)) {
+		return -1;
+	}
+
+	const int point_count = (int)cloud.points.size();
+	if ((int)pixel_index.size() != point_count) {
+		return -1;
+	}
+
+	const int step = pixel_grid.step;
+	const double focal_length = pixel_grid.focal_length;
+	if (step < 1 || !(focal_length > 0) || !std::isfinite(focal_length)) {
+		return -1;
+	}
+
+	const int width = pixel_grid.width;
+	const int height = pixel_grid.height;
+	const int grid_width = width / step;
+	const int grid_height = height / step;
+	if (grid_width <= 0 || grid_height <= 0) {
+		return -1;
+	}
+
+	const int sample = step / 2;
+	const int integral_width = grid_width + 1;
+	const int window_max = (std::max)(grid_width, grid_height);
+	const pcl::PointXYZRGBA* points = cloud.points.data();
+
+	const int chunk_count = (point_count + kChunkSize - 1) / kChunkSize;
+
+	grid_.assign((size_t)grid_width * (size_t)grid_height, -1);
+	integral_.resize((size_t)integral_width * ((size_t)grid_height + 1));
+	inlier_.assign((size_t)point_count, 0);
+	chunk_output_offset_.resize((size_t)chunk_count + 1);
+
+	// 1. put the points on the grid (lod block units)
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			for (int i = start; i < end; i++) {
+				const pcl::PointXYZRGBA& point = points[i];
+				if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) {
+					continue;
+				}
+
+				const int pixel = pixel_index[i];
+				if (pixel < 0 || pixel >= width * height) {
+					continue;
+				}
+
+				const int x = (pixel % width) - sample;
+				const int y = (pixel / width) - sample;
+				if (x < 0 || y < 0) {
+					continue;
+				}
+
+				const int gx = x / step;
+				const int gy = y / step;
+				if (gx < grid_width && gy < grid_height) {
+					grid_[((size_t)gy * grid_width) + gx] = i;
+				}
+			}
+		}
+	});
+
+	// 2. integral image of the occupied cells, sums of each row then of each column
+	std::fill(integral_.begin(), integral_.begin() + integral_width, 0);
+
+	cv::parallel_for_(cv::Range(0, grid_height), [&](const cv::Range& range) {
+		for (int gy = range.start; gy < range.end; gy++) {
+			const int* cells = &grid_[(size_t)gy * grid_width];
+			int* row = &integral_[((size_t)gy + 1) * integral_width];
+
+			int sum = 0;
+			row[0] = 0;
+			for (int gx = 0; gx < grid_width; gx++) {
+				sum += (cells[gx] >= 0) ? 1 : 0;
+				row[gx + 1] = sum;
+			}
+		}
+	});
+
+	cv::parallel_for_(cv::Range(1, integral_width), [&](const cv::Range& range) {
+		for (int gy = 1; gy <= grid_height; gy++) {
+			const int* above = &integral_[((size_t)gy - 1) * integral_width];
+			int* row = &integral_[(size_t)gy * integral_width];
+			for (int j = range.start; j < range.end; j++) {
+				row[j] += above[j];
+			}
+		}
+	});
+
+	auto count_occupied = [&](const int x0, const int y0, const int x1, const int y1) {
+		const int* top = &integral_[(size_t)y0 * integral_width];
+		const int* bottom = &integral_[((size_t)y1 + 1) * integral_width];
+		return bottom[x1 + 1] - bottom[x0] - top[x1 + 1] + top[x0];
+	};
+
+	// 3. count the neighbors in the window of each point
+	const float radius_square = (float)(radius_search * radius_search);
+	const double focal_length_square = focal_length * focal_length;
+
+	cv::parallel_for_(cv::Range(0, grid_height), [&](const cv::Range& range) {
+		for (int gy = range.start; gy < range.end; gy++) {
+			for (int gx = 0; gx < grid_width; gx++) {
+				const int index = grid_[((size_t)gy * grid_width) + gx];
+				if (index < 0) {
+					continue;
+				}
+
+				if (min_neighbors <= 0) {
+					inlier_[index] = 1;
+					continue;
+				}
+
+				const pcl::PointXYZRGBA& point = points[index];
+
+				// the distance from the camera does not depend on the output frame,
+				// the depth along the optical axis is found with the direction of the pixel
+				const double dx = (double)point.x - pixel_grid.origin_x;
+				const double dy = (double)point.y - pixel_grid.origin_y;
+				const double dz = (double)point.z - pixel_grid.origin_z;
+				const double distance = std::sqrt((dx * dx) + (dy * dy) + (dz * dz));
+
+				const double u = ((double)gx * step) + sample - pixel_grid.center_x;
+				const double v = ((double)gy * step) + sample - pixel_grid.center_y;
+				const double depth = distance * focal_length / std::sqrt((u * u) + (v * v) + focal_length_square);
+
+				int half_window = window_max;
+				if (depth > 0) {
+					const double cells = std::ceil(radius_search * focal_length / (depth * step));
+					if (cells < window_max) {
+						half_window = (int)cells;
+					}
+				}
+
+				const int x0 = (std::max)(0, gx - half_window);
+				const int x1 = (std::min)(grid_width - 1, gx + half_window);
+				const int y0 = (std::max)(0, gy - half_window);
+				const int y1 = (std::min)(grid_height - 1, gy + half_window);
+
+				// not enough points in the window, including the point itself
+				if (count_occupied(x0, y0, x1, y1) - 1 < min_neighbors) {
+					continue;
+				}
+
+				int count = 0;
+				auto count_row = [&](const int y) {
+					if (count_occupied(x0, y, x1, y) == 0) {
+						return false;
+					}
+
+					const int* cells = &grid_[(size_t)y * grid_width];
+					for (int x = x0; x <= x1; x++) {
+						const int neighbor = cells[x];
+						if (neighbor < 0 || neighbor == index) {
+							continue;
+						}
+
+						const float nx = points[neighbor].x - point.x;
+						const float ny = points[neighbor].y - point.y;
+						const float nz = points[neighbor].z - point.z;
+						if (((nx * nx) + (ny * ny) + (nz * nz)) <= radius_square) {
+							count++;
+							if (count >= min_neighbors) {
+								return true;
+							}
+						}
+					}
+
+					return false;
+				};
+
+				// from the center row, the near rows have most of the neighbors
+				bool inlier = count_row(gy);
+				for (int r = 1; !inlier && (gy - r >= y0 || gy + r <= y1); r++) {
+					if (gy - r >= y0) {
+						inlier = count_row(gy - r);
+					}
+					if (!inlier && gy + r <= y1) {
+						inlier = count_row(gy + r);
+					}
+				}
+
+				if (inlier) {
+					inlier_[index] = 1;
+				}
+			}
+		}
+	});
+
+	// 4. output in the input order
+	chunk_output_offset_[0] = 0;
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			int count = 0;
+			for (int i = start; i < end; i++) {
+				count += inlier_[i];
+			}
+			chunk_output_offset_[(size_t)c + 1] = count;
+		}
+	});
+
+	for (int c = 0; c < chunk_count; c++) {
+		chunk_output_offset_[(size_t)c + 1] += chunk_output_offset_[c];
+	}
+	const int output_count = chunk_output_offset_[chunk_count];
+
+	filtered_cloud->points.resize((size_t)output_count);
+	filtered_cloud->width = (uint32_t)output_count;
+	filtered_cloud->height = 1;
+	filtered_cloud->is_dense = true;
+	filtered_cloud->header = cloud.header;
+	filtered_cloud->sensor_origin_ = cloud.sensor_origin_;
+	filtered_cloud->sensor_orientation_ = cloud.sensor_orientation_;
+	pixel_index_.resize((size_t)output_count);
+
+	pcl::PointXYZRGBA* dst = filtered_cloud->points.data();
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			int position = chunk_output_offset_[c];
+			for (int i = start; i < end; i++) {
+				if (inlier_[i] == 0) {
+					continue;
+				}
+
+				dst[position] = points[i];
+				pixel_index_[position] = pixel_index[i];
+				position++;
+			}
+		}
+	});
+
+	return 0;
+}
+
+/**
+ * 最後の結果の各点に対応する画素の位置を取得します.
+ *
+ * @return 画素の位置 (y * width + x)
+ */
+const std::vector<int>& PclRadiusOutlierFilter::GetPixelIndex() const
+{
+	return pixel_index_;
+}
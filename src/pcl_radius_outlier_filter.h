@@ -0,0 +1,51 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_radius_outlier_filter.h
+ * @brief Radius outlier removal on the pixel grid of the point cloud.
+ */
+
+#pragma once
+
+/**
+ * @class   PclRadiusOutlierFilter
+ * @brief   Radius outlier removal class for clouds made from the disparity
+ * this class keeps the work buffers and reuses them for every frame
+ */
+class PclRadiusOutlierFilter {
+public:
+
+	PclRadiusOutlierFilter();
+	~PclRadiusOutlierFilter();
+
+	int Initialize(const int point_count_max);
+
+	int Terminate();
+
+	int Filter(const double radius_search, const int min_neighbors, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+				const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, pcl::PointCloud<pcl::PointXYZRGBA>* filtered_cloud);
+
+	const std::vector<int>& GetPixelIndex() const;
+
+private:
+	static constexpr int kChunkSize = 16384;				/**< points per work unit for the output */
+
+	std::vector<int> grid_;									/**< point index of each cell, -1 for empty */
+	std::vector<int> integral_;								/**< integral image of the occupied cells ((width + 1) x (height + 1)) */
+	std::vector<uint8_t> inlier_;							/**< 1: the point is kept */
+	std::vector<int> chunk_output_offset_;					/**< chunk, output position */
+	std::vector<int> pixel_index_;							/**< source pixel index of each output point */
+
+};
@@ -22,9 +22,15 @@
  * @details Create a point cloud from the parallax and filter and display it using the Point cloud Library functionality.
  */
 
+#include <cstdint>
 #include <mutex>
+#include <condition_variable>
+#include <system_error>
 #include <iostream>
 #include <thread>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
 #include <boost/thread.hpp>
 #include <pcl/common/angles.h> // for pcl::deg2rad
 #include <pcl/features/normal_3d.h>
@@ -33,11 +39,9 @@
 #include <pcl/console/parse.h>
 #include <pcl/visualization/cloud_viewer.h>
 #include <boost/make_shared.hpp>
-#include <pcl/filters/passthrough.h>
+#include <pcl/common/io.h>
 #include <pcl/filters/radius_outlier_removal.h>
-#include <pcl/filters/voxel_grid.h>
 #include <pcl/surface/mls.h>
-#include <pcl/segmentation/sac_segmentation.h>
 
 #include "opencv2/opencv.hpp"
 
@@ -49,8 +53,25 @@
 
 #include "pcl_def.h"
 #include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
+#include "pcl_frame_triple_buffer.h"
+#include "pcl_frame_broadcast_ring.h"
+#include "pcl_build_slot_queue.h"
+#include "pcl_cloud_buffer_pool.h"
+#include "pcl_point_cloud_builder.h"
+#include "pcl_voxel_grid_filter.h"
+#include "pcl_radius_outlier_filter.h"
+#include "pcl_plane_detector.h"
+#include "pcl_filter_pipeline.h"
+#include "pcl_flying_pixel_filter.h"
+#include "pcl_temporal_filter.h"
+#include "pcl_quality_controller.h"
+#include "pcl_normal_estimator.h"
 
 #include "pcl_support.h"
+#include "win_support.h"
+
+constexpr int kBUILD_SLOT_COUNT_MAX = 4;	/**< 同時に処理できるフレームの数 (build_frames_in_flight の最大) */
 
 /** @enum  OperationStatus
  *  @brief 表示動作の状態
@@ -85,7 +106,60 @@ struct PclVizControl {
 	VizParameters viz_parameters;
 
 	// data ring buffer
-	PclDataRingBuffer* pcl_data_ring_buffer;
+	PclFrameTripleBuffer* pcl_frame_buffer;
+
+	// frames for the consumers other than the 3D view
+	PclFrameBroadcastRing* pcl_frame_broadcast_ring;
+
+	// frames in flight between the build thread and the filter thread
+	struct BuildSlot {
+		PclPointCloudBuilder* pcl_point_cloud_builder;	/**< keeps the pixel index and the pixel grid of the frame, the cloud is in build_cloud_pool */
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;	/**< output of the builder */
+		bool repeated;									/**< same build as the previous frame, cloud is shared with it and not built again */
+		const std::vector<int>* pixel_index;			/**< pixel of each point of cloud */
+		std::vector<int> repeated_pixel_index;			/**< repeated: copy of the pixel index of the previous frame */
+		PclPointCloudBuilder::PixelGrid pixel_grid;		/**< pixel grid of cloud */
+		PclFilterParameter pcl_filter_parameter;		/**< parameters of the frame, after the quality control */
+		unsigned long long frame_key;					/**< cache key of the frame */
+		unsigned long long build_key;					/**< cache key of the build stage */
+		double build_time;								/**< processing time of the build thread (ms) */
+	};
+	BuildSlot build_slots[kBUILD_SLOT_COUNT_MAX];
+	PclBuildSlotQueue* free_slot_queue;				/**< filter thread to build thread */
+	PclBuildSlotQueue* built_slot_queue;			/**< build thread to filter thread */
+	PclCloudBufferPool* build_cloud_pool;			/**< clouds of the builders of all the slots (used by build thread) */
+
+	// flying pixel filter (used by build thread)
+	PclFlyingPixelFilter* pcl_flying_pixel_filter;
+
+	// temporal filter (used by build thread)
+	PclTemporalFilter* pcl_temporal_filter;
+
+	// down sampling (used by filter thread)
+	PclVoxelGridFilter* pcl_voxel_grid_filter;
+
+	// radius outlier removal (used by filter thread)
+	PclRadiusOutlierFilter* pcl_radius_outlier_filter;
+	std::vector<int> pixel_index;						/**< pixel of each point after down sampling */
+	std::vector<int> outlier_kept_index;				/**< points kept by the exact radius outlier removal */
+	std::vector<int> outlier_pixel_index;				/**< pixel of each point after the exact radius outlier removal */
+
+	// plane detection (used by filter thread)
+	PclPlaneDetector* pcl_plane_detector;
+	std::vector<PclPlaneDetector::Plane> planes;		/**< planes of the multi plane detection */
+
+	// normal estimation (used by filter thread)
+	PclNormalEstimator* pcl_normal_estimator;
+
+	// filter stages (used by filter thread)
+	PclFilterPipeline* pcl_filter_pipeline;
+
+	// quality control (applied by build thread, updated by filter thread)
+	PclQualityController* pcl_quality_controller;				/**< guarded by threads_mutex */
+	PclVizOutputArgs::QualityInformation quality_information;	/**< guarded by threads_mutex */
+
+	// statistics of the filter stages (updated by filter thread)
+	PclVizOutputArgs::StageInformation stage_information[kPCL_FILTER_STAGE_COUNT];	/**< guarded by threads_mutex */
 
 	// point cloud for draw
 	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
@@ -94,28 +168,23 @@ struct PclVizControl {
 	OperationStatus operation_status;
 
 	// Thread Control
-	HANDLE handle_semaphore_pcl_build;
-	HANDLE handle_semaphore_pcl_draw;
-	CRITICAL_SECTION	threads_critical;
+	std::mutex threads_mutex;
 
 	struct ThreadControl {
-		HANDLE thread_handle;
-		;
-		int terminate_request;
-		int terminate_done;
-		int end_code;
-		bool stop_request;
+		std::thread thread;
+		std::atomic<bool> terminate_request;
+		std::mutex wake_mutex;
+		std::condition_variable wake_condition;
+		bool wake_request;								/**< guarded by wake_mutex, like a semaphore of count 1 */
 	};
-	ThreadControl thread_control_build_pcl;
-	ThreadControl thread_control_draw;
+	ThreadControl thread_control_build_pcl;			/**< woken by RunPclViz when a frame is put */
+	ThreadControl thread_control_filter_pcl;		/**< waits on built_slot_queue */
+	ThreadControl thread_control_draw;				/**< woken by the filter thread when the cloud is updated */
 
 	// pick control/information
-	CRITICAL_SECTION pick_callback_critical;
+	std::mutex pick_callback_mutex;
 	PickInforamtion pick_information;
 
-	// ketbord call back 
-	CRITICAL_SECTION kbd_callback_critical;
-
 };
 PclVizControl pcl_viz_control_ = {};	/**< 表示Threadへ渡すデータ */
 
@@ -131,24 +200,52 @@ struct CallbackArgs {
 // 
 // functions
 //
-unsigned __stdcall BuildPCLThread(void* context);
+unsigned BuildPCLThread(void* context);
 
-unsigned __stdcall VisualizerThread(void* context);
+unsigned FilterPCLThread(void* context);
 
-void BuildPointCloud(	const int width, const int height, const double d_inf, const double base_length, const double bf, const double min_distance, const double max_distance,
-						cv::Mat& base_image, cv::Mat& depth_data,
-						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
+unsigned VisualizerThread(void* context);
+
+int StartThread(PclVizControl::ThreadControl* thread_control, unsigned (*thread_function)(void*), void* context);
 
-int PathThroughFilter(const std::string field_name, const double min_length, const double max_length, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud);
+void StopThread(PclVizControl::ThreadControl* thread_control);
 
-int RadiusOutlierRemoval(const double radius_search, const int min_neighbors_in_radius, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud);
+void StopBuildThreads(PclVizControl* pcl_viz_control);
 
-int DownSampling(const double boxel_size, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud);
+void WakeUpThread(PclVizControl::ThreadControl* thread_control);
 
-int PlaneDetection(double threshold, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
+bool WaitWakeUp(PclVizControl::ThreadControl* thread_control, const int timeout);
+
+int RadiusOutlierRemoval(const double radius_search, const int min_neighbors_in_radius, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud, std::vector<int>* kept_index);
+
+int RadiusOutlierRemoval(PclRadiusOutlierFilter* radius_outlier_filter, const double radius_search, const int min_neighbors_in_radius, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+							pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud);
+
+int DownSampling(PclVoxelGridFilter* voxel_grid_filter, const double boxel_size, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud);
+
+int PlaneDetection(PclPlaneDetector* plane_detector, double threshold, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
+
+int MultiPlaneDetection(PclPlaneDetector* plane_detector, double threshold, int plane_count_max, int min_inlier_count, double time_budget, std::vector<PclPlaneDetector::Plane>* planes, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
+
+int NormalEstimation(PclNormalEstimator* normal_estimator, const int window_size, const bool color_by_normal, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
 
 int WritePclToFile(char* write_file_name, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud);
 
+/**
+ * キーに値を加えます.
+ *
+ * @param[in] key これまでのキー
+ * @param[in] value 値 (パディングの無い型)
+ *
+ * @return キー
+ */
+template <typename T>
+static unsigned long long HashValue(const unsigned long long key, const T& value)
+{
+	return PclFilterPipeline::Hash(key, &value, sizeof(T));
+}
+
 /**
  * 初期化します.
  *
@@ -170,8 +267,13 @@ int InitializePclViz(const VizParameters* init_viz_parameters)
 	pcl_viz_control->viz_parameters.d_inf					= init_viz_parameters->d_inf;
 	pcl_viz_control->viz_parameters.base_length				= init_viz_parameters->base_length;
 	pcl_viz_control->viz_parameters.bf						= init_viz_parameters->bf;
+	pcl_viz_control->viz_parameters.angle					= init_viz_parameters->angle;
 	pcl_viz_control->viz_parameters.min_distance			= init_viz_parameters->min_distance;
 	pcl_viz_control->viz_parameters.max_distance			= init_viz_parameters->max_distance;
+	pcl_viz_control->viz_parameters.output_frame			= init_viz_parameters->output_frame;
+	for (int i = 0; i < 16; i++) {
+		pcl_viz_control->viz_parameters.extrinsic[i]		= init_viz_parameters->extrinsic[i];
+	}
 	pcl_viz_control->viz_parameters.coordinate_system		= init_viz_parameters->coordinate_system;
 	pcl_viz_control->viz_parameters.full_screen_request		= init_viz_parameters->full_screen_request;
 	pcl_viz_control->viz_parameters.restore_screen_request	= init_viz_parameters->restore_screen_request;
@@ -180,17 +282,14 @@ int InitializePclViz(const VizParameters* init_viz_parameters)
 
 	pcl_viz_control->operation_status = OperationStatus::idle;
 
-	pcl_viz_control->thread_control_build_pcl.thread_handle = NULL;
-	pcl_viz_control->thread_control_build_pcl.terminate_request = 0;
-	pcl_viz_control->thread_control_build_pcl.terminate_done = 0;
-	pcl_viz_control->thread_control_build_pcl.stop_request = false;
-	pcl_viz_control->thread_control_build_pcl.end_code = 0;
+	pcl_viz_control->thread_control_build_pcl.terminate_request = false;
+	pcl_viz_control->thread_control_build_pcl.wake_request = false;
+
+	pcl_viz_control->thread_control_filter_pcl.terminate_request = false;
+	pcl_viz_control->thread_control_filter_pcl.wake_request = false;
 
-	pcl_viz_control->thread_control_draw.thread_handle = NULL;
-	pcl_viz_control->thread_control_draw.terminate_request = 0;
-	pcl_viz_control->thread_control_draw.terminate_done = 0;
-	pcl_viz_control->thread_control_draw.stop_request = false;
-	pcl_viz_control->thread_control_draw.end_code = 0;
+	pcl_viz_control->thread_control_draw.terminate_request = false;
+	pcl_viz_control->thread_control_draw.wake_request = false;
 
 	pcl_viz_control->pick_information.max_count = 4;
 	pcl_viz_control->pick_information.count = 0;
@@ -202,29 +301,60 @@ int InitializePclViz(const VizParameters* init_viz_parameters)
 	}
 
 	// buffers
-	pcl_viz_control->pcl_data_ring_buffer = new PclDataRingBuffer;
-	pcl_viz_control->pcl_data_ring_buffer->Initialize(true, true, 4, pcl_viz_control->viz_parameters.width, pcl_viz_control->viz_parameters.height);
+	pcl_viz_control->pcl_frame_buffer = new PclFrameTripleBuffer;
+	pcl_viz_control->pcl_frame_buffer->Initialize(pcl_viz_control->viz_parameters.width, pcl_viz_control->viz_parameters.height);
+
+	// 8 frames of delay for a lossless consumer, up to 4 consumers
+	pcl_viz_control->pcl_frame_broadcast_ring = new PclFrameBroadcastRing;
+	pcl_viz_control->pcl_frame_broadcast_ring->Initialize(kPCL_FRAME_RING_DEPTH, kPCL_FRAME_CONSUMER_MAX);
+
+	// the builder of each slot is created when the slot is used
+	for (int i = 0; i < kBUILD_SLOT_COUNT_MAX; i++) {
+		pcl_viz_control->build_slots[i].pcl_point_cloud_builder = nullptr;
+		pcl_viz_control->build_slots[i].cloud.reset();
+		pcl_viz_control->build_slots[i].repeated = false;
+		pcl_viz_control->build_slots[i].pixel_index = nullptr;
+	}
 
-	// flags
-	char semaphoreName[64] = {};
+	pcl_viz_control->free_slot_queue = new PclBuildSlotQueue;
+	pcl_viz_control->free_slot_queue->Initialize(kBUILD_SLOT_COUNT_MAX);
 
-	sprintf_s(semaphoreName, "THREAD_SEMAPHORENAME_pb_%d", 0);
-	pcl_viz_control->handle_semaphore_pcl_build = CreateSemaphoreA(NULL, 0, 1, semaphoreName);
-	if (pcl_viz_control->handle_semaphore_pcl_build == NULL) {
-		// Fail
-		return 0;
-	}
+	pcl_viz_control->built_slot_queue = new PclBuildSlotQueue;
+	pcl_viz_control->built_slot_queue->Initialize(kBUILD_SLOT_COUNT_MAX);
 
-	sprintf_s(semaphoreName, "THREAD_SEMAPHORENAME_bd_U_%d", 0);
-	pcl_viz_control->handle_semaphore_pcl_draw = CreateSemaphoreA(NULL, 0, 1, semaphoreName);
-	if (pcl_viz_control->handle_semaphore_pcl_draw == NULL) {
-		// Fail
-		return 0;
-	}
+	// one cloud for each frame in flight, the viewer and the last build (kept for a repeated frame)
+	// a cloud grows when it is written, only the clouds of the frames in flight are used
+	pcl_viz_control->build_cloud_pool = new PclCloudBufferPool;
+	pcl_viz_control->build_cloud_pool->Initialize(kBUILD_SLOT_COUNT_MAX + 2);
+
+	pcl_viz_control->pcl_flying_pixel_filter = new PclFlyingPixelFilter;
+	pcl_viz_control->pcl_flying_pixel_filter->Initialize(pcl_viz_control->viz_parameters.width, pcl_viz_control->viz_parameters.height);
+
+	pcl_viz_control->pcl_temporal_filter = new PclTemporalFilter;
+	pcl_viz_control->pcl_temporal_filter->Initialize(pcl_viz_control->viz_parameters.width, pcl_viz_control->viz_parameters.height);
+
+	pcl_viz_control->pcl_voxel_grid_filter = new PclVoxelGridFilter;
+	pcl_viz_control->pcl_voxel_grid_filter->Initialize(pcl_viz_control->viz_parameters.width * pcl_viz_control->viz_parameters.height);
+
+	pcl_viz_control->pcl_radius_outlier_filter = new PclRadiusOutlierFilter;
+	pcl_viz_control->pcl_radius_outlier_filter->Initialize(pcl_viz_control->viz_parameters.width * pcl_viz_control->viz_parameters.height);
+	pcl_viz_control->pixel_index.reserve((size_t)pcl_viz_control->viz_parameters.width * pcl_viz_control->viz_parameters.height);
+
+	pcl_viz_control->pcl_plane_detector = new PclPlaneDetector;
+	pcl_viz_control->pcl_plane_detector->Initialize(pcl_viz_control->viz_parameters.width * pcl_viz_control->viz_parameters.height);
+	pcl_viz_control->planes.reserve(PclPlaneDetector::kPlaneCountMax);
+
+	pcl_viz_control->pcl_normal_estimator = new PclNormalEstimator;
+	pcl_viz_control->pcl_normal_estimator->Initialize(pcl_viz_control->viz_parameters.width * pcl_viz_control->viz_parameters.height);
+
+	pcl_viz_control->pcl_filter_pipeline = new PclFilterPipeline;
+	pcl_viz_control->pcl_filter_pipeline->Initialize();
 
-	InitializeCriticalSection(&pcl_viz_control->threads_critical);
-	InitializeCriticalSection(&pcl_viz_control->pick_callback_critical);
-	InitializeCriticalSection(&pcl_viz_control->kbd_callback_critical);
+	pcl_viz_control->pcl_quality_controller = new PclQualityController;
+	pcl_viz_control->quality_information = {};
+	for (int i = 0; i < kPCL_FILTER_STAGE_COUNT; i++) {
+		pcl_viz_control->stage_information[i] = {};
+	}
 
 	return 0;
 }
@@ -238,69 +368,77 @@ int TerminatePclViz()
 	// ended
 	PclVizControl* pcl_viz_control = &pcl_viz_control_;
 
-	// stop draw
-	if (pcl_viz_control->thread_control_draw.thread_handle != NULL) {
-		pcl_viz_control->thread_control_draw.stop_request = true;
-		pcl_viz_control->thread_control_draw.terminate_done = 0;
-		pcl_viz_control->thread_control_draw.end_code = 0;
-		pcl_viz_control->thread_control_draw.terminate_request = 1;
+	// stop draw, then build (the filter thread wakes the draw thread)
+	StopThread(&pcl_viz_control->thread_control_draw);
+	StopBuildThreads(pcl_viz_control);
 
-		int count = 0;
-		while (pcl_viz_control->thread_control_draw.terminate_done == 0) {
-			if (count > 200) {
-				break;
-			}
-			count++;
-			Sleep(10L);
-		}
-
-		if (pcl_viz_control->thread_control_draw.thread_handle != NULL) {
-			CloseHandle(pcl_viz_control->thread_control_draw.thread_handle);
-			pcl_viz_control->thread_control_draw.thread_handle = NULL;
+	// deletebuffer
+	pcl_viz_control->pcl_frame_buffer->Terminate();
+	delete pcl_viz_control->pcl_frame_buffer;
+	pcl_viz_control->pcl_frame_buffer = nullptr;
+
+	pcl_viz_control->pcl_frame_broadcast_ring->Terminate();
+	delete pcl_viz_control->pcl_frame_broadcast_ring;
+	pcl_viz_control->pcl_frame_broadcast_ring = nullptr;
+
+	for (int i = 0; i < kBUILD_SLOT_COUNT_MAX; i++) {
+		PclVizControl::BuildSlot* build_slot = &pcl_viz_control->build_slots[i];
+		build_slot->cloud.reset();
+		build_slot->pixel_index = nullptr;
+		build_slot->repeated_pixel_index.clear();
+		if (build_slot->pcl_point_cloud_builder != nullptr) {
+			build_slot->pcl_point_cloud_builder->Terminate();
+			delete build_slot->pcl_point_cloud_builder;
+			build_slot->pcl_point_cloud_builder = nullptr;
 		}
 	}
 
-	// stop build
-	if (pcl_viz_control->thread_control_build_pcl.thread_handle != NULL) {
-		pcl_viz_control->thread_control_build_pcl.stop_request = true;
-		pcl_viz_control->thread_control_build_pcl.terminate_done = 0;
-		pcl_viz_control->thread_control_build_pcl.end_code = 0;
-		pcl_viz_control->thread_control_build_pcl.terminate_request = 1;
+	pcl_viz_control->free_slot_queue->Terminate();
+	delete pcl_viz_control->free_slot_queue;
+	pcl_viz_control->free_slot_queue = nullptr;
 
-		int count = 0;
-		while (pcl_viz_control->thread_control_build_pcl.terminate_done == 0) {
-			if (count > 200) {
-				break;
-			}
-			count++;
-			Sleep(10L);
-		}
+	pcl_viz_control->built_slot_queue->Terminate();
+	delete pcl_viz_control->built_slot_queue;
+	pcl_viz_control->built_slot_queue = nullptr;
 
-		if (pcl_viz_control->thread_control_build_pcl.thread_handle != NULL) {
-			CloseHandle(pcl_viz_control->thread_control_build_pcl.thread_handle);
-			pcl_viz_control->thread_control_build_pcl.thread_handle = NULL;
-		}
-	}
+	pcl_viz_control->build_cloud_pool->Terminate();
+	delete pcl_viz_control->build_cloud_pool;
+	pcl_viz_control->build_cloud_pool = nullptr;
 
-	// delete flags
-	DeleteCriticalSection(&pcl_viz_control->threads_critical);
-	DeleteCriticalSection(&pcl_viz_control->pick_callback_critical);
-	DeleteCriticalSection(&pcl_viz_control->kbd_callback_critical);
+	pcl_viz_control->pcl_flying_pixel_filter->Terminate();
+	delete pcl_viz_control->pcl_flying_pixel_filter;
+	pcl_viz_control->pcl_flying_pixel_filter = nullptr;
 
-	if (pcl_viz_control->handle_semaphore_pcl_draw != NULL) {
-		CloseHandle(pcl_viz_control->handle_semaphore_pcl_draw);
-		pcl_viz_control->handle_semaphore_pcl_draw = NULL;
-	}
-		
-	if (pcl_viz_control->handle_semaphore_pcl_build != NULL) {
-		CloseHandle(pcl_viz_control->handle_semaphore_pcl_build);
-		pcl_viz_control->handle_semaphore_pcl_build = NULL;
-	}
+	pcl_viz_control->pcl_temporal_filter->Terminate();
+	delete pcl_viz_control->pcl_temporal_filter;
+	pcl_viz_control->pcl_temporal_filter = nullptr;
 
-	// deletebuffer
-	pcl_viz_control->pcl_data_ring_buffer->Terminate();
-	delete pcl_viz_control->pcl_data_ring_buffer;
-	pcl_viz_control->pcl_data_ring_buffer = nullptr;
+	pcl_viz_control->pcl_voxel_grid_filter->Terminate();
+	delete pcl_viz_control->pcl_voxel_grid_filter;
+	pcl_viz_control->pcl_voxel_grid_filter = nullptr;
+
+	pcl_viz_control->pcl_radius_outlier_filter->Terminate();
+	delete pcl_viz_control->pcl_radius_outlier_filter;
+	pcl_viz_control->pcl_radius_outlier_filter = nullptr;
+	pcl_viz_control->pixel_index.clear();
+	pcl_viz_control->outlier_kept_index.clear();
+	pcl_viz_control->outlier_pixel_index.clear();
+
+	pcl_viz_control->pcl_plane_detector->Terminate();
+	delete pcl_viz_control->pcl_plane_detector;
+	pcl_viz_control->pcl_plane_detector = nullptr;
+	pcl_viz_control->planes.clear();
+
+	pcl_viz_control->pcl_normal_estimator->Terminate();
+	delete pcl_viz_control->pcl_normal_estimator;
+	pcl_viz_control->pcl_normal_estimator = nullptr;
+
+	pcl_viz_control->pcl_filter_pipeline->Terminate();
+	delete pcl_viz_control->pcl_filter_pipeline;
+	pcl_viz_control->pcl_filter_pipeline = nullptr;
+
+	delete pcl_viz_control->pcl_quality_controller;
+	pcl_viz_control->pcl_quality_controller = nullptr;
 
 	return 0;
 }
@@ -316,37 +454,26 @@ int StartPclViz()
 {
 	PclVizControl* pcl_viz_control = &pcl_viz_control_;
 
+	// the slots are given by the build thread
+	pcl_viz_control->free_slot_queue->Clear();
+	pcl_viz_control->built_slot_queue->Clear();
+
 	// start buildl thread
-	if (pcl_viz_control->thread_control_build_pcl.thread_handle != NULL) {
+	if (StartThread(&pcl_viz_control->thread_control_build_pcl, BuildPCLThread, (void*)pcl_viz_control) != 0) {
 		return -1;
 	}
-	pcl_viz_control->thread_control_build_pcl.thread_handle = NULL;
-	pcl_viz_control->thread_control_build_pcl.terminate_request = 0;
-	pcl_viz_control->thread_control_build_pcl.terminate_done = 0;
-	pcl_viz_control->thread_control_build_pcl.stop_request = false;
-	pcl_viz_control->thread_control_build_pcl.end_code = 0;
-
-	if ((pcl_viz_control->thread_control_build_pcl.thread_handle = (HANDLE)_beginthreadex(0, 0, BuildPCLThread, (void*)pcl_viz_control, 0, 0)) == 0) {
-		// Fail
-		return 0;
+
+	// start filter thread
+	if (StartThread(&pcl_viz_control->thread_control_filter_pcl, FilterPCLThread, (void*)pcl_viz_control) != 0) {
+		StopBuildThreads(pcl_viz_control);
+		return -1;
 	}
-	SetThreadPriority(pcl_viz_control->thread_control_build_pcl.thread_handle, THREAD_PRIORITY_NORMAL);
 
 	// start visual thread
-	if (pcl_viz_control->thread_control_draw.thread_handle != NULL) {
+	if (StartThread(&pcl_viz_control->thread_control_draw, VisualizerThread, (void*)pcl_viz_control) != 0) {
+		StopBuildThreads(pcl_viz_control);
 		return -1;
 	}
-	pcl_viz_control->thread_control_draw.thread_handle = NULL;
-	pcl_viz_control->thread_control_draw.terminate_request = 0;
-	pcl_viz_control->thread_control_draw.terminate_done = 0;
-	pcl_viz_control->thread_control_draw.stop_request = false;
-	pcl_viz_control->thread_control_draw.end_code = 0;
-
-	if ((pcl_viz_control->thread_control_draw.thread_handle = (HANDLE)_beginthreadex(0, 0, VisualizerThread, (void*)pcl_viz_control, 0, 0)) == 0) {
-		// Fail
-		return 0;
-	}
-	SetThreadPriority(pcl_viz_control->thread_control_draw.thread_handle, THREAD_PRIORITY_NORMAL);
 
 	// clear buufer
 	pcl_viz_control->pick_information.count = 0;
@@ -357,7 +484,7 @@ int StartPclViz()
 		pcl_viz_control->pick_information.pick_data[i].z = 0.0F;
 	}
 
-	pcl_viz_control->pcl_data_ring_buffer->Clear();
+	pcl_viz_control->pcl_frame_buffer->Clear();
 
 	pcl_viz_control->operation_status = OperationStatus::active;
 
@@ -377,51 +504,9 @@ int StopPclViz()
 
 	pcl_viz_control->operation_status = OperationStatus::idle;
 
-	// stop draw
-	if (pcl_viz_control->thread_control_draw.thread_handle != NULL) {
-		pcl_viz_control->thread_control_draw.stop_request = true;
-		pcl_viz_control->thread_control_draw.terminate_done = 0;
-		pcl_viz_control->thread_control_draw.end_code = 0;
-		pcl_viz_control->thread_control_draw.terminate_request = 1;
-
-		int count = 0;
-		while (pcl_viz_control->thread_control_draw.terminate_done == 0) {
-			if (count > 200) {
-				printf("[ERROR]Stop VisualizerThread! count > 200\n");
-				break;
-			}
-			count++;
-			Sleep(10L);
-		}
-
-		if (pcl_viz_control->thread_control_draw.thread_handle != NULL) {
-			CloseHandle(pcl_viz_control->thread_control_draw.thread_handle);
-			pcl_viz_control->thread_control_draw.thread_handle = NULL;
-		}
-	}
-
-	// stop build
-	if (pcl_viz_control->thread_control_build_pcl.thread_handle != NULL) {
-		pcl_viz_control->thread_control_build_pcl.stop_request = true;
-		pcl_viz_control->thread_control_build_pcl.terminate_done = 0;
-		pcl_viz_control->thread_control_build_pcl.end_code = 0;
-		pcl_viz_control->thread_control_build_pcl.terminate_request = 1;
-
-		int count = 0;
-		while (pcl_viz_control->thread_control_build_pcl.terminate_done == 0) {
-			if (count > 200) {
-				printf("[ERROR]Stop BuildPCLThread! count > 200\n");
-				break;
-			}
-			count++;
-			Sleep(10L);
-		}
-
-		if (pcl_viz_control->thread_control_build_pcl.thread_handle != NULL) {
-			CloseHandle(pcl_viz_control->thread_control_build_pcl.thread_handle);
-			pcl_viz_control->thread_control_build_pcl.thread_handle = NULL;
-		}
-	}
+	// stop draw, then build (the filter thread wakes the draw thread)
+	StopThread(&pcl_viz_control->thread_control_draw);
+	StopBuildThreads(pcl_viz_control);
 
 	pcl_viz_control->pick_information.count = 0;
 	for (int i = 0; i < 4; i++) {
@@ -446,40 +531,70 @@ int StopPclViz()
  */
 int RunPclViz(PclVizInputArgs* input_args, PclVizOutputArgs* output_args)
 {
-	PclDataRingBuffer::BufferData* buffer_data = nullptr;
-	const ULONGLONG time = GetTickCount64();
+	PclFrameTripleBuffer::BufferData* buffer_data = nullptr;
+	const std::uint64_t time = WsGetTickCount();
 
 	PclVizControl* pcl_viz_control = &pcl_viz_control_;
 
+	// the consumers get the frame whether the 3D view is active or not, the ring takes its own reference
+	pcl_viz_control->pcl_frame_broadcast_ring->Put(input_args->frame);
+
 	if (pcl_viz_control->operation_status != OperationStatus::active) {
+		PclFramePool::Release(input_args->frame);
+		input_args->frame = nullptr;
 		return 0;
 	}
 
-	int put_index = pcl_viz_control->pcl_data_ring_buffer->GetPutBuffer(&buffer_data, time);
+	int put_index = pcl_viz_control->pcl_frame_buffer->GetPutBuffer(&buffer_data, time);
 	int image_status = 0;
 
 	if (put_index >= 0 && buffer_data != nullptr) {
 		pcl_viz_control->viz_parameters.base_length		= input_args->base_length;
 		pcl_viz_control->viz_parameters.d_inf			= input_args->d_inf;
 		pcl_viz_control->viz_parameters.bf				= input_args->bf;
+		pcl_viz_control->viz_parameters.angle			= input_args->angle;
 
 		buffer_data->pcl_data.width						= input_args->width;
 		buffer_data->pcl_data.height					= input_args->height;
 		buffer_data->pcl_data.base_image_channel_count	= input_args->base_image_channel_count;
 
-		size_t cp_size = input_args->width * input_args->height * input_args->base_image_channel_count;
-		memcpy(buffer_data->pcl_data.image, input_args->image, cp_size);
+		buffer_data->pcl_data.image_source_depth_heat	= input_args->image_source_depth_heat;
 
-		buffer_data->pcl_data.depth_width	= input_args->width;
-		buffer_data->pcl_data.depth_height	= input_args->height;
+		buffer_data->pcl_data.frame_no					= input_args->frame_no;
+		buffer_data->pcl_data.frame_time				= input_args->frame_time;
 
-		cp_size = input_args->width * input_args->height * sizeof(float);
-		memcpy(buffer_data->pcl_data.disparity_data, input_args->disparity_data, cp_size);
+		// the disparity keeps its own resolution, the builder samples the image at the disparity pixels
+		buffer_data->pcl_data.depth_width	= input_args->depth_width;
+		buffer_data->pcl_data.depth_height	= input_args->depth_height;
+
+		if (input_args->frame != nullptr) {
+			// the images stay in the frame, its reference is moved to the buffer
+			buffer_data->frame = input_args->frame;
+			input_args->frame = nullptr;
+		}
+		else {
+			// only the color source used by the builder is copied
+			size_t cp_size = 0;
+			if (!input_args->image_source_depth_heat) {
+				cp_size = input_args->width * input_args->height * input_args->base_image_channel_count;
+				memcpy(buffer_data->pcl_data.image, input_args->image, cp_size);
+			}
 
-		cp_size = input_args->width * input_args->height * 4;
-		memcpy(buffer_data->pcl_data.disparity_image_bgra, input_args->disparity_image_bgra, cp_size);
+			cp_size = input_args->depth_width * input_args->depth_height * sizeof(float);
+			memcpy(buffer_data->pcl_data.disparity_data, input_args->disparity_data, cp_size);
+
+			if (input_args->image_source_depth_heat) {
+				cp_size = input_args->depth_width * input_args->depth_height * 4;
+				memcpy(buffer_data->pcl_data.disparity_image_bgra, input_args->disparity_image_bgra, cp_size);
+			}
+		}
 
 		// parameter
+		buffer_data->pcl_filter_parameter.enabled_flying_pixel_filter					= input_args->pcl_filter_parameter.enabled_flying_pixel_filter;
+		buffer_data->pcl_filter_parameter.flying_pixel_filter_ratio						= input_args->pcl_filter_parameter.flying_pixel_filter_ratio;
+		buffer_data->pcl_filter_parameter.enabled_temporal_filter						= input_args->pcl_filter_parameter.enabled_temporal_filter;
+		buffer_data->pcl_filter_parameter.temporal_filter_mode							= input_args->pcl_filter_parameter.temporal_filter_mode;
+		buffer_data->pcl_filter_parameter.temporal_filter_alpha							= input_args->pcl_filter_parameter.temporal_filter_alpha;
 		buffer_data->pcl_filter_parameter.enabled_remove_nan							= input_args->pcl_filter_parameter.enabled_remove_nan;
 		buffer_data->pcl_filter_parameter.enabled_pass_through_filter					= input_args->pcl_filter_parameter.enabled_pass_through_filter;
 		buffer_data->pcl_filter_parameter.pass_through_filter_range.min					= input_args->pcl_filter_parameter.pass_through_filter_range.min;
@@ -489,17 +604,39 @@ int RunPclViz(PclVizInputArgs* input_args, PclVizOutputArgs* output_args)
 		buffer_data->pcl_filter_parameter.enabled_radius_outlier_removal				= input_args->pcl_filter_parameter.enabled_radius_outlier_removal;
 		buffer_data->pcl_filter_parameter.radius_outlier_removal_param.radius_search	= input_args->pcl_filter_parameter.radius_outlier_removal_param.radius_search;
 		buffer_data->pcl_filter_parameter.radius_outlier_removal_param.min_neighbors	= input_args->pcl_filter_parameter.radius_outlier_removal_param.min_neighbors;
+		buffer_data->pcl_filter_parameter.radius_outlier_removal_param.exact			= input_args->pcl_filter_parameter.radius_outlier_removal_param.exact;
 		buffer_data->pcl_filter_parameter.enabled_plane_detection						= input_args->pcl_filter_parameter.enabled_plane_detection;
 		buffer_data->pcl_filter_parameter.plane_detection_threshold						= input_args->pcl_filter_parameter.plane_detection_threshold;
+		buffer_data->pcl_filter_parameter.plane_detection_mode							= input_args->pcl_filter_parameter.plane_detection_mode;
+		buffer_data->pcl_filter_parameter.plane_detection_plane_count					= input_args->pcl_filter_parameter.plane_detection_plane_count;
+		buffer_data->pcl_filter_parameter.plane_detection_min_inliers					= input_args->pcl_filter_parameter.plane_detection_min_inliers;
+		buffer_data->pcl_filter_parameter.plane_detection_time_budget					= input_args->pcl_filter_parameter.plane_detection_time_budget;
+		buffer_data->pcl_filter_parameter.enabled_normal_estimation						= input_args->pcl_filter_parameter.enabled_normal_estimation;
+		buffer_data->pcl_filter_parameter.normal_estimation_window						= input_args->pcl_filter_parameter.normal_estimation_window;
+		buffer_data->pcl_filter_parameter.normal_estimation_color						= input_args->pcl_filter_parameter.normal_estimation_color;
+		buffer_data->pcl_filter_parameter.enabled_quality_control						= input_args->pcl_filter_parameter.enabled_quality_control;
+		buffer_data->pcl_filter_parameter.quality_control_budget						= input_args->pcl_filter_parameter.quality_control_budget;
+		buffer_data->pcl_filter_parameter.build_frames_in_flight						= input_args->pcl_filter_parameter.build_frames_in_flight;
+		buffer_data->pcl_filter_parameter.lod_mode										= input_args->pcl_filter_parameter.lod_mode;
+		buffer_data->pcl_filter_parameter.lod_step										= input_args->pcl_filter_parameter.lod_step;
 
 		// OK
 		image_status = 1;
 	}
-	pcl_viz_control->pcl_data_ring_buffer->DonePutBuffer(put_index, image_status);
+	else {
+		PclFramePool::Release(input_args->frame);
+		input_args->frame = nullptr;
+	}
+	pcl_viz_control->pcl_frame_buffer->DonePutBuffer(put_index, image_status);
+
+	if (image_status == 1) {
+		// the build thread sleeps until a frame is put
+		WakeUpThread(&pcl_viz_control->thread_control_build_pcl);
+	}
 
 	// screen control
 	// Immediately Execute
-	EnterCriticalSection(&pcl_viz_control->threads_critical);
+	std::unique_lock<std::mutex> threads_lock(pcl_viz_control->threads_mutex);
 
 	if (input_args->full_screen_request) {
 		pcl_viz_control->viz_parameters.full_screen_request = true;
@@ -510,10 +647,18 @@ int RunPclViz(PclVizInputArgs* input_args, PclVizOutputArgs* output_args)
 		pcl_viz_control->viz_parameters.restore_screen_request = true;
 	}
 
-	LeaveCriticalSection(&pcl_viz_control->threads_critical);
+	// quality control information
+	output_args->quality_information = pcl_viz_control->quality_information;
+
+	// filter stage information
+	for (int i = 0; i < kPCL_FILTER_STAGE_COUNT; i++) {
+		output_args->stage_information[i] = pcl_viz_control->stage_information[i];
+	}
+
+	threads_lock.unlock();
 
 	// mouse pick information
-	EnterCriticalSection(&pcl_viz_control->pick_callback_critical);
+	std::unique_lock<std::mutex> pick_lock(pcl_viz_control->pick_callback_mutex);
 
 	if (pcl_viz_control->pick_information.count > 0) {
 		// it copy last one
@@ -530,21 +675,195 @@ int RunPclViz(PclVizInputArgs* input_args, PclVizOutputArgs* output_args)
 		pcl_viz_control->pick_information.pick_data[index].valid = false;
 	}
 
-	LeaveCriticalSection(&pcl_viz_control->pick_callback_critical);
+	pick_lock.unlock();
 
 	return 0;
 }
 
 /**
- * 視差データより点群(Point Cloud)を作成し、Filter処理を行います.
+ * 入力されたフレームを読み出す Consumer を登録します.
+ *
+ * @param[in] lossless true:全てのフレームを順に読み出します false:最新のフレームのみ読み出します
+ *
+ * @return Consumer の番号. 失敗した場合は -1
+ *
+ * @details 3D表示とは別に、記録や配信などでフレームをコピーせずに使用します.
+ *  lossless の Consumer が遅れた場合は、3D表示や他の Consumer を待たせずにその Consumer の最も古いフレームを破棄します
+ */
+int AddPclVizFrameConsumer(const bool lossless)
+{
+	PclVizControl* pcl_viz_control = &pcl_viz_control_;
+
+	const PclFrameBroadcastRing::Policy policy = lossless ? PclFrameBroadcastRing::Policy::kLossless : PclFrameBroadcastRing::Policy::kLatestOnly;
+
+	return pcl_viz_control->pcl_frame_broadcast_ring->AddConsumer(policy);
+}
+
+/**
+ * Consumer の登録を解除します.
+ *
+ * @param[in] consumer_id Consumer の番号
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details GetPclVizFrame で待機している場合は、待機を終了します
+ */
+int RemovePclVizFrameConsumer(const int consumer_id)
+{
+	PclVizControl* pcl_viz_control = &pcl_viz_control_;
+
+	return pcl_viz_control->pcl_frame_broadcast_ring->RemoveConsumer(consumer_id);
+}
+
+/**
+ * Consumer の次のフレームを取得します.
+ *
+ * @param[in] consumer_id Consumer の番号
+ * @param[in] timeout 最大の待ち時間(ms) 0:待たない 負の値:無制限
+ * @param[out] frame フレーム. 使用後に PclFramePool::Release で解放します
+ *
+ * @retval 0 成功
+ * @retval -1 フレームが無い、または登録が解除されました
+ */
+int GetPclVizFrame(const int consumer_id, const int timeout, PclFrame** frame)
+{
+	PclVizControl* pcl_viz_control = &pcl_viz_control_;
+
+	return pcl_viz_control->pcl_frame_broadcast_ring->Get(consumer_id, timeout, frame);
+}
+
+/**
+ * Threadを開始します.
+ *
+ * @param[inout] thread_control Threadの制御
+ * @param[in] thread_function Threadの関数
+ * @param[in] context Threadの関数に渡すデータ
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int StartThread(PclVizControl::ThreadControl* thread_control, unsigned (*thread_function)(void*), void* context)
+{
+	if (thread_control->thread.joinable()) {
+		return -1;
+	}
+
+	thread_control->terminate_request = false;
+	{
+		std::lock_guard<std::mutex> lock(thread_control->wake_mutex);
+		thread_control->wake_request = false;
+	}
+
+	try {
+		thread_control->thread = std::thread(thread_function, context);
+	}
+	catch (const std::system_error& e) {
+		printf("[ERROR]StartThread failed, %s\n", e.what());
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Threadを停止し、終了を待ちます.
+ *
+ * @param[inout] thread_control Threadの制御
+ *
+ * @details 待機中の Thread も起こすため、ポーリングせずに終了を待つことができます
+ */
+void StopThread(PclVizControl::ThreadControl* thread_control)
+{
+	if (!thread_control->thread.joinable()) {
+		return;
+	}
+
+	thread_control->terminate_request = true;
+	WakeUpThread(thread_control);
+
+	thread_control->thread.join();
+
+	return;
+}
+
+/**
+ * 点群を作成するThreadを停止します.
+ *
+ * @param[inout] pcl_viz_control 表示データ授受用の構造体
+ *
+ * @details スロットを待機している Thread を起こすため、停止を要求してから Queue を閉じます
+ */
+void StopBuildThreads(PclVizControl* pcl_viz_control)
+{
+	pcl_viz_control->thread_control_build_pcl.terminate_request = true;
+	pcl_viz_control->thread_control_filter_pcl.terminate_request = true;
+
+	pcl_viz_control->free_slot_queue->Close();
+	pcl_viz_control->built_slot_queue->Close();
+
+	StopThread(&pcl_viz_control->thread_control_filter_pcl);
+	StopThread(&pcl_viz_control->thread_control_build_pcl);
+
+	return;
+}
+
+/**
+ * 待機中のThreadを起こします.
+ *
+ * @param[inout] thread_control Threadの制御
+ *
+ * @details Thread が待機していない場合は、次の WaitWakeUp がすぐに戻ります
+ */
+void WakeUpThread(PclVizControl::ThreadControl* thread_control)
+{
+	{
+		std::lock_guard<std::mutex> lock(thread_control->wake_mutex);
+		thread_control->wake_request = true;
+	}
+	thread_control->wake_condition.notify_one();
+
+	return;
+}
+
+/**
+ * WakeUpThread まで待機します.
+ *
+ * @param[inout] thread_control Threadの制御
+ * @param[in] timeout 最大の待ち時間(ms) 負の値は無制限
+ *
+ * @retval true 起こされました
+ * @retval false タイムアウト
+ */
+bool WaitWakeUp(PclVizControl::ThreadControl* thread_control, const int timeout)
+{
+	std::unique_lock<std::mutex> lock(thread_control->wake_mutex);
+
+	if (timeout < 0) {
+		thread_control->wake_condition.wait(lock, [thread_control] { return thread_control->wake_request; });
+	}
+	else {
+		if (!thread_control->wake_condition.wait_for(lock, std::chrono::milliseconds(timeout), [thread_control] { return thread_control->wake_request; })) {
+			return false;
+		}
+	}
+	thread_control->wake_request = false;
+
+	return true;
+}
+
+/**
+ * 視差データより点群(Point Cloud)を作成します. 投影の段です
  *
  * @param[inout] context (pcl_viz_control)表示データ授受用の構造体
  *
  * @retval 0 成功
  * @retval other 失敗
  *
+ * @details 点群はスロットに作成して FilterPCLThread に渡し、Filter処理を待たずに次のフレームに進みます.
+ *  スロットは FilterPCLThread から作成した順に戻るため、フレームの順序は変わりません
  */
-unsigned __stdcall BuildPCLThread(void* context)
+unsigned BuildPCLThread(void* context)
 {
 	// build point cloud thread
 	PclVizControl* pcl_viz_control = (PclVizControl*)context;
@@ -553,203 +872,619 @@ unsigned __stdcall BuildPCLThread(void* context)
 		return -1;
 	}
 
-	while (pcl_viz_control->thread_control_build_pcl.terminate_request < 1) {
+	// slots given to the filter thread, and the slot for the next frame
+	int slot_count = 0;
+	int frames_in_flight = 1;
+	int slot_index = -1;
+
+	// the last build, a repeated frame (paused playback) with the same parameters is not built again
+	bool has_last_build = false;
+	unsigned long long last_build_key = 0;
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr last_cloud;
+	const std::vector<int>* last_pixel_index = nullptr;
+	PclPointCloudBuilder::PixelGrid last_pixel_grid = {};
+
+	// the frame last given to the temporal filter, the state is updated once for each frame
+	bool has_temporal_frame = false;
+	unsigned long long temporal_frame_key = 0;
+
+	while (!pcl_viz_control->thread_control_build_pcl.terminate_request) {
 
 		for (;;) {
-			if (pcl_viz_control->thread_control_build_pcl.stop_request) {
-				pcl_viz_control->thread_control_build_pcl.stop_request = false;
+			if (pcl_viz_control->thread_control_build_pcl.terminate_request) {
 				break;
 			}
 
+			// the slot is taken before the frame, the latest frame is built when the filter thread is behind
+			if (slot_index < 0) {
+				if (frames_in_flight != slot_count) {
+					// all slots are taken back, then the slots are given again
+					while (slot_count > 0 && pcl_viz_control->free_slot_queue->Pop(&slot_index) == 0) {
+						slot_count--;
+					}
+					if (slot_count > 0) {
+						// closed
+						slot_index = -1;
+						break;
+					}
+					for (; slot_count < frames_in_flight; slot_count++) {
+						pcl_viz_control->free_slot_queue->Push(slot_count);
+					}
+				}
+
+				if (pcl_viz_control->free_slot_queue->Pop(&slot_index) != 0) {
+					// closed
+					slot_index = -1;
+					break;
+				}
+			}
+
 			// get data
-			PclDataRingBuffer::BufferData* buffer_data = nullptr;
-			ULONGLONG time = 0;
-			int get_index = pcl_viz_control->pcl_data_ring_buffer->GetGetBuffer(&buffer_data, &time);
+			PclFrameTripleBuffer::BufferData* buffer_data = nullptr;
+			std::uint64_t time = 0;
+			int get_index = pcl_viz_control->pcl_frame_buffer->GetGetBuffer(&buffer_data, &time);
 
 			if (get_index >= 0) {
+				// the time of the frame is measured for the quality control
+				const auto frame_start = std::chrono::steady_clock::now();
+
 				// build pcl data
-				// build point cloud
-				double display_scale = 1.0;
+				// The ring buffer data is used as it is.
+				// The images are in the frame of the pool when it is given, they were not copied.
+				const PclDataRingBuffer::PclData* pcl_data = (buffer_data->frame != nullptr) ? &buffer_data->frame->pcl_data : &buffer_data->pcl_data;
+				// The 180 degree rotation and the mono to RGB expansion are done by the builder.
 
 				// Base Image
-				cv::Mat mat_data_proc_image_scale_flip;
+				cv::Mat mat_base_image;
 				{
-					const int width						= buffer_data->pcl_data.width;
-					const int height					= buffer_data->pcl_data.height;
-					const int base_image_channel_count	= buffer_data->pcl_data.base_image_channel_count;
-					unsigned char* image				= buffer_data->pcl_data.image;
+					const int width						= pcl_data->width;
+					const int height					= pcl_data->height;
+					const int base_image_channel_count	= pcl_data->base_image_channel_count;
+					unsigned char* image				= pcl_data->image;
 
 					if (base_image_channel_count == 3) {
 						// color image
-						cv::Mat mat_base_image(height, width, CV_8UC3, image);
-
-						double ratio = 1.0 / (double)display_scale;
-						cv::Mat mat_base_image_scale;
-						cv::resize(mat_base_image, mat_base_image_scale, cv::Size(), ratio, ratio, cv::INTER_NEAREST);
-						cv::flip(mat_base_image_scale, mat_data_proc_image_scale_flip, -1);
+						mat_base_image = cv::Mat(height, width, CV_8UC3, image);
 					}
 					else if (base_image_channel_count == 4) {
 						// color image
-						cv::Mat mat_base_image(height, width, CV_8UC4, image);
-
-						double ratio = 1.0 / (double)display_scale;
-						cv::Mat mat_base_image_scale;
-						cv::resize(mat_base_image, mat_base_image_scale, cv::Size(), ratio, ratio, cv::INTER_NEAREST);
-						cv::flip(mat_base_image_scale, mat_data_proc_image_scale_flip, -1);
+						mat_base_image = cv::Mat(height, width, CV_8UC4, image);
 					}
 					else {
 						// base image
-						cv::Mat mat_base_image(height, width, CV_8U, image);
-
-						double ratio = 1.0 / (double)display_scale;
-						cv::Mat mat_base_image_scale;
-						cv::resize(mat_base_image, mat_base_image_scale, cv::Size(), ratio, ratio, cv::INTER_NEAREST);
-
-						cv::Mat mat_base_image_scale_flip_temp;
-						cv::flip(mat_base_image_scale, mat_base_image_scale_flip_temp, -1);
-
-						cv::Mat mat_base_image_color;
-						cv::cvtColor(mat_base_image_scale_flip_temp, mat_data_proc_image_scale_flip, cv::COLOR_GRAY2RGB);
+						mat_base_image = cv::Mat(height, width, CV_8U, image);
 					}
-
-					//cv::imshow("Base Image", mat_data_proc_image_scale_flip);
 				}
 
 				// depth
-				cv::Mat mat_depth_scale_flip;
+				cv::Mat mat_depth;
 				{
-					const int depth_width	= buffer_data->pcl_data.depth_width;
-					const int depth_height	= buffer_data->pcl_data.depth_height;
-					float* depth			= buffer_data->pcl_data.disparity_data;
+					const int depth_width	= pcl_data->depth_width;
+					const int depth_height	= pcl_data->depth_height;
+					float* depth			= pcl_data->disparity_data;
 
-					cv::Mat mat_depth(depth_height, depth_width, CV_32F, depth);
+					mat_depth = cv::Mat(depth_height, depth_width, CV_32F, depth);
+				}
 
-					double ratio = 1.0 / (double)display_scale;
-					cv::Mat mat_depth_scale;
-					cv::resize(mat_depth, mat_depth_scale, cv::Size(), ratio, ratio, cv::INTER_NEAREST);
+				// heat map
+				cv::Mat mat_heat_image;
+				const bool image_source_depth_heat = pcl_data->image_source_depth_heat;
+				if (image_source_depth_heat) {
+					const int depth_width	= pcl_data->depth_width;
+					const int depth_height	= pcl_data->depth_height;
 
-					cv::flip(mat_depth_scale, mat_depth_scale_flip, -1);
+					mat_heat_image = cv::Mat(depth_height, depth_width, CV_8UC4, pcl_data->disparity_image_bgra);
 				}
 
-				// CloudViewer に与える PointCloud 
-				//pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
-
 				// parameters
 				VizParameters* viz_parameters = &pcl_viz_control->viz_parameters;
 
 				// draw PCL
 				{
-					if (mat_data_proc_image_scale_flip.empty()) {
-						return 0;
+					if (mat_base_image.empty() || mat_depth.empty()) {
+						// nothing to build, the buffer and the slot are given back for the next frame
+						pcl_viz_control->pcl_frame_buffer->DoneGetBuffer(get_index);
+						if (pcl_viz_control->free_slot_queue->Push(slot_index) != 0) {
+							break;
+						}
+						slot_index = -1;
+						continue;
 					}
 
-					if (mat_depth_scale_flip.empty()) {
-						return 0;
+					// the frame is built into the slot, it is owned by this frame until the filter thread gives it back
+					PclVizControl::BuildSlot* build_slot = &pcl_viz_control->build_slots[slot_index];
+					if (build_slot->pcl_point_cloud_builder == nullptr) {
+						// the builder keeps the pixel index and the pixel grid of the frame, the clouds are shared by the slots
+						build_slot->pcl_point_cloud_builder = new PclPointCloudBuilder;
+						build_slot->pcl_point_cloud_builder->Initialize(viz_parameters->width, viz_parameters->height);
+						build_slot->pcl_point_cloud_builder->SetCloudBufferPool(pcl_viz_control->build_cloud_pool);
 					}
 
-					// CloudViewer に与える PointCloud 
-					pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
-					//NaNを含む可能性があるならfalseにする。基本はfalseでよい
-					cloud->is_dense = false;
-
-					const int width = mat_data_proc_image_scale_flip.cols;
-					const int height = mat_data_proc_image_scale_flip.rows;
-
-					BuildPointCloud(
-						width,
-						height,
-						viz_parameters->d_inf,
-						viz_parameters->base_length,
-						viz_parameters->bf,
-						viz_parameters->min_distance,
-						viz_parameters->max_distance,
-						mat_data_proc_image_scale_flip,
-						mat_depth_scale_flip,
-						cloud);
-
 					// filter
-					PclFilterParameter* pcl_filter_parameter = &buffer_data->pcl_filter_parameter;
+					PclFilterParameter* pcl_filter_parameter = &build_slot->pcl_filter_parameter;
+					*pcl_filter_parameter = buffer_data->pcl_filter_parameter;
+
+					// from the next frame
+					frames_in_flight = (std::max)(1, (std::min)(pcl_filter_parameter->build_frames_in_flight, kBUILD_SLOT_COUNT_MAX));
+
+					// the quality control lowers the parameters of the GUI when the build exceeds the budget
+					// it is updated by the filter thread
+					PclQualityController* quality_controller = pcl_viz_control->pcl_quality_controller;
+					{
+						std::lock_guard<std::mutex> threads_lock(pcl_viz_control->threads_mutex);
+						if (pcl_filter_parameter->enabled_quality_control) {
+							quality_controller->Apply(pcl_filter_parameter);
+						}
+						else {
+							quality_controller->Reset();
+						}
+					}
 
 					bool remove_nan				= pcl_filter_parameter->enabled_remove_nan;
-					bool path_through_filter	= pcl_filter_parameter->enabled_pass_through_filter;
-					bool down_sampling			= pcl_filter_parameter->enabled_down_sampling;
 					bool radius_outlier_removal	= pcl_filter_parameter->enabled_radius_outlier_removal;
-					bool plane_detection		= pcl_filter_parameter->enabled_plane_detection;
+					bool radius_outlier_exact	= pcl_filter_parameter->radius_outlier_removal_param.exact;
+					bool normal_estimation		= pcl_filter_parameter->enabled_normal_estimation;
+
+					PclPointCloudBuilder::BuildParameter build_parameter = {};
+					build_parameter.width					= mat_depth.cols;
+					build_parameter.height					= mat_depth.rows;
+					build_parameter.d_inf					= viz_parameters->d_inf;
+					build_parameter.base_length				= viz_parameters->base_length;
+					build_parameter.bf						= viz_parameters->bf;
+					build_parameter.angle					= viz_parameters->angle;
+					build_parameter.min_distance			= viz_parameters->min_distance;
+					build_parameter.max_distance			= viz_parameters->max_distance;
+					build_parameter.image_source_depth_heat	= image_source_depth_heat;
+					build_parameter.color_sampling			= PclPointCloudBuilder::ColorSampling::kBilinear;
+
+					// level of detail, decimated in the builder before projection
+					switch (pcl_filter_parameter->lod_mode) {
+					case 1:
+						build_parameter.lod_mode = PclPointCloudBuilder::LodMode::kStride;
+						break;
+					case 2:
+						build_parameter.lod_mode = PclPointCloudBuilder::LodMode::kBlockAverage;
+						break;
+					case 3:
+						build_parameter.lod_mode = PclPointCloudBuilder::LodMode::kBlockMinDisparity;
+						break;
+					default:
+						build_parameter.lod_mode = PclPointCloudBuilder::LodMode::kOff;
+						break;
+					}
+					build_parameter.lod_step = pcl_filter_parameter->lod_step;
+
+					// coordinate frame, the points are projected directly into it
+					// picking, pcd export and the overlays use the cloud as is, so they are in the same frame
+					switch (viz_parameters->output_frame) {
+					case 1:
+						build_parameter.output_frame = PclPointCloudBuilder::OutputFrame::kRos;
+						break;
+					case 2:
+						build_parameter.output_frame = PclPointCloudBuilder::OutputFrame::kUnity;
+						break;
+					case 3:
+						build_parameter.output_frame = PclPointCloudBuilder::OutputFrame::kExtrinsic;
+						break;
+					default:
+						build_parameter.output_frame = PclPointCloudBuilder::OutputFrame::kCamera;
+						break;
+					}
+					for (int i = 0; i < 16; i++) {
+						build_parameter.extrinsic[i] = viz_parameters->extrinsic[i];
+					}
 
-					if (remove_nan) {
-						// The mapping tells you to what points of the old cloud the new ones correspond,
-						// but we will not use it.
-						// このmappingにより元のクラウドのどのポイントが新しいクラウドのどこに写像されたかわかるが、
-						// これは使わない
+					if (pcl_filter_parameter->enabled_pass_through_filter) {
+						// The pass through filter is done by the builder in the disparity domain, there is no filter stage for it.
+						// The range is the distance (camera frame z) for every output frame, not the z of the output frame.
+						// The culled points are dropped by the dense build together with NaN,
+						// it gives the same points as pcl::PassThrough("z") in the camera frame, which also drops NaN.
+						build_parameter.pass_through		= true;
+						build_parameter.pass_through_min	= pcl_filter_parameter->pass_through_filter_range.min;
+						build_parameter.pass_through_max	= pcl_filter_parameter->pass_through_filter_range.max;
 
-						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp_filtered_cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+						remove_nan = true;
+					}
 
-						std::vector<int> mapping;
-						pcl::removeNaNFromPointCloud(*cloud, *temp_filtered_cloud, mapping);
+					if (radius_outlier_removal && !radius_outlier_exact) {
+						// The radius outlier removal on the pixel grid needs the point to pixel mapping of the dense build.
+						// NaN points are removed by it as well, so the result is the same.
+						remove_nan = true;
+					}
+
+					if (normal_estimation) {
+						// The normal estimation finds the neighbors on the pixel grid as well.
+						remove_nan = true;
+					}
 
-						cloud = std::move(temp_filtered_cloud);
+					if (remove_nan) {
+						// The builder emits the valid points only, in the same order as removeNaNFromPointCloud.
+						// The point to pixel mapping is kept by the builder (GetPixelIndex).
+						build_parameter.dense = true;
+					}
+
+					// the keys of the cache of the filter thread
+					// frame, the images are the same for the same frame
+					unsigned long long stage_key = 0xCBF29CE484222325ULL;
+					stage_key = HashValue(stage_key, pcl_data->frame_no);
+					stage_key = HashValue(stage_key, pcl_data->frame_time);
+					stage_key = HashValue(stage_key, mat_base_image.cols);
+					stage_key = HashValue(stage_key, mat_base_image.rows);
+					stage_key = HashValue(stage_key, pcl_data->base_image_channel_count);
+					stage_key = HashValue(stage_key, image_source_depth_heat);
+					if (image_source_depth_heat) {
+						// the heat map is colored with the range of the pass through filter
+						stage_key = HashValue(stage_key, pcl_filter_parameter->pass_through_filter_range.min);
+						stage_key = HashValue(stage_key, pcl_filter_parameter->pass_through_filter_range.max);
+					}
+					build_slot->frame_key = stage_key;
+
+					// build
+					stage_key = HashValue(stage_key, build_parameter.width);
+					stage_key = HashValue(stage_key, build_parameter.height);
+					stage_key = HashValue(stage_key, build_parameter.d_inf);
+					stage_key = HashValue(stage_key, build_parameter.base_length);
+					stage_key = HashValue(stage_key, build_parameter.bf);
+					stage_key = HashValue(stage_key, build_parameter.angle);
+					stage_key = HashValue(stage_key, build_parameter.min_distance);
+					stage_key = HashValue(stage_key, build_parameter.max_distance);
+					stage_key = HashValue(stage_key, build_parameter.pass_through);
+					stage_key = HashValue(stage_key, build_parameter.pass_through_min);
+					stage_key = HashValue(stage_key, build_parameter.pass_through_max);
+					stage_key = HashValue(stage_key, build_parameter.color_sampling);
+					stage_key = HashValue(stage_key, build_parameter.dense);
+					stage_key = HashValue(stage_key, build_parameter.output_frame);
+					stage_key = PclFilterPipeline::Hash(stage_key, build_parameter.extrinsic, sizeof(build_parameter.extrinsic));
+					stage_key = HashValue(stage_key, build_parameter.lod_mode);
+					stage_key = HashValue(stage_key, build_parameter.lod_step);
+					stage_key = HashValue(stage_key, pcl_filter_parameter->enabled_flying_pixel_filter);
+					stage_key = HashValue(stage_key, pcl_filter_parameter->flying_pixel_filter_ratio);
+					stage_key = HashValue(stage_key, pcl_filter_parameter->enabled_temporal_filter);
+					stage_key = HashValue(stage_key, pcl_filter_parameter->temporal_filter_mode);
+					stage_key = HashValue(stage_key, pcl_filter_parameter->temporal_filter_alpha);
+					build_slot->build_key = stage_key;
+
+					PclTemporalFilter* temporal_filter = pcl_viz_control->pcl_temporal_filter;
+					if (!pcl_filter_parameter->enabled_temporal_filter) {
+						// the state is not continuous when it is enabled again
+						temporal_filter->Reset();
+						has_temporal_frame = false;
 					}
 
-					if (path_through_filter) {
-						const double min_length = pcl_filter_parameter->pass_through_filter_range.min;	
-						const double max_length = pcl_filter_parameter->pass_through_filter_range.max;	
+					if (has_last_build && build_slot->build_key == last_build_key) {
+						// the same frame with the same build parameters (paused playback)
+						// the cloud of the previous frame is given again, the filter thread does not modify it
+						build_slot->repeated = true;
+						build_slot->cloud = last_cloud;
+						if (last_pixel_index != &build_slot->repeated_pixel_index) {
+							build_slot->repeated_pixel_index = *last_pixel_index;
+						}
+						build_slot->pixel_index = &build_slot->repeated_pixel_index;
+						build_slot->pixel_grid = last_pixel_grid;
+					}
+					else {
+						// the builder of the last frame may write its buffer again
+						has_last_build = false;
+						last_cloud.reset();
+
+						// flying pixels are removed on the full resolution disparity, before the level of detail and the projection
+						cv::Mat* depth_data = &mat_depth;
+						if (pcl_filter_parameter->enabled_flying_pixel_filter) {
+							PclFlyingPixelFilter* flying_pixel_filter = pcl_viz_control->pcl_flying_pixel_filter;
+							if (flying_pixel_filter->Filter((float)viz_parameters->d_inf, pcl_filter_parameter->flying_pixel_filter_ratio, mat_depth) == 0) {
+								depth_data = &flying_pixel_filter->GetFilteredData();
+							}
+						}
 
-						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp_filtered_cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+						// temporal smoothing, the state of each pixel is kept by the filter
+						// the output includes the current frame, no frame of latency is added
+						// a frame is added to the state once, the build parameters of a repeated frame change the projection only
+						if (pcl_filter_parameter->enabled_temporal_filter) {
+							unsigned long long temporal_key = build_slot->frame_key;
+							temporal_key = HashValue(temporal_key, pcl_filter_parameter->enabled_flying_pixel_filter);
+							temporal_key = HashValue(temporal_key, pcl_filter_parameter->flying_pixel_filter_ratio);
+							temporal_key = HashValue(temporal_key, pcl_filter_parameter->temporal_filter_mode);
+							temporal_key = HashValue(temporal_key, pcl_filter_parameter->temporal_filter_alpha);
+							if (has_temporal_frame && temporal_frame_key == temporal_key) {
+								depth_data = &temporal_filter->GetFilteredData();
+							}
+							else {
+								const PclTemporalFilter::Mode temporal_mode = (pcl_filter_parameter->temporal_filter_mode == 1) ? PclTemporalFilter::Mode::kMedian : PclTemporalFilter::Mode::kExponentialAverage;
+								if (temporal_filter->Filter(temporal_mode, pcl_filter_parameter->temporal_filter_alpha, (float)viz_parameters->d_inf, *depth_data) == 0) {
+									depth_data = &temporal_filter->GetFilteredData();
+									has_temporal_frame = true;
+									temporal_frame_key = temporal_key;
+								}
+							}
+						}
 
-						int ret = PathThroughFilter("z", min_length, max_length, cloud, temp_filtered_cloud);
-						//int ret = PathThroughFilter("y", min_length, max_length, cloud, temp_filtered_cloud);
-						//int ret = PathThroughFilter("x", min_length, max_length, cloud, temp_filtered_cloud);
+						// the cloud is in the buffer of the builder of the slot, the filter thread reads the pixel of each point from it
+						int build_ret = build_slot->pcl_point_cloud_builder->Build(build_parameter, mat_base_image, mat_heat_image, *depth_data, &build_slot->cloud);
+						if (build_ret != 0) {
+							// the slot is used for the next frame
+							pcl_viz_control->pcl_frame_buffer->DoneGetBuffer(get_index);
+							continue;
+						}
 
-						cloud = std::move(temp_filtered_cloud);
+						build_slot->repeated = false;
+						build_slot->pixel_index = &build_slot->pcl_point_cloud_builder->GetPixelIndex();
+						build_slot->pixel_grid = build_slot->pcl_point_cloud_builder->GetPixelGrid();
 					}
 
-					if (down_sampling) {
-						const double boxel_size = pcl_filter_parameter->down_sampling_boxel_size;	//0.1;// 0.01f;
+					has_last_build = true;
+					last_build_key = build_slot->build_key;
+					last_cloud = build_slot->cloud;
+					last_pixel_index = build_slot->pixel_index;
+					last_pixel_grid = build_slot->pixel_grid;
+
+					build_slot->build_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+				}
 
-						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp_filtered_cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+				// done, the images are not used after the projection
+				pcl_viz_control->pcl_frame_buffer->DoneGetBuffer(get_index);
 
-						int ret = DownSampling(boxel_size, cloud, temp_filtered_cloud);
+				// to the filter thread, the queue keeps the order of the frames
+				if (pcl_viz_control->built_slot_queue->Push(slot_index) != 0) {
+					break;
+				}
+				slot_index = -1;
+			}
+			else {
+				// sleeps until RunPclViz puts a frame, StopThread wakes it as well
+				WaitWakeUp(&pcl_viz_control->thread_control_build_pcl, -1);
+			}
+		}// for (;;) {
 
-						cloud = std::move(temp_filtered_cloud);
-					}
+	}// while (!thread_control_build_pcl.terminate_request) {
+
+	return 0;
+}
+
+/**
+ * 作成された点群の Filter処理を行い、表示Threadに渡します. Filter と出力の段です
+ *
+ * @param[inout] context (pcl_viz_control)表示データ授受用の構造体
+ *
+ * @retval 0 成功
+ * @retval other 失敗
+ *
+ * @details スロットを BuildPCLThread が作成した順に処理し、処理後に BuildPCLThread に戻します
+ */
+unsigned FilterPCLThread(void* context)
+{
+	// filter point cloud thread
+	PclVizControl* pcl_viz_control = (PclVizControl*)context;
+
+	if (pcl_viz_control == nullptr) {
+		return -1;
+	}
+
+	while (!pcl_viz_control->thread_control_filter_pcl.terminate_request) {
+
+		// sleeps until the build thread gives a slot, the queue is closed to stop the thread
+		int slot_index = -1;
+		if (pcl_viz_control->built_slot_queue->Pop(&slot_index) != 0) {
+			break;
+		}
+
+		const auto filter_start = std::chrono::steady_clock::now();
+
+		PclVizControl::BuildSlot* build_slot = &pcl_viz_control->build_slots[slot_index];
+		const PclPointCloudBuilder::PixelGrid& pixel_grid = build_slot->pixel_grid;
+
+		// CloudViewer に与える PointCloud 
+		pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+
+		// filter, the parameters of the frame after the quality control
+		const PclFilterParameter* pcl_filter_parameter = &build_slot->pcl_filter_parameter;
+
+		bool down_sampling			= pcl_filter_parameter->enabled_down_sampling;
+		bool radius_outlier_removal	= pcl_filter_parameter->enabled_radius_outlier_removal;
+		bool radius_outlier_exact	= pcl_filter_parameter->radius_outlier_removal_param.exact;
+		bool plane_detection		= pcl_filter_parameter->enabled_plane_detection;
+		bool normal_estimation		= pcl_filter_parameter->enabled_normal_estimation;
+
+		// the stages write into the buffers of the pipeline, no point cloud is allocated for each frame
+		// while the same frame is given (paused playback), the stages before a changed parameter are taken from the cache
+		PclFilterPipeline* filter_pipeline = pcl_viz_control->pcl_filter_pipeline;
+
+		filter_pipeline->Start(build_slot->frame_key);
+
+		unsigned long long stage_key = build_slot->build_key;
+
+		if (!filter_pipeline->Restore(PclFilterPipeline::Stage::kBuild, stage_key)) {
+			filter_pipeline->BeginInPlaceStage(PclFilterPipeline::Stage::kBuild, stage_key);
+
+			// pixel of each point in the filter chain
+			// the cloud of a repeated frame is shared with the previous one, it is copied before it is modified
+			filter_pipeline->SetCloud(build_slot->cloud, build_slot->repeated);
+			filter_pipeline->SetPixelIndex(build_slot->pixel_index);
+
+			filter_pipeline->EndStage();
+		}
 
-					if (radius_outlier_removal) {
-						const double radius_search			= pcl_filter_parameter->radius_outlier_removal_param.radius_search;			// 0.01;// 0.15;
-						const int min_neighbors_in_radius	= pcl_filter_parameter->radius_outlier_removal_param.min_neighbors;	// 100;
+		if (down_sampling) {
+			const double boxel_size = pcl_filter_parameter->down_sampling_boxel_size;	//0.1;// 0.01f;
+			const bool need_pixel_index = (radius_outlier_removal && !radius_outlier_exact) || normal_estimation;
 
-						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp_filtered_cloud(new pcl::PointCloud<pcl::PointXYZRGBA>);
+			stage_key = HashValue(stage_key, boxel_size);
+			stage_key = HashValue(stage_key, need_pixel_index);
 
-						int ret = RadiusOutlierRemoval(radius_search, min_neighbors_in_radius, cloud, temp_filtered_cloud);
+			if (!filter_pipeline->Restore(PclFilterPipeline::Stage::kDownSampling, stage_key)) {
+				const std::vector<int>* pixel_index = filter_pipeline->GetPixelIndex();
 
-						cloud = std::move(temp_filtered_cloud);
+				pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp_filtered_cloud = filter_pipeline->BeginStage(PclFilterPipeline::Stage::kDownSampling, stage_key);
+
+				int ret = DownSampling(pcl_viz_control->pcl_voxel_grid_filter, boxel_size, filter_pipeline->GetCloud(), temp_filtered_cloud);
+
+				if (ret != 0) {
+					// the output buffer is not valid, the input is passed on as it is
+					filter_pipeline->CancelStage();
+				}
+				else {
+					if (need_pixel_index && pixel_index != nullptr) {
+						// each voxel is on the pixel of its first point
+						const std::vector<int>& source_index = pcl_viz_control->pcl_voxel_grid_filter->GetSourceIndex();
+						const size_t point_count = source_index.size();
+						pcl_viz_control->pixel_index.resize(point_count);
+						for (size_t i = 0; i < point_count; i++) {
+							pcl_viz_control->pixel_index[i] = (*pixel_index)[source_index[i]];
+						}
+						filter_pipeline->SetPixelIndex(&pcl_viz_control->pixel_index);
+					}
+					else {
+						filter_pipeline->SetPixelIndex(nullptr);
 					}
 
-					if (plane_detection) {
-						double threshold = pcl_filter_parameter->plane_detection_threshold;	//  0.2;
-						int ret = PlaneDetection(threshold, cloud);
+					filter_pipeline->EndStage();
+				}
+			}
+		}
+
+		if (radius_outlier_removal) {
+			const double radius_search			= pcl_filter_parameter->radius_outlier_removal_param.radius_search;			// 0.01;// 0.15;
+			const int min_neighbors_in_radius	= pcl_filter_parameter->radius_outlier_removal_param.min_neighbors;	// 100;
+
+			stage_key = HashValue(stage_key, radius_search);
+			stage_key = HashValue(stage_key, min_neighbors_in_radius);
+			stage_key = HashValue(stage_key, radius_outlier_exact);
+
+			if (!filter_pipeline->Restore(PclFilterPipeline::Stage::kRadiusOutlierRemoval, stage_key)) {
+				const std::vector<int>* pixel_index = filter_pipeline->GetPixelIndex();
+
+				pcl::PointCloud<pcl::PointXYZRGBA>::Ptr temp_filtered_cloud = filter_pipeline->BeginStage(PclFilterPipeline::Stage::kRadiusOutlierRemoval, stage_key);
+
+				int ret = 0;
+				const bool exact = radius_outlier_exact || pixel_index == nullptr;
+				// the normal estimation after it needs the pixels of the remaining points
+				const bool keep_pixel_index = exact && normal_estimation && pixel_index != nullptr;
+				if (exact) {
+					ret = RadiusOutlierRemoval(radius_search, min_neighbors_in_radius, filter_pipeline->GetCloud(), temp_filtered_cloud, keep_pixel_index ? &pcl_viz_control->outlier_kept_index : nullptr);
+				}
+				else {
+					ret = RadiusOutlierRemoval(pcl_viz_control->pcl_radius_outlier_filter, radius_search, min_neighbors_in_radius, pixel_grid, *pixel_index, filter_pipeline->GetCloud(), temp_filtered_cloud);
+				}
+
+				if (ret != 0) {
+					// the output buffer is not valid, the input and its pixels are passed on as they are
+					filter_pipeline->CancelStage();
+				}
+				else {
+					if (keep_pixel_index) {
+						const std::vector<int>& kept_index = pcl_viz_control->outlier_kept_index;
+						const size_t point_count = kept_index.size();
+						pcl_viz_control->outlier_pixel_index.resize(point_count);
+						for (size_t i = 0; i < point_count; i++) {
+							pcl_viz_control->outlier_pixel_index[i] = (*pixel_index)[kept_index[i]];
+						}
+						filter_pipeline->SetPixelIndex(&pcl_viz_control->outlier_pixel_index);
+					}
+					else if (exact) {
+						// the points are removed, the pixels are not known after this stage
+						filter_pipeline->SetPixelIndex(nullptr);
+					}
+					else {
+						// the filter keeps the pixels of the remaining points
+						filter_pipeline->SetPixelIndex(&pcl_viz_control->pcl_radius_outlier_filter->GetPixelIndex());
 					}
 
-					// set draw data
-					PclVizControl* pcl_viz_control = &pcl_viz_control_;
+					filter_pipeline->EndStage();
+				}
+			}
+		}
 
-					EnterCriticalSection(&pcl_viz_control->threads_critical);
-					pcl_viz_control->cloud = cloud;
-					ReleaseSemaphore(pcl_viz_control->handle_semaphore_pcl_draw, 1, NULL);
+		// the neighbors are found on the pixel grid, the stages before it keep the pixels of the points (the stage is not run without them)
+		if (normal_estimation && filter_pipeline->GetPixelIndex() != nullptr) {
+			const int window_size		= pcl_filter_parameter->normal_estimation_window;
+			const bool color_by_normal	= pcl_filter_parameter->normal_estimation_color;
 
-					LeaveCriticalSection(&pcl_viz_control->threads_critical);
+			stage_key = HashValue(stage_key, window_size);
+			stage_key = HashValue(stage_key, color_by_normal);
+
+			if (!filter_pipeline->Restore(PclFilterPipeline::Stage::kNormalEstimation, stage_key)) {
+				// the points are colored in place
+				filter_pipeline->BeginInPlaceStage(PclFilterPipeline::Stage::kNormalEstimation, stage_key);
+
+				int ret = NormalEstimation(pcl_viz_control->pcl_normal_estimator, window_size, color_by_normal, pixel_grid, *filter_pipeline->GetPixelIndex(), filter_pipeline->GetCloud());
+
+				filter_pipeline->EndStage();
+			}
+		}
+
+		if (plane_detection) {
+			double threshold = pcl_filter_parameter->plane_detection_threshold;	//  0.2;
+			const int plane_detection_mode		= pcl_filter_parameter->plane_detection_mode;
+			const int plane_count_max			= pcl_filter_parameter->plane_detection_plane_count;
+			const int min_inlier_count			= pcl_filter_parameter->plane_detection_min_inliers;
+			const double time_budget			= pcl_filter_parameter->plane_detection_time_budget;
+
+			stage_key = HashValue(stage_key, threshold);
+			stage_key = HashValue(stage_key, plane_detection_mode);
+			if (plane_detection_mode == 1) {
+				stage_key = HashValue(stage_key, plane_count_max);
+				stage_key = HashValue(stage_key, min_inlier_count);
+				stage_key = HashValue(stage_key, time_budget);
+			}
+
+			if (!filter_pipeline->Restore(PclFilterPipeline::Stage::kPlaneDetection, stage_key)) {
+				// the inliers are painted in place
+				filter_pipeline->BeginInPlaceStage(PclFilterPipeline::Stage::kPlaneDetection, stage_key);
+
+				int ret = 0;
+				if (plane_detection_mode == 1) {
+					// the planes are extracted within the time budget, it bounds the latency of this thread
+					ret = MultiPlaneDetection(pcl_viz_control->pcl_plane_detector, threshold, plane_count_max, min_inlier_count, time_budget, &pcl_viz_control->planes, filter_pipeline->GetCloud());
+				}
+				else {
+					ret = PlaneDetection(pcl_viz_control->pcl_plane_detector, threshold, filter_pipeline->GetCloud());
 				}
 
-				// done
-				pcl_viz_control->pcl_data_ring_buffer->DoneGetBuffer(get_index);
+				filter_pipeline->EndStage();
 			}
-			else {
-				Sleep(16);
+		}
+
+		cloud = filter_pipeline->GetCloud();
+
+		// the builder writes the next frame into a buffer only the viewer may hold
+		// (without a filter stage the cloud is the buffer of the builder)
+		filter_pipeline->Finish();
+		build_slot->cloud.reset();
+
+		// the level of the next frame
+		// the frames are dropped when the slowest stage exceeds the budget, it is the sum of the stages when they are serial
+		const double filter_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - filter_start).count();
+		const double frame_time = (pcl_filter_parameter->build_frames_in_flight > 1) ? (std::max)(build_slot->build_time, filter_time) : build_slot->build_time + filter_time;
+
+		// set draw data
+		PclQualityController* quality_controller = pcl_viz_control->pcl_quality_controller;
+
+		{
+			std::lock_guard<std::mutex> threads_lock(pcl_viz_control->threads_mutex);
+			if (pcl_filter_parameter->enabled_quality_control) {
+				quality_controller->Update(pcl_filter_parameter->quality_control_budget, frame_time);
 			}
-		}// for (;;) {
 
-	}// while (thread_control_camera_.terminate_request < 1) {
+			pcl_viz_control->cloud = cloud;
+			pcl_viz_control->quality_information.enabled	= pcl_filter_parameter->enabled_quality_control;
+			pcl_viz_control->quality_information.level		= quality_controller->GetLevel();
+			pcl_viz_control->quality_information.frame_time	= quality_controller->GetFrameTime();
+
+			static_assert((int)PclFilterPipeline::Stage::kCount == kPCL_FILTER_STAGE_COUNT, "the stages of the pipeline and the output do not match");
+			for (int i = 0; i < kPCL_FILTER_STAGE_COUNT; i++) {
+				const PclFilterPipeline::StageStatistics& statistics = filter_pipeline->GetStatistics((PclFilterPipeline::Stage)i);
+				pcl_viz_control->stage_information[i].executed		= statistics.executed;
+				pcl_viz_control->stage_information[i].cached		= statistics.cached;
+				pcl_viz_control->stage_information[i].time			= statistics.time;
+				pcl_viz_control->stage_information[i].input_count	= statistics.input_count;
+				pcl_viz_control->stage_information[i].output_count	= statistics.output_count;
+			}
+		}
+		WakeUpThread(&pcl_viz_control->thread_control_draw);
 
-	pcl_viz_control->thread_control_build_pcl.terminate_done = 1;
+		// done, the slot is given back to the build thread
+		pcl_viz_control->free_slot_queue->Push(slot_index);
+
+	}// while (!thread_control_filter_pcl.terminate_request) {
 
 	return 0;
 }
@@ -786,7 +1521,7 @@ static void PointPickCallback(const pcl::visualization::PointPickingEvent& event
 	if (args != nullptr) {
 		cb_args = (struct CallbackArgs*)args;
 
-		EnterCriticalSection(&cb_args->pcl_viz_control->pick_callback_critical);
+		std::unique_lock<std::mutex> pick_lock(cb_args->pcl_viz_control->pick_callback_mutex);
 
 		if (0) {
 			pcl::search::KdTree<pcl::PointXYZRGBA> search;
@@ -811,7 +1546,7 @@ static void PointPickCallback(const pcl::visualization::PointPickingEvent& event
 
 		cb_args->pcl_viz_control->pick_information.count = 1;
 
-		LeaveCriticalSection(&cb_args->pcl_viz_control->pick_callback_critical);
+		pick_lock.unlock();
 	}
 
 	// debug
@@ -852,9 +1587,9 @@ static void KeyboardEventCallback(const pcl::visualization::KeyboardEvent& event
 		if (args != nullptr) {
 			cb_args = (struct CallbackArgs*)args;
 
-			EnterCriticalSection(&cb_args->pcl_viz_control->threads_critical);
+			std::unique_lock<std::mutex> threads_lock(cb_args->pcl_viz_control->threads_mutex);
 			pcl::PointCloud<pcl::PointXYZRGBA>::Ptr deep_copy(new pcl::PointCloud<pcl::PointXYZRGBA>(*cb_args->pcl_viz_control->cloud));
-			LeaveCriticalSection(&cb_args->pcl_viz_control->threads_critical);
+			threads_lock.unlock();
 
 			int ret = WritePclToFile(cb_args->pcl_viz_control->viz_parameters.pcd_file_write_folder, deep_copy);
 			
@@ -878,7 +1613,7 @@ static void KeyboardEventCallback(const pcl::visualization::KeyboardEvent& event
  * @retval other 失敗
  *
  */
-unsigned __stdcall VisualizerThread(void* context)
+unsigned VisualizerThread(void* context)
 {
 
 	/*
@@ -935,20 +1670,7 @@ unsigned __stdcall VisualizerThread(void* context)
 	viewer->registerKeyboardCallback(KeyboardEventCallback, (void*)&cb_args);
 
 	// window order
-	HWND hwnd = FindWindowA(NULL, visualizer_window_name.c_str());
-	{
-		//SetForegroundWindow(hwnd);
-		SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, (SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW));
-		SetWindowPos(hwnd, HWND_NOTOPMOST, 0, 0, 0, 0, (SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW));	
-	
-		/*
-		// 最前面表示の設定
-		SetWindowPos(hWnd, HWND_TOPMOST, 0, 0, 0, 0, (SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW));
-
-		// 最前面表示の解除
-		SetWindowPos(hWnd, HWND_NOTOPMOST, 0, 0, 0, 0, (SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW));	
-		*/
-	}
+	WsBringWindowToTop(visualizer_window_name.c_str());
 	// vtkSmartPointer<vtkRenderWindow> renderWindow = viewer->getRenderWindow();
 
 	// default camera position
@@ -970,16 +1692,17 @@ unsigned __stdcall VisualizerThread(void* context)
 	// wait start
 	while (!viewer->wasStopped()) {
 
-		if (pcl_viz_control->thread_control_draw.terminate_request == 1) {
+		if (pcl_viz_control->thread_control_draw.terminate_request) {
 			break;
 		}
 
 		viewer->spinOnce();
 
-		DWORD wait_result = WaitForSingleObject(pcl_viz_control->handle_semaphore_pcl_draw, 16);
+		// the viewer is spun at least every 16ms
+		bool is_updated = WaitWakeUp(&pcl_viz_control->thread_control_draw, 16);
 
-		if (wait_result == WAIT_OBJECT_0) {
-			EnterCriticalSection(&pcl_viz_control->threads_critical);
+		if (is_updated && !pcl_viz_control->thread_control_draw.terminate_request) {
+			std::lock_guard<std::mutex> threads_lock(pcl_viz_control->threads_mutex);
 
 			if (pcl_viz_control->cloud != NULL) {
 				if ((pcl_viz_control->cloud->size() != 0)) {
@@ -1013,243 +1736,83 @@ unsigned __stdcall VisualizerThread(void* context)
 					}
 				}
 			}
-
-			LeaveCriticalSection(&pcl_viz_control->threads_critical);
 		}
 	}
 
-	// ended
-	pcl_viz_control->thread_control_draw.end_code = 0;
-	pcl_viz_control->thread_control_draw.terminate_done = 1;
-
 	return 0;
 }
 
 /**
- * 視差データより点群(Point Cloud:XYZRGBA)を作成します.
- *
- * @param[in] width データ幅
- * @param[in] height データ高さ
- * @param[in] d_inf カメラ固有パラメータ
- * @param[in] base_length カメラ基線長
- * @param[in] bf カメラ固有パラメータ
- * @param[in] min_distance 描画する最短距離
- * @param[in] max_distance 描画する最大距離
- * @param[in] base_image 画像
- * @param[in] depth_data 視差
- * @param[in] cloud 点群データ
- *
- */
-void BuildPointCloud(	const int width, const int height, const double d_inf, const double base_length, const double bf, const double min_distance, const double max_distance,
-						cv::Mat& base_image, cv::Mat& depth_data,
-						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
-{
-
-	/*
-		座標系について
-		 ROS	: 右手系
-		 Unity	: 左手系
- 
-		 ROSではロボットの進行方向がx軸、左方向がy軸、上方向がz軸の正方向
-
-		変換方法
-		 Unity -> ROS
-		  Position: Unity(x,y,z) -> ROS(z,-x,y)
-		  Quaternion: Unity(x,y,z,w) -> ROS(z,-x,y,-w)
-
-		 ROS -> Unity
-		  Position: ROS(x,y,z) -> Unity(-y,z,x)
-		  Quaternion: ROS(x,y,z,w) -> Unity(-y,z,x,-w)
-	*/
-
-	// ポイントクラウドの大きさをセット
-	cloud->width = width;
-	cloud->height = height;
-	cloud->is_dense = false;
-	cloud->points.resize(cloud->height * cloud->width);
-
-	// nan
-	pcl::PointXYZRGBA point_nan;
-	point_nan.x = std::numeric_limits<float>::quiet_NaN();
-	point_nan.y = std::numeric_limits<float>::quiet_NaN();
-	point_nan.z = std::numeric_limits<float>::quiet_NaN();
-	point_nan.r = 0;
-	point_nan.g = 0;
-	point_nan.b = 0;
-
-	int yc = height / 2;
-	int xc = width / 2;
-
-	int type = base_image.type();
-
-	if (type == CV_8UC3) {
-		for (int i = 0; i < height; i++) {
-
-			float* src_depth = depth_data.ptr<float>(i);
-			cv::Vec3b* src_image = base_image.ptr<cv::Vec3b>(i);
-
-			for (int j = 0; j < width; j++) {
-				float value = src_depth[j] - (float)d_inf;
-				float x = 0;
-				float y = 0;
-				float z = 0;
-				unsigned int col = 0;
-				unsigned char b = 0;
-				unsigned char g = 0;
-				unsigned char r = 0;
-
-				if (value > 0) {
-					x = (base_length * (j - xc)) / value;	// m
-					y = (base_length * (yc - i)) / value;	// m
-					z = (float)bf / value;					// m
-
-					col = 0;
-
-					if (z >= min_distance && z < max_distance) {
-						b = src_image[j][0];
-						g = src_image[j][1];
-						r = src_image[j][2];
-
-						pcl::PointXYZRGBA point;
-						point.x = -1 * x;	// z;		// x;
-						point.y = y;		// x * -1;	// y;
-						point.z = z;		// y;		// z;
-
-						point.r = r;
-						point.g = g;
-						point.b = b;
-
-						cloud->push_back(point);
-					}
-					else {
-						cloud->push_back(point_nan);
-					}
-				}
-				else {
-					cloud->push_back(point_nan);
-				}
-			}
-		}
-	}
-	else if (type == CV_8UC4) {
-		for (int i = 0; i < height; i++) {
-
-			float* src_depth = depth_data.ptr<float>(i);
-			cv::Vec4b* src_image = base_image.ptr<cv::Vec4b>(i);
-
-			for (int j = 0; j < width; j++) {
-				float value = src_depth[j] - (float)d_inf;
-				float x = 0;
-				float y = 0;
-				float z = 0;
-				unsigned int col = 0;
-				unsigned char b = 0;
-				unsigned char g = 0;
-				unsigned char r = 0;
-
-				if (value > 0) {
-					x = (base_length * (j - xc)) / value;
-					y = (base_length * (yc - i)) / value;
-					z = (float)bf / value;
-
-					col = 0;
-
-					if (z >= min_distance && z < max_distance) {
-						b = src_image[j][0];
-						g = src_image[j][1];
-						r = src_image[j][2];
-
-						pcl::PointXYZRGBA point;
-						point.x = -1 * x;	// z;		// x;
-						point.y = y;		// x * -1;	// y;
-						point.z = z;		// y;		// z;
-
-						point.r = r;
-						point.g = g;
-						point.b = b;
-
-						cloud->push_back(point);
-					}
-					else {
-						cloud->push_back(point_nan);
-					}
-				}
-				else {
-					cloud->push_back(point_nan);
-				}
-
-			}
-		}
-	}
-
-	return;
-}
-
-/**
- * 値がユーザーが指定した特定の範囲にないポイントがクラウドから削除される.
+ * 半径に基づく外れ値除去.
  *
- * @param[in] field_name 対象とするフィールド
- * @param[in] min_length 最短距離
- * @param[in] max_length 最大距離
+ * @param[in] radius_search 検索半径
+ * @param[in] min_neighbors_in_radius ポイントが外れ値としてラベル付けされるのを避けるべき最小の近傍点数
  * @param[in] cloud 入力点群データ
  * @param[out] filtered_cloud フィルター後の点群データ
+ * @param[out] kept_index 残った各点の入力での位置. nullptr の場合は取得しません
  *
  * @retval 0 成功
  * @retval other 失敗
  *
  */
-int PathThroughFilter(const std::string field_name, const double min_length, const double max_length, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud)
+int RadiusOutlierRemoval(const double radius_search, const int min_neighbors_in_radius, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud, std::vector<int>* kept_index)
 {
-	// パススルー　フィルター
-	// pass through filter
-	pcl::PassThrough<pcl::PointXYZRGBA> filter;
-	filter.setInputCloud(cloud);
+	// 半径に基づく外れ値除去
+	/*
+		このアルゴリズムはすべてのポイントを繰り返し実行し（そのためクラウドが大きい場合は遅くなる可能性がある）、チェックを実行する。
+		指定された半径内に指定した近傍数より少ないポイントが見つかった場合は、それらを削除する。
+	*/
 
-	// Filter out all points with Z values not in the [1-10] range.
-	// Z値が[1-10]の範囲に「ない」すべてのポイントを見つけ出す
-	filter.setFilterFieldName(field_name);
-	filter.setFilterLimits(min_length, max_length);
+	pcl::RadiusOutlierRemoval<pcl::PointXYZRGBA> filter;
+	filter.setInputCloud(cloud);
+	// Every point must have 5neighbors within 15cm, or it will be removed.
+	// どのポイントも15cm以内に5個以上の近傍点を持たなければならない、そうでなければ除去される
+	filter.setRadiusSearch(radius_search);						// unit:m
+	filter.setMinNeighborsInRadius(min_neighbors_in_radius);	// unit:count
 
-	filter.filter(*filtered_cloud);
+	if (kept_index != nullptr) {
+		// the same points as filter(cloud), the indices map the survivors back to their pixels
+		filter.filter(*kept_index);
+		pcl::copyPointCloud(*cloud, *kept_index, *filtered_cloud);
+	}
+	else {
+		filter.filter(*filtered_cloud);
+	}
 
 	return 0;
 }
 
 /**
- * 半径に基づく外れ値除去.
+ * 半径に基づく外れ値除去 (画素の配置を使用).
  *
+ * @param[in] radius_outlier_filter 外れ値除去フィルター
  * @param[in] radius_search 検索半径
  * @param[in] min_neighbors_in_radius ポイントが外れ値としてラベル付けされるのを避けるべき最小の近傍点数
+ * @param[in] pixel_grid 画素の配置
+ * @param[in] pixel_index 各点の画素の位置
  * @param[in] cloud 入力点群データ
  * @param[out] filtered_cloud フィルター後の点群データ
  *
  * @retval 0 成功
  * @retval other 失敗
  *
+ * @details 近傍点をKdTreeではなく、点の距離で検索半径が占める画素の範囲から探します.
+ *  パラメータの意味は RadiusOutlierRemoval と同じです
  */
-int RadiusOutlierRemoval(const double radius_search, const int min_neighbors_in_radius, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud)
+int RadiusOutlierRemoval(PclRadiusOutlierFilter* radius_outlier_filter, const double radius_search, const int min_neighbors_in_radius, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+							pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud)
 {
 	// 半径に基づく外れ値除去
-	/*
-		このアルゴリズムはすべてのポイントを繰り返し実行し（そのためクラウドが大きい場合は遅くなる可能性がある）、チェックを実行する。
-		指定された半径内に指定した近傍数より少ないポイントが見つかった場合は、それらを削除する。
-	*/
-
-	pcl::RadiusOutlierRemoval<pcl::PointXYZRGBA> filter;
-	filter.setInputCloud(cloud);
-	// Every point must have 5neighbors within 15cm, or it will be removed.
-	// どのポイントも15cm以内に5個以上の近傍点を持たなければならない、そうでなければ除去される
-	filter.setRadiusSearch(radius_search);						// unit:m
-	filter.setMinNeighborsInRadius(min_neighbors_in_radius);	// unit:count
 
-	filter.filter(*filtered_cloud);
+	int ret = radius_outlier_filter->Filter(radius_search, min_neighbors_in_radius, pixel_grid, pixel_index, *cloud, filtered_cloud.get());
 
-	return 0;
+	return ret;
 }
 
 /**
  * クラウドのポイント数を減らす（ダウンサンプリングする）.
  *
+ * @param[in] voxel_grid_filter ボクセルグリッドフィルター
  * @param[in] boxel_size ボクセルのサイズ
  * @param[in] cloud 入力点群データ
  * @param[out] filtered_cloud フィルター後の点群データ
@@ -1257,63 +1820,131 @@ int RadiusOutlierRemoval(const double radius_search, const int min_neighbors_in_
  * @retval 0 成功
  * @retval other 失敗
  *
+ * @details pcl::VoxelGrid の代わりに並列のハッシュによるボクセルグリッドを使用します.
+ *  点はボクセル内の点の平均 (pcl::VoxelGrid と同じ) で、順序は各ボクセルの最初の点の順です
  */
-int DownSampling(const double boxel_size, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud)
+int DownSampling(PclVoxelGridFilter* voxel_grid_filter, const double boxel_size, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr filtered_cloud)
 {
 	// ダウンサンプリング
 
-	pcl::VoxelGrid<pcl::PointXYZRGBA> filter;
-	filter.setInputCloud(cloud);
-
 	// We set the size of every voxel to be 1x1x1cm
 	// (only one point per every cubic centimeter will survive).
 	// どのボクセルのサイズも 1 x 1 x 1 cmとする(1 立方センチメートルの立方体あたり1個だけ残す)
 
-	float lx = (float)boxel_size;
-	float ly = (float)boxel_size;
-	float lz = (float)boxel_size;
-	filter.setLeafSize(lx, ly, lz);
+	int ret = voxel_grid_filter->Filter(boxel_size, PclVoxelGridFilter::Mode::kCentroid, *cloud, filtered_cloud.get());
 
-	filter.filter(*filtered_cloud);
+	return ret;
+}
+
+/**
+ * 平面検出を行います.
+ *
+ * @param[in] plane_detector 平面検出
+ * @param[in] threshold 平面とするThreshold
+ * @param[inout] cloud 入力点群データ(インプレース処理)
+ *
+ * @retval 0 成功
+ * @retval other 失敗
+ *
+ * @details pcl::SACSegmentation の代わりに、前のフレームの平面を初期値とする並列のRANSACを使用します
+ */
+int PlaneDetection(PclPlaneDetector* plane_detector, double threshold, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
+{
+	//平面方程式と平面と検出された点
+	PclPlaneDetector::Plane plane = {};
+
+	//RANSACによる検出．前のフレームの平面から開始し、点群はコピーしない
+	int ret = plane_detector->Detect(threshold, *cloud, &plane);
+	if (ret != 0)
+	{
+		std::cout << "Could not estimate a planar model for the given dataset." << std::endl;
+		return -1;
+	}
+
+	const std::vector<int>& label = plane_detector->GetLabel();
+	const size_t point_count = cloud->points.size();
+	for (size_t i = 0; i < point_count; ++i) {
+		if (label[i] == 0) {
+			cloud->points[i].r = 255;
+			cloud->points[i].g = 0;
+			cloud->points[i].b = 0;
+		}
+	}
 
 	return 0;
 }
 
 /**
- * 平面検出を行います.
+ * 複数の平面の検出を行います.
  *
+ * @param[in] plane_detector 平面検出
  * @param[in] threshold 平面とするThreshold
+ * @param[in] plane_count_max 最大の平面の数
+ * @param[in] min_inlier_count 平面の最小の点の数
+ * @param[in] time_budget 時間の制限(ms)
+ * @param[out] planes 検出した平面
  * @param[inout] cloud 入力点群データ(インプレース処理)
  *
  * @retval 0 成功
  * @retval other 失敗
  *
+ * @details 大きい平面から順に検出し、平面ごとに色を付けます.
+ *  残りの点が min_inlier_count 未満、または time_budget を過ぎた時点で終了します
  */
-int PlaneDetection(double threshold, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
+int MultiPlaneDetection(PclPlaneDetector* plane_detector, double threshold, int plane_count_max, int min_inlier_count, double time_budget, std::vector<PclPlaneDetector::Plane>* planes, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
 {
-	//平面方程式と平面と検出された点のインデックス
-	pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-	pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
-
-	//RANSACによる検出．
-	pcl::SACSegmentation<pcl::PointXYZRGBA> seg;
-	seg.setOptimizeCoefficients(true);				//外れ値の存在を前提とし最適化を行う
-	seg.setModelType(pcl::SACMODEL_PLANE);			//モードを平面検出に設定
-	seg.setMethodType(pcl::SAC_RANSAC);				//検出方法をRANSACに設定
-	seg.setDistanceThreshold(threshold);			//しきい値を設定
-	seg.setInputCloud(cloud->makeShared());			//入力点群をセット
-	seg.segment(*inliers, *coefficients);			//検出を行う
-
-	if (inliers->indices.size() == 0)
+	// color of each plane (r, g, b)
+	static const unsigned char plane_colors[PclPlaneDetector::kPlaneCountMax][3] = {
+		{ 255, 0, 0 }, { 0, 255, 0 }, { 0, 0, 255 }, { 255, 255, 0 },
+		{ 255, 0, 255 }, { 0, 255, 255 }, { 255, 128, 0 }, { 128, 0, 255 }
+	};
+
+	int ret = plane_detector->DetectPlanes(threshold, plane_count_max, min_inlier_count, time_budget, *cloud, planes);
+	if (ret != 0)
 	{
 		std::cout << "Could not estimate a planar model for the given dataset." << std::endl;
 		return -1;
 	}
 
-	for (size_t i = 0; i < inliers->indices.size(); ++i) {
-		cloud->points[inliers->indices[i]].r = 255;
-		cloud->points[inliers->indices[i]].g = 0;
-		cloud->points[inliers->indices[i]].b = 0;
+	const std::vector<int>& label = plane_detector->GetLabel();
+	const size_t point_count = cloud->points.size();
+	for (size_t i = 0; i < point_count; ++i) {
+		const int plane_number = label[i];
+		if (plane_number >= 0) {
+			cloud->points[i].r = plane_colors[plane_number][0];
+			cloud->points[i].g = plane_colors[plane_number][1];
+			cloud->points[i].b = plane_colors[plane_number][2];
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * 法線の推定を行います.
+ *
+ * @param[in] normal_estimator 法線推定
+ * @param[in] window_size 近傍の窓の半径(画素)
+ * @param[in] color_by_normal 法線で色を付ける
+ * @param[in] pixel_grid 画素グリッド
+ * @param[in] pixel_index 各点の画素
+ * @param[inout] cloud 入力点群データ(インプレース処理)
+ *
+ * @retval 0 成功
+ * @retval other 失敗
+ *
+ * @details pcl::NormalEstimation の KdTree による近傍探索の代わりに、画素グリッド上の積分画像を使用します
+ */
+int NormalEstimation(PclNormalEstimator* normal_estimator, const int window_size, const bool color_by_normal, const PclPointCloudBuilder::PixelGrid& pixel_grid, const std::vector<int>& pixel_index,
+						pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
+{
+	int ret = normal_estimator->Estimate(window_size, pixel_grid, pixel_index, *cloud);
+	if (ret != 0) {
+		return -1;
+	}
+
+	if (color_by_normal) {
+		normal_estimator->ColorByNormal(cloud.get());
 	}
 
 	return 0;
@@ -1332,12 +1963,12 @@ int PlaneDetection(double threshold, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr clo
 int WritePclToFile(char* write_folder_name, pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud)
 {
 
-	SYSTEMTIME st = {};
-	GetLocalTime(&st);
+	int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+	WsGetLocalTime(&year, &month, &day, &hour, &minute, &second);
 
 	char date_time_name[_MAX_PATH] = {};
 	// YYYYMMDD_HHMMSS
-	sprintf(date_time_name, "%04d%02d%02d_%02d%02d%02d", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+	sprintf(date_time_name, "%04d%02d%02d_%02d%02d%02d", year, month, day, hour, minute, second);
 
 	char write_file_name[_MAX_PATH] = {};
 	sprintf(write_file_name, "%s\\dpl-pcd-dada_%s.pcd", write_folder_name, date_time_name);
@@ -43,3 +43,18 @@ int StopPclViz();
     @return 0, if successful.
  */
 int RunPclViz(PclVizInputArgs* input_args, PclVizOutputArgs* output_args);
+
+/** @brief Registers a consumer of the frames entered by RunPclViz, in addition to the display.
+    @return consumer id, if successful. -1, if failed.
+ */
+int AddPclVizFrameConsumer(const bool lossless);
+
+/** @brief Unregisters the consumer.
+    @return 0, if successful.
+ */
+int RemovePclVizFrameConsumer(const int consumer_id);
+
+/** @brief Gets the next frame of the consumer. The frame must be released by PclFramePool::Release.
+    @return 0, if successful.
+ */
+int GetPclVizFrame(const int consumer_id, const int timeout, PclFrame** frame);
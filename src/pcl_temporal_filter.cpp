@@ -0,0 +1,310 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_temporal_filter.cpp
+ * @brief Temporal smoothing of the disparity.
+ * @version 0.1
+ *
+ * @details The disparity of a still scene changes by the noise of the matching in every frame, the 3D view flickers.
+ *  Each pixel is smoothed with its previous frames. The output includes the current frame, so no latency is added.
+ *  The state of a pixel is reset to the current disparity when it changes largely (moving object) or becomes invalid.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <emmintrin.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_temporal_filter.h"
+
+/**
+ * 状態を継続するかどうかを返します（参照実装）.
+ *
+ * @param[in] depth 現在の視差
+ * @param[in] state 前フレームの出力
+ * @param[in] d_inf カメラ固有パラメータ
+ * @param[in] ratio リセットの比
+ * @param[in] margin リセットのしきい値への加算値
+ *
+ * @retval true 継続
+ * @retval false リセット (無効、または大きな変化)
+ *
+ * @details SIMD版と同じ演算です. NaN はリセットになります
+ */
+static inline bool KeepState(const float depth, const float state, const float d_inf, const float ratio, const float margin)
+{
+	const float value = depth - d_inf;
+	const float threshold = (value * ratio) + margin;
+
+	return (value > 0) && ((state - d_inf) > 0) && (std::fabs(depth - state) <= threshold);
+}
+
+/**
+ * 3つの値の中央値を返します.
+ *
+ */
+static inline float Median3(const float a, const float b, const float c)
+{
+	return (std::max)((std::min)(a, b), (std::min)((std::max)(a, b), c));
+}
+
+/**
+ * 5つの値の中央値を返します.
+ *
+ * @details 最小/最大のみで構成し、SIMD版と同じ順に比較します
+ */
+static inline float Median5(const float a, const float b, const float c, const float d, const float e)
+{
+	const float f = (std::max)((std::min)(a, b), (std::min)(c, d));
+	const float g = (std::min)((std::max)(a, b), (std::max)(c, d));
+
+	return Median3(e, f, g);
+}
+
+static inline __m128 Median3(const __m128 a, const __m128 b, const __m128 c)
+{
+	return _mm_max_ps(_mm_min_ps(a, b), _mm_min_ps(_mm_max_ps(a, b), c));
+}
+
+static inline __m128 Median5(const __m128 a, const __m128 b, const __m128 c, const __m128 d, const __m128 e)
+{
+	const __m128 f = _mm_max_ps(_mm_min_ps(a, b), _mm_min_ps(c, d));
+	const __m128 g = _mm_min_ps(_mm_max_ps(a, b), _mm_max_ps(c, d));
+
+	return Median3(e, f, g);
+}
+
+/**
+ * constructor
+ *
+ */
+PclTemporalFilter::PclTemporalFilter():
+	has_state_(false), mode_(Mode::kExponentialAverage), filtered_data_(), history_(), history_index_(0)
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclTemporalFilter::~PclTemporalFilter()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] width_max 最大データ幅
+ * @param[in] height_max 最大データ高さ
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclTemporalFilter::Initialize(const int width_max, const int height_max)
+{
+	if (width_max <= 0 || height_max <= 0) {
+		return -1;
+	}
+
+	filtered_data_.create(height_max, width_max, CV_32F);
+	history_.reserve((size_t)width_max * height_max * kHistoryCount);
+
+	Reset();
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclTemporalFilter::Terminate()
+{
+	filtered_data_.release();
+	history_.clear();
+
+	Reset();
+
+	return 0;
+}
+
+/**
+ * 状態を破棄します.
+ *
+ * @details 次のフレームは入力をそのまま出力します. フィルターを使用しないフレームがあった場合に呼び出します
+ */
+void PclTemporalFilter::Reset()
+{
+	has_state_ = false;
+	history_index_ = 0;
+
+	return;
+}
+
+/**
+ * 視差を時間方向に平滑化します.
+ *
+ * @param[in] mode 平滑化の方法
+ * @param[in] alpha 指数移動平均の現在のフレームの重み (0 - 1)
+ * @param[in] d_inf カメラ固有パラメータ
+ * @param[in] depth_data 視差 (CV_32F)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 画素ごとに、前フレームの出力との差が (d - d_inf) * kResetRatio + kResetMargin を超える場合、
+ *  または現在か前フレームが無効の場合は、状態をリセットして現在の視差を出力します.
+ *  結果は GetFilteredData で取得します. 全画素を kChunkSize ごとに並列に、SSE2 で4画素ずつ処理します
+ */
+int PclTemporalFilter::Filter(const Mode mode, const float alpha, const float d_inf, const cv::Mat& depth_data)
+{
+	if (depth_data.type() != CV_32F || depth_data.cols <= 0 || depth_data.rows <= 0) {
+		return -1;
+	}
+
+	const int width = depth_data.cols;
+	const int height = depth_data.rows;
+	const int pixel_count = width * height;
+
+	if (filtered_data_.cols != width || filtered_data_.rows != height || mode != mode_) {
+		// the state is for an other image
+		Reset();
+	}
+
+	filtered_data_.create(height, width, CV_32F);
+	mode_ = mode;
+
+	if (mode == Mode::kMedian) {
+		history_.resize((size_t)pixel_count * kHistoryCount);
+	}
+
+	const float weight = (std::max)(0.0F, (std::min)(1.0F, alpha));
+	const float ratio = kResetRatio;
+	const float margin = kResetMargin;
+
+	// the first frame after the reset, every pixel is reset
+	const bool has_state = has_state_;
+
+	// history in the order of the frames, the current frame is the last
+	float* history[kHistoryCount] = {};
+	if (mode == Mode::kMedian) {
+		for (int k = 0; k < kHistoryCount; k++) {
+			history[k] = history_.data() + (size_t)((history_index_ + 1 + k) % kHistoryCount) * pixel_count;
+		}
+	}
+
+	const int chunk_count = (pixel_count + kChunkSize - 1) / kChunkSize;
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		const __m128 d_inf_4 = _mm_set1_ps(d_inf);
+		const __m128 ratio_4 = _mm_set1_ps(ratio);
+		const __m128 margin_4 = _mm_set1_ps(margin);
+		const __m128 weight_4 = _mm_set1_ps(weight);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 sign_mask = _mm_set1_ps(-0.0F);
+		const __m128 has_state_4 = has_state ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, pixel_count);
+
+			// the matrices are continuous
+			const float* src = depth_data.ptr<float>(0);
+			float* dst = filtered_data_.ptr<float>(0);
+
+			int i = start;
+			for (; i + 4 <= end; i += 4) {
+				const __m128 depth = _mm_loadu_ps(src + i);
+				const __m128 state = _mm_loadu_ps(dst + i);
+
+				const __m128 value = _mm_sub_ps(depth, d_inf_4);
+				const __m128 threshold = _mm_add_ps(_mm_mul_ps(value, ratio_4), margin_4);
+				const __m128 difference = _mm_andnot_ps(sign_mask, _mm_sub_ps(depth, state));
+
+				__m128 keep = _mm_and_ps(_mm_cmpgt_ps(value, zero), _mm_cmpgt_ps(_mm_sub_ps(state, d_inf_4), zero));
+				keep = _mm_and_ps(keep, _mm_cmple_ps(difference, threshold));
+				keep = _mm_and_ps(keep, has_state_4);
+
+				__m128 smoothed;
+				if (mode == Mode::kMedian) {
+					__m128 h[kHistoryCount];
+					for (int k = 0; k < kHistoryCount - 1; k++) {
+						h[k] = _mm_or_ps(_mm_and_ps(keep, _mm_loadu_ps(history[k] + i)), _mm_andnot_ps(keep, depth));
+					}
+					h[kHistoryCount - 1] = depth;
+
+					_mm_storeu_ps(history[kHistoryCount - 1] + i, depth);
+					for (int k = 0; k < kHistoryCount - 1; k++) {
+						_mm_storeu_ps(history[k] + i, h[k]);
+					}
+
+					smoothed = Median5(h[0], h[1], h[2], h[3], h[4]);
+				}
+				else {
+					smoothed = _mm_add_ps(state, _mm_mul_ps(weight_4, _mm_sub_ps(depth, state)));
+				}
+
+				_mm_storeu_ps(dst + i, _mm_or_ps(_mm_and_ps(keep, smoothed), _mm_andnot_ps(keep, depth)));
+			}
+
+			for (; i < end; i++) {
+				const float depth = src[i];
+				const float state = dst[i];
+				const bool keep = has_state && KeepState(depth, state, d_inf, ratio, margin);
+
+				float smoothed;
+				if (mode == Mode::kMedian) {
+					float h[kHistoryCount];
+					for (int k = 0; k < kHistoryCount - 1; k++) {
+						h[k] = keep ? history[k][i] : depth;
+						history[k][i] = h[k];
+					}
+					h[kHistoryCount - 1] = depth;
+					history[kHistoryCount - 1][i] = depth;
+
+					smoothed = Median5(h[0], h[1], h[2], h[3], h[4]);
+				}
+				else {
+					smoothed = state + (weight * (depth - state));
+				}
+
+				dst[i] = keep ? smoothed : depth;
+			}
+		}
+	});
+
+	if (mode == Mode::kMedian) {
+		// the oldest frame is written next
+		history_index_ = (history_index_ + 1) % kHistoryCount;
+	}
+	has_state_ = true;
+
+	return 0;
+}
+
+/**
+ * 最後の結果を取得します.
+ *
+ * @return 視差 (CV_32F 入力と同じ大きさ)
+ *
+ * @details 次のフレームの状態のため、変更しないでください
+ */
+cv::Mat& PclTemporalFilter::GetFilteredData()
+{
+	return filtered_data_;
+}
@@ -0,0 +1,64 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_temporal_filter.h
+ * @brief Temporal smoothing of the disparity.
+ */
+
+#pragma once
+
+/**
+ * @class   PclTemporalFilter
+ * @brief   Temporal filter class
+ * this class keeps the per pixel state over the frames
+ */
+class PclTemporalFilter {
+public:
+
+	/** @enum  Mode
+	 *  @brief Smoothing method
+	 */
+	enum class Mode {
+		kExponentialAverage,		/**< exponential moving average */
+		kMedian						/**< median of the last kHistoryCount frames */
+	};
+
+	PclTemporalFilter();
+	~PclTemporalFilter();
+
+	int Initialize(const int width_max, const int height_max);
+
+	int Terminate();
+
+	void Reset();
+
+	int Filter(const Mode mode, const float alpha, const float d_inf, const cv::Mat& depth_data);
+
+	cv::Mat& GetFilteredData();
+
+private:
+	static constexpr int kChunkSize = 16384;				/**< pixels per parallel task */
+	static constexpr int kHistoryCount = 5;					/**< frames of the median */
+	static constexpr float kResetRatio = 0.1F;				/**< the state is reset if the disparity changes more than this ratio */
+	static constexpr float kResetMargin = 1.0F;				/**< pixels, added to the reset threshold for the noise of the disparity */
+
+	bool has_state_;										/**< filtered_data_ holds the previous frame */
+	Mode mode_;												/**< mode of the state */
+
+	cv::Mat filtered_data_;									/**< filtered disparity (CV_32F), the state of the next frame */
+	std::vector<float> history_;							/**< last kHistoryCount disparities, frame major */
+	int history_index_;										/**< frame in the history to be written next */
+
+};
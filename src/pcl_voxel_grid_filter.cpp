@@ -0,0 +1,446 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_voxel_grid_filter.cpp
+ * @brief Voxel grid down sampling with a hash over the voxel keys.
+ * @version 0.1
+ *
+ * @details Replaces pcl::VoxelGrid, which sorts every point by the voxel index on one thread
+ *  and can not be used when the number of voxels of the bounding box exceeds int32.
+ *  The voxels are found with open addressing hash tables, one for each partition of the keys.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_voxel_grid_filter.h"
+
+static constexpr uint64_t kInvalidKey = std::numeric_limits<uint64_t>::max();
+static constexpr uint64_t kOverflowKey = kInvalidKey - 1;		/**< finite point outside the key range, the keys use 63 bits */
+
+static constexpr int kKeyBits = 21;								/**< bits for each axis */
+static constexpr int64_t kKeyBias = (int64_t)1 << (kKeyBits - 1);	/**< voxel index range -kKeyBias <= i < kKeyBias */
+
+/**
+ * ボクセルのキーのハッシュ値を返します.
+ *
+ * @param[in] key キー
+ *
+ * @return ハッシュ値
+ *
+ * @details 上位ビットをパーティション、下位ビットをテーブルの位置に使用します
+ */
+static inline uint64_t HashKey(uint64_t key)
+{
+	// splitmix64 finalizer
+	key ^= key >> 30;
+	key *= 0xBF58476D1CE4E5B9ULL;
+	key ^= key >> 27;
+	key *= 0x94D049BB133111EBULL;
+	key ^= key >> 31;
+
+	return key;
+}
+
+/**
+ * 点のボクセルのキーを返します.
+ *
+ * @param[in] point 点
+ * @param[in] inverse_leaf_size 1 / ボクセルの大きさ
+ *
+ * @return キー (無効な点は kInvalidKey, 範囲外の点は kOverflowKey)
+ *
+ * @details pcl::VoxelGrid と同じく floor(x / leaf_size) をボクセルの位置とします
+ */
+static inline uint64_t GetVoxelKey(const pcl::PointXYZRGBA& point, const double inverse_leaf_size)
+{
+	if (!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z)) {
+		return kInvalidKey;
+	}
+
+	const double fx = std::floor(point.x * inverse_leaf_size);
+	const double fy = std::floor(point.y * inverse_leaf_size);
+	const double fz = std::floor(point.z * inverse_leaf_size);
+
+	const double limit = (double)kKeyBias;
+	if (fx < -limit || fx >= limit || fy < -limit || fy >= limit || fz < -limit || fz >= limit) {
+		return kOverflowKey;
+	}
+
+	const uint64_t ix = (uint64_t)((int64_t)fx + kKeyBias);
+	const uint64_t iy = (uint64_t)((int64_t)fy + kKeyBias);
+	const uint64_t iz = (uint64_t)((int64_t)fz + kKeyBias);
+
+	return (ix << (kKeyBits * 2)) | (iy << kKeyBits) | iz;
+}
+
+/**
+ * constructor
+ *
+ */
+PclVoxelGridFilter::PclVoxelGridFilter():
+	keys_(), chunk_partition_offset_(), partition_offset_(), order_(), partition_voxels_(), partition_table_(), voxel_offset_(),
+	first_voxel_(), chunk_output_offset_(), voxels_(), source_index_(), key_overflow_(false)
+{
+}
+
+/**
+ * destructor
+ *
+ */
+PclVoxelGridFilter::~PclVoxelGridFilter()
+{
+}
+
+/**
+ * 初期化します.
+ *
+ * @param[in] point_count_max 最大点数
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ */
+int PclVoxelGridFilter::Initialize(const int point_count_max)
+{
+	if (point_count_max < 0) {
+		return -1;
+	}
+
+	const size_t point_count = (size_t)point_count_max;
+
+	keys_.reserve(point_count);
+	order_.reserve(point_count);
+	first_voxel_.reserve(point_count);
+	source_index_.reserve(point_count);
+	partition_offset_.reserve(kPartitionCount + 1);
+	voxel_offset_.reserve(kPartitionCount + 1);
+
+	return 0;
+}
+
+/**
+ * 終了します.
+ *
+ * @retval 0 成功
+ */
+int PclVoxelGridFilter::Terminate()
+{
+	keys_.clear();
+	chunk_partition_offset_.clear();
+	partition_offset_.clear();
+	order_.clear();
+
+	for (int p = 0; p < kPartitionCount; p++) {
+		partition_voxels_[p].clear();
+		partition_table_[p].clear();
+	}
+	voxel_offset_.clear();
+
+	first_voxel_.clear();
+	chunk_output_offset_.clear();
+	voxels_.clear();
+	source_index_.clear();
+
+	return 0;
+}
+
+/**
+ * ボクセルグリッドでダウンサンプリングします.
+ *
+ * @param[in] leaf_size ボクセルの大きさ(m)
+ * @param[in] mode kCentroid:ボクセル内の点の平均 kFirstPoint:ボクセル内の最初の点
+ * @param[in] cloud 入力点群データ
+ * @param[out] filtered_cloud フィルター後の点群データ (cloud とは別のもの)
+ *
+ * @retval 0 成功
+ * @retval -1 失敗
+ *
+ * @details 1. 点ごとのキーを求め、キーのハッシュで点をパーティションに分けます (入力の順序を保ちます)
+ *  2. パーティションごとに並列にハッシュテーブルでボクセルを求め、入力の順に加算します
+ *  3. 各ボクセルの最初の点の位置に、入力の順で出力します
+ *  処理の単位は点数から決まり、加算の順序も入力の順のため、結果はスレッド数によらず同じです.
+ *  NaN の点は出力しません.
+ *  キーの範囲 (各軸 ±2^20 ボクセル) を超える点がある場合は、pcl::VoxelGrid と同じく警告を出力し、
+ *  入力をそのまま出力します (範囲外の点だけが消えることはありません)
+ */
+int PclVoxelGridFilter::Filter(const double leaf_size, const Mode mode, const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, pcl::PointCloud<pcl::PointXYZRGBA>* filtered_cloud)
+{
+	if (filtered_cloud == nullptr || filtered_cloud == &cloud) {
+		return -1;
+	}
+
+	if (!(leaf_size > 0)) {
+		return -1;
+	}
+
+	const int point_count = (int)cloud.points.size();
+	const pcl::PointXYZRGBA* points = cloud.points.data();
+	const double inverse_leaf_size = 1.0 / leaf_size;
+
+	const int chunk_count = (point_count + kChunkSize - 1) / kChunkSize;
+
+	// 1. keys, counts of each chunk x partition
+	keys_.resize((size_t)point_count);
+	chunk_partition_offset_.assign((size_t)chunk_count * kPartitionCount, 0);
+	std::atomic<int> overflow_count(0);
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+			int* count = &chunk_partition_offset_[(size_t)c * kPartitionCount];
+			int chunk_overflow_count = 0;
+
+			for (int i = start; i < end; i++) {
+				const uint64_t key = GetVoxelKey(points[i], inverse_leaf_size);
+				keys_[i] = key;
+				if (key == kOverflowKey) {
+					chunk_overflow_count++;
+				}
+				else if (key != kInvalidKey) {
+					count[HashKey(key) >> (64 - kPartitionBits)]++;
+				}
+			}
+
+			if (chunk_overflow_count != 0) {
+				overflow_count += chunk_overflow_count;
+			}
+		}
+	});
+
+	if (overflow_count != 0) {
+		// the leaf size is too small for the cloud
+		if (!key_overflow_) {
+			printf("[WARN]PclVoxelGridFilter: leaf size %f is too small, %d points are out of the voxel index range, the cloud is not filtered\n", leaf_size, overflow_count.load());
+		}
+		key_overflow_ = true;
+
+		filtered_cloud->points.assign(cloud.points.begin(), cloud.points.end());
+		filtered_cloud->width = cloud.width;
+		filtered_cloud->height = cloud.height;
+		filtered_cloud->is_dense = cloud.is_dense;
+		filtered_cloud->header = cloud.header;
+		filtered_cloud->sensor_origin_ = cloud.sensor_origin_;
+		filtered_cloud->sensor_orientation_ = cloud.sensor_orientation_;
+
+		source_index_.resize((size_t)point_count);
+		for (int i = 0; i < point_count; i++) {
+			source_index_[i] = i;
+		}
+
+		return 0;
+	}
+	key_overflow_ = false;
+
+	// partition major prefix sum, the points of a partition stay in the input order
+	partition_offset_.resize(kPartitionCount + 1);
+	int offset = 0;
+	for (int p = 0; p < kPartitionCount; p++) {
+		partition_offset_[p] = offset;
+		for (int c = 0; c < chunk_count; c++) {
+			int& value = chunk_partition_offset_[((size_t)c * kPartitionCount) + p];
+			const int count = value;
+			value = offset;
+			offset += count;
+		}
+	}
+	partition_offset_[kPartitionCount] = offset;
+
+	order_.resize((size_t)offset);
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+			int* position = &chunk_partition_offset_[(size_t)c * kPartitionCount];
+
+			for (int i = start; i < end; i++) {
+				const uint64_t key = keys_[i];
+				if (key != kInvalidKey) {
+					order_[position[HashKey(key) >> (64 - kPartitionBits)]++] = i;
+				}
+			}
+		}
+	});
+
+	// 2. voxels of each partition
+	cv::parallel_for_(cv::Range(0, kPartitionCount), [&](const cv::Range& range) {
+		for (int p = range.start; p < range.end; p++) {
+			const int start = partition_offset_[p];
+			const int end = partition_offset_[p + 1];
+
+			std::vector<Voxel>& voxels = partition_voxels_[p];
+			std::vector<int>& table = partition_table_[p];
+			voxels.clear();
+
+			// load factor <= 0.5
+			size_t table_size = 16;
+			while (table_size < (size_t)(end - start) * 2) {
+				table_size <<= 1;
+			}
+			const size_t table_mask = table_size - 1;
+			table.assign(table_size, -1);
+
+			for (int k = start; k < end; k++) {
+				const int i = order_[k];
+				const uint64_t key = keys_[i];
+
+				size_t slot = (size_t)HashKey(key) & table_mask;
+				for (;;) {
+					const int index = table[slot];
+					if (index < 0) {
+						Voxel voxel = {};
+						voxel.key = key;
+						voxel.first = i;
+						table[slot] = (int)voxels.size();
+						voxels.push_back(voxel);
+						break;
+					}
+					if (voxels[index].key == key) {
+						break;
+					}
+					slot = (slot + 1) & table_mask;
+				}
+				Voxel& voxel = voxels[table[slot]];
+
+				voxel.count++;
+				if (mode == Mode::kCentroid) {
+					const pcl::PointXYZRGBA& point = points[i];
+					voxel.sum_x += point.x;
+					voxel.sum_y += point.y;
+					voxel.sum_z += point.z;
+					voxel.sum_b += point.b;
+					voxel.sum_g += point.g;
+					voxel.sum_r += point.r;
+					voxel.sum_a += point.a;
+				}
+			}
+		}
+	});
+
+	voxel_offset_.resize(kPartitionCount + 1);
+	int voxel_count = 0;
+	for (int p = 0; p < kPartitionCount; p++) {
+		voxel_offset_[p] = voxel_count;
+		voxel_count += (int)partition_voxels_[p].size();
+	}
+	voxel_offset_[kPartitionCount] = voxel_count;
+
+	// 3. output in the order of the first point of each voxel
+	first_voxel_.assign((size_t)point_count, -1);
+	voxels_.resize((size_t)voxel_count);
+
+	cv::parallel_for_(cv::Range(0, kPartitionCount), [&](const cv::Range& range) {
+		for (int p = range.start; p < range.end; p++) {
+			const std::vector<Voxel>& voxels = partition_voxels_[p];
+			for (int v = 0; v < (int)voxels.size(); v++) {
+				const int number = voxel_offset_[p] + v;
+				first_voxel_[voxels[v].first] = number;
+				voxels_[number] = &voxels[v];
+			}
+		}
+	});
+
+	chunk_output_offset_.resize((size_t)chunk_count + 1);
+	chunk_output_offset_[0] = 0;
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			int count = 0;
+			for (int i = start; i < end; i++) {
+				if (first_voxel_[i] >= 0) {
+					count++;
+				}
+			}
+			chunk_output_offset_[(size_t)c + 1] = count;
+		}
+	});
+
+	for (int c = 0; c < chunk_count; c++) {
+		chunk_output_offset_[(size_t)c + 1] += chunk_output_offset_[c];
+	}
+
+	filtered_cloud->points.resize((size_t)voxel_count);
+	filtered_cloud->width = (uint32_t)voxel_count;
+	filtered_cloud->height = 1;
+	filtered_cloud->is_dense = true;
+	filtered_cloud->header = cloud.header;
+	filtered_cloud->sensor_origin_ = cloud.sensor_origin_;
+	filtered_cloud->sensor_orientation_ = cloud.sensor_orientation_;
+	source_index_.resize((size_t)voxel_count);
+
+	pcl::PointXYZRGBA* dst = filtered_cloud->points.data();
+
+	cv::parallel_for_(cv::Range(0, chunk_count), [&](const cv::Range& range) {
+		for (int c = range.start; c < range.end; c++) {
+			const int start = c * kChunkSize;
+			const int end = (std::min)(start + kChunkSize, point_count);
+
+			int position = chunk_output_offset_[c];
+			for (int i = start; i < end; i++) {
+				const int number = first_voxel_[i];
+				if (number < 0) {
+					continue;
+				}
+
+				pcl::PointXYZRGBA& point = dst[position];
+				if (mode == Mode::kCentroid) {
+					const Voxel& voxel = *voxels_[number];
+					const float inverse_count = 1.0F / voxel.count;
+					const uint32_t half = (uint32_t)voxel.count / 2;
+
+					point.x = voxel.sum_x * inverse_count;
+					point.y = voxel.sum_y * inverse_count;
+					point.z = voxel.sum_z * inverse_count;
+					point.data[3] = 1.0F;
+					point.b = (uint8_t)((voxel.sum_b + half) / (uint32_t)voxel.count);
+					point.g = (uint8_t)((voxel.sum_g + half) / (uint32_t)voxel.count);
+					point.r = (uint8_t)((voxel.sum_r + half) / (uint32_t)voxel.count);
+					point.a = (uint8_t)((voxel.sum_a + half) / (uint32_t)voxel.count);
+				}
+				else {
+					point = points[i];
+				}
+
+				source_index_[position] = i;
+				position++;
+			}
+		}
+	});
+
+	return 0;
+}
+
+/**
+ * 最後の結果の各点に対応する入力の点を取得します.
+ *
+ * @return 入力の点の位置 (各ボクセルの最初の点)
+ */
+const std::vector<int>& PclVoxelGridFilter::GetSourceIndex() const
+{
+	return source_index_;
+}
@@ -0,0 +1,81 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file pcl_voxel_grid_filter.h
+ * @brief Voxel grid down sampling with a hash over the voxel keys.
+ */
+
+#pragma once
+
+/**
+ * @class   PclVoxelGridFilter
+ * @brief   Voxel grid filter class
+ * this class keeps the work buffers and reuses them for every frame
+ */
+class PclVoxelGridFilter {
+public:
+
+	/** @enum  Mode
+	 *  @brief Output point of each voxel
+	 */
+	enum class Mode {
+		kCentroid,		/**< average of the points (xyz and color) */
+		kFirstPoint		/**< first point of the voxel in the input order */
+	};
+
+	PclVoxelGridFilter();
+	~PclVoxelGridFilter();
+
+	int Initialize(const int point_count_max);
+
+	int Terminate();
+
+	int Filter(const double leaf_size, const Mode mode, const pcl::PointCloud<pcl::PointXYZRGBA>& cloud, pcl::PointCloud<pcl::PointXYZRGBA>* filtered_cloud);
+
+	const std::vector<int>& GetSourceIndex() const;
+
+private:
+	static constexpr int kPartitionBits = 6;
+	static constexpr int kPartitionCount = 1 << kPartitionBits;	/**< voxels are split by the hash of the key */
+	static constexpr int kChunkSize = 16384;						/**< points per work unit, fixed so that the result does not depend on the thread count */
+
+	/** @struct  Voxel
+	 *  @brief Accumulation of one voxel
+	 */
+	struct Voxel {
+		uint64_t key;
+		int first;							/**< first point (input index) */
+		int count;
+		float sum_x, sum_y, sum_z;
+		uint32_t sum_b, sum_g, sum_r, sum_a;
+	};
+
+	std::vector<uint64_t> keys_;							/**< voxel key of each point */
+	std::vector<int> chunk_partition_offset_;				/**< chunk x partition, write position in order_ */
+	std::vector<int> partition_offset_;						/**< partition, start position in order_ (kPartitionCount + 1) */
+	std::vector<int> order_;								/**< point index sorted by partition, in input order in each partition */
+
+	std::vector<Voxel> partition_voxels_[kPartitionCount];	/**< voxels of each partition */
+	std::vector<int> partition_table_[kPartitionCount];		/**< open addressing table of each partition (index to partition_voxels_) */
+	std::vector<int> voxel_offset_;							/**< partition, start of its voxels in the output numbering (kPartitionCount + 1) */
+
+	std::vector<int> first_voxel_;							/**< voxel number for the first point of each voxel, -1 for the others */
+	std::vector<int> chunk_output_offset_;					/**< chunk, output position */
+	std::vector<const Voxel*> voxels_;						/**< voxels in the output numbering */
+	std::vector<int> source_index_;							/**< input index of each output point */
+
+	bool key_overflow_;										/**< the last cloud was out of the voxel index range (warned once) */
+
+};
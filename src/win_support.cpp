@@ -289,3 +289,59 @@ int WsOpenFolderDialog(wchar_t* open_folder_name)
 
     return ret;
 }
+
+/**
+ * システムを開始してからの経過時間を取得します
+ *
+ * @return 経過時間 (msec)
+ */
+unsigned long long WsGetTickCount()
+{
+    return GetTickCount64();
+}
+
+/**
+ * ウィンドウを他のウィンドウの前面に表示します. 最前面には固定しません
+ *
+ * @param[in] window_name ウィンドウの名前
+ *
+ */
+void WsBringWindowToTop(const char* window_name)
+{
+    HWND hwnd = FindWindowA(NULL, window_name);
+    if (hwnd == NULL) {
+        return;
+    }
+
+    // 最前面表示の設定と解除
+    SetWindowPos(hwnd, HWND_TOPMOST, 0, 0, 0, 0, (SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW));
+    SetWindowPos(hwnd, HWND_NOTOPMOST, 0, 0, 0, 0, (SWP_NOMOVE | SWP_NOSIZE | SWP_SHOWWINDOW));
+
+    return;
+}
+
+/**
+ * 現在の日時を取得します
+ *
+ * @param[out] year 年
+ * @param[out] month 月
+ * @param[out] day 日
+ * @param[out] hour 時
+ * @param[out] minute 分
+ * @param[out] second 秒
+ *
+ */
+void WsGetLocalTime(int* year, int* month, int* day, int* hour, int* minute, int* second)
+{
+    SYSTEMTIME st = {};
+    GetLocalTime(&st);
+
+    *year = st.wYear;
+    *month = st.wMonth;
+    *day = st.wDay;
+    *hour = st.wHour;
+    *minute = st.wMinute;
+    *second = st.wSecond;
+
+    return;
+}
@@ -48,3 +48,18 @@ int WsOpenFileDialog(wchar_t* initial_folder, wchar_t* open_file_name);
     @return 0, if successful.
  */
 int WsOpenFolderDialog(wchar_t* open_folder_name);
+
+/** @brief Gets the number of milliseconds since the system was started.
+    @return milliseconds.
+ */
+unsigned long long WsGetTickCount();
+
+/** @brief Brings the window to the top of the other windows, without making it topmost.
+    @return none
+ */
+void WsBringWindowToTop(const char* window_name);
+
+/** @brief Gets the current local date and time.
+    @return none
+ */
+void WsGetLocalTime(int* year, int* month, int* day, int* hour, int* minute, int* second);
@@ -0,0 +1,201 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file bench_pcl_point_cloud_builder.cpp
+ * @brief Measures the projection of the scalar and SIMD kernels for the camera sizes.
+ * @version 0.1
+ *
+ * @details A random disparity of the VM, XC and 4K sizes is built with both kernels on one thread,
+ *  the mean time of the builds and the number of points which differ between the kernels are printed.
+ *  It is not a test, run it on a quiet machine: bench_pcl_point_cloud_builder [build count]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_cloud_buffer_pool.h"
+#include "pcl_point_cloud_builder.h"
+
+/**
+ * 試験用の視差と画像を作成します.
+ *
+ * @param[in] width 幅
+ * @param[in] height 高さ
+ * @param[out] base_image 画像
+ * @param[out] heat_image 視差の色
+ * @param[out] depth_data 視差
+ *
+ * @return none.
+ */
+static void MakeInput(const int width, const int height, cv::Mat* base_image, cv::Mat* heat_image, cv::Mat* depth_data)
+{
+	uint32_t seed = 12345;
+	auto next = [&seed]() {
+		seed = (seed * 1103515245) + 12345;
+		return (seed >> 8) & 0xFFFF;
+	};
+
+	*depth_data = cv::Mat(height, width, CV_32F);
+	for (int i = 0; i < height; i++) {
+		float* row = depth_data->ptr<float>(i);
+		for (int j = 0; j < width; j++) {
+			// about one pixel in eight has no disparity
+			row[j] = ((next() % 8) == 0) ? 0.0F : 1.0F + ((float)next() / 65535.0F) * 120.0F;
+		}
+	}
+
+	*base_image = cv::Mat(height, width, CV_8UC1);
+	for (int i = 0; i < height; i++) {
+		unsigned char* row = base_image->ptr<unsigned char>(i);
+		for (int j = 0; j < width; j++) {
+			row[j] = (unsigned char)next();
+		}
+	}
+
+	*heat_image = cv::Mat(height, width, CV_8UC4);
+	memset(heat_image->data, 0, (size_t)width * height * 4);
+
+	return;
+}
+
+/**
+ * 1つの kernel の作成時間を計測します.
+ *
+ * @param[in] projection_kernel kernel
+ * @param[in] build_parameter 点群作成のパラメータ
+ * @param[in] build_count 計測する作成の回数
+ * @param[in] base_image 画像
+ * @param[in] heat_image 視差の色
+ * @param[in] depth_data 視差
+ * @param[out] points 作成した点群 (最後の1回)
+ *
+ * @return 1回の平均時間 (ms). 失敗した場合は負の値
+ */
+static double MeasureKernel(const PclPointCloudBuilder::ProjectionKernel projection_kernel, const PclPointCloudBuilder::BuildParameter& build_parameter, const int build_count,
+							cv::Mat& base_image, cv::Mat& heat_image, cv::Mat& depth_data, std::vector<pcl::PointXYZRGBA>* points)
+{
+	PclPointCloudBuilder builder;
+	builder.Initialize(build_parameter.width, build_parameter.height);
+	builder.SetProjectionKernel(projection_kernel);
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud;
+
+	// the first build sets up the tables and touches the buffers
+	if (builder.Build(build_parameter, base_image, heat_image, depth_data, &cloud) != 0) {
+		builder.Terminate();
+		return -1.0;
+	}
+	cloud.reset();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < build_count; i++) {
+		builder.Build(build_parameter, base_image, heat_image, depth_data, &cloud);
+
+		// the builder writes the other buffer when the viewer holds the cloud, as in the application
+		cloud.reset();
+	}
+	const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / build_count;
+
+	builder.Build(build_parameter, base_image, heat_image, depth_data, &cloud);
+	points->assign(cloud->points.begin(), cloud->points.end());
+	cloud.reset();
+
+	builder.Terminate();
+
+	return time;
+}
+
+int main(int argc, char* argv[])
+{
+	const int build_count = (argc > 1) ? (std::max)(1, atoi(argv[1])) : 20;
+
+	struct CameraSize {
+		const char* name;
+		int width, height;
+	};
+	const CameraSize camera_sizes[] = {
+		{ "VM", 752, 480 },
+		{ "XC", 1280, 720 },
+		{ "4K", 3840, 1920 },
+	};
+
+#if defined(__AVX2__)
+	const char* simd_name = "AVX2";
+#else
+	const char* simd_name = "SSE2";
+#endif
+
+	printf("mean of %d builds, one thread, scalar vs %s\n", build_count, simd_name);
+
+	int failed = 0;
+	for (const CameraSize& camera_size : camera_sizes) {
+		cv::Mat base_image, heat_image, depth_data;
+		MakeInput(camera_size.width, camera_size.height, &base_image, &heat_image, &depth_data);
+
+		PclPointCloudBuilder::BuildParameter build_parameter = {};
+		build_parameter.width					= camera_size.width;
+		build_parameter.height					= camera_size.height;
+		build_parameter.d_inf					= 1.0;
+		build_parameter.base_length				= 0.1;
+		build_parameter.bf						= 60.0;
+		build_parameter.min_distance			= 0.1;
+		build_parameter.max_distance			= 20.0;
+		build_parameter.color_sampling			= PclPointCloudBuilder::ColorSampling::kNearest;
+		build_parameter.output_frame			= PclPointCloudBuilder::OutputFrame::kCamera;
+		build_parameter.lod_mode				= PclPointCloudBuilder::LodMode::kOff;
+		build_parameter.lod_step				= 1;
+		for (int k = 0; k < 16; k++) {
+			build_parameter.extrinsic[k] = (k % 5 == 0) ? 1.0 : 0.0;
+		}
+
+		std::vector<pcl::PointXYZRGBA> points_scalar, points_simd;
+		const double time_scalar = MeasureKernel(PclPointCloudBuilder::ProjectionKernel::kScalar, build_parameter, build_count, base_image, heat_image, depth_data, &points_scalar);
+		const double time_simd = MeasureKernel(PclPointCloudBuilder::ProjectionKernel::kSimd, build_parameter, build_count, base_image, heat_image, depth_data, &points_simd);
+		if (time_scalar < 0 || time_simd < 0) {
+			printf("%s %dx%d: Build failed\n", camera_size.name, camera_size.width, camera_size.height);
+			failed++;
+			continue;
+		}
+
+		int mismatch = 0;
+		if (points_scalar.size() != points_simd.size()) {
+			mismatch = -1;
+		}
+		else {
+			for (size_t i = 0; i < points_scalar.size(); i++) {
+				if (memcmp(points_scalar[i].data, points_simd[i].data, sizeof(points_scalar[i].data)) != 0 || points_scalar[i].rgba != points_simd[i].rgba) {
+					mismatch++;
+				}
+			}
+		}
+		if (mismatch != 0) {
+			failed++;
+		}
+
+		printf("%s %dx%d: scalar %.2f ms, %s %.2f ms, %d mismatching points\n",
+			camera_size.name, camera_size.width, camera_size.height, time_scalar, simd_name, time_simd, mismatch);
+	}
+
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file test_pcl_build_slot_queue.cpp
+ * @brief Checks the slot queue between the stage threads.
+ * @version 0.1
+ *
+ * @details The slots are passed around a ring of a build and a filter thread as in pcl_support,
+ *  each slot is checked to be held by one thread only and the frames to stay in order.
+ *  Close must release a thread waiting on an empty queue.
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "pcl_build_slot_queue.h"
+
+namespace {
+
+constexpr int kSlotCount = 3;
+constexpr int kFrameCount = 100000;
+
+std::atomic<int> slot_frames[kSlotCount];	/**< frame built into each slot, 0:free */
+std::atomic<int> errors(0);
+
+/**
+ * 各フレームをスロットに作成して次の段に渡します.
+ *
+ * @param[in] free_slot_queue 空いているスロット
+ * @param[in] built_slot_queue 作成したスロット
+ *
+ * @return none.
+ */
+void Build(PclBuildSlotQueue* free_slot_queue, PclBuildSlotQueue* built_slot_queue)
+{
+	for (int frame_no = 1; frame_no <= kFrameCount; frame_no++) {
+		int slot = -1;
+		if (free_slot_queue->Pop(&slot) != 0) {
+			printf("[FAIL] free queue is closed\n");
+			errors++;
+			return;
+		}
+
+		int expected = 0;
+		if (!slot_frames[slot].compare_exchange_strong(expected, frame_no)) {
+			printf("[FAIL] slot %d is still used by frame %d\n", slot, expected);
+			errors++;
+		}
+
+		if (built_slot_queue->Push(slot) != 0) {
+			printf("[FAIL] built queue is closed\n");
+			errors++;
+			return;
+		}
+	}
+
+	return;
+}
+
+/**
+ * 作成したスロットを順に取り出して空きに戻します.
+ *
+ * @param[in] free_slot_queue 空いているスロット
+ * @param[in] built_slot_queue 作成したスロット
+ *
+ * @return none.
+ */
+void Filter(PclBuildSlotQueue* free_slot_queue, PclBuildSlotQueue* built_slot_queue)
+{
+	for (int frame_no = 1; frame_no <= kFrameCount; frame_no++) {
+		int slot = -1;
+		if (built_slot_queue->Pop(&slot) != 0) {
+			printf("[FAIL] built queue is closed\n");
+			errors++;
+			return;
+		}
+
+		const int slot_frame_no = slot_frames[slot].exchange(0);
+		if (slot_frame_no != frame_no) {
+			printf("[FAIL] frame %d is in slot %d, %d is expected\n", slot_frame_no, slot, frame_no);
+			errors++;
+		}
+
+		if (free_slot_queue->Push(slot) != 0) {
+			printf("[FAIL] free queue is closed\n");
+			errors++;
+			return;
+		}
+	}
+
+	return;
+}
+
+}
+
+int main()
+{
+	PclBuildSlotQueue free_slot_queue;
+	PclBuildSlotQueue built_slot_queue;
+	free_slot_queue.Initialize(kSlotCount);
+	built_slot_queue.Initialize(kSlotCount);
+
+	for (int i = 0; i < kSlotCount; i++) {
+		slot_frames[i].store(0);
+		free_slot_queue.Push(i);
+	}
+
+	std::thread filter_thread(Filter, &free_slot_queue, &built_slot_queue);
+	std::thread build_thread(Build, &free_slot_queue, &built_slot_queue);
+	build_thread.join();
+	filter_thread.join();
+
+	// every slot is free again
+	for (int i = 0; i < kSlotCount; i++) {
+		int slot = -1;
+		if (free_slot_queue.Pop(&slot) != 0 || slot_frames[slot].load() != 0) {
+			printf("[FAIL] slot %d is not free\n", slot);
+			errors++;
+		}
+	}
+
+	// a thread waiting on the empty queue is released by Close
+	int close_ret = 0;
+	std::thread waiting_thread([&built_slot_queue, &close_ret]() {
+		int slot = -1;
+		close_ret = built_slot_queue.Pop(&slot);
+	});
+	built_slot_queue.Close();
+	waiting_thread.join();
+	if (close_ret != -1) {
+		printf("[FAIL] Pop returned %d after Close\n", close_ret);
+		errors++;
+	}
+
+	// Clear opens the queue again
+	built_slot_queue.Clear();
+	int slot = -1;
+	if (built_slot_queue.Push(1) != 0 || built_slot_queue.Pop(&slot) != 0 || slot != 1) {
+		printf("[FAIL] the queue is not usable after Clear\n");
+		errors++;
+	}
+
+	free_slot_queue.Terminate();
+	built_slot_queue.Terminate();
+
+	printf("%s\n", errors.load() == 0 ? "passed" : "failed");
+
+	return (errors.load() == 0) ? 0 : 1;
+}
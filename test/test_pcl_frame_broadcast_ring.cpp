@@ -0,0 +1,155 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file test_pcl_frame_broadcast_ring.cpp
+ * @brief Checks the broadcast ring with a lagging kLossless consumer.
+ * @version 0.1
+ *
+ * @details The pool is sized as in gui_support (the frame being written, the triple buffer, the ring and
+ *  one frame held by each consumer). A kLossless consumer which reads every frame, a kLossless consumer which
+ *  stops reading and a kLatestOnly consumer are registered. The producer must always get a frame of the pool,
+ *  the lagging consumer drops its own oldest frames and the other consumers are not affected.
+ */
+
+#include <stdio.h>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "pcl_def.h"
+
+#include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
+#include "pcl_frame_broadcast_ring.h"
+
+namespace {
+
+constexpr int kTripleBufferCount = 3;
+constexpr int kFrameCount = 1000;
+constexpr int kLagFrameCount = 100;		/**< the lagging consumer stops reading after this frame */
+
+int errors = 0;
+
+/**
+ * フレームを読み出して番号を確認します.
+ *
+ * @param[in] ring Ring
+ * @param[in] consumer_id Consumer の番号
+ * @param[in] frame_no 期待するフレームの番号
+ * @param[in] name Consumer の名前
+ *
+ * @return none.
+ */
+void ReadFrame(PclFrameBroadcastRing* ring, const int consumer_id, const int frame_no, const char* name)
+{
+	PclFrame* frame = nullptr;
+	if (ring->Get(consumer_id, 0, &frame) != 0) {
+		printf("[FAIL] %s: no frame %d\n", name, frame_no);
+		errors++;
+		return;
+	}
+
+	if (frame->pcl_data.frame_no != frame_no) {
+		printf("[FAIL] %s: frame %d, %d is expected\n", name, frame->pcl_data.frame_no, frame_no);
+		errors++;
+	}
+	PclFramePool::Release(frame);
+
+	return;
+}
+
+}
+
+int main()
+{
+	PclFramePool pool;
+	pool.Initialize(1 + kTripleBufferCount + kPCL_FRAME_RING_DEPTH + kPCL_FRAME_CONSUMER_MAX);
+
+	PclFrameBroadcastRing ring;
+	ring.Initialize(kPCL_FRAME_RING_DEPTH, kPCL_FRAME_CONSUMER_MAX + 1);
+
+	const int lossless_id = ring.AddConsumer(PclFrameBroadcastRing::Policy::kLossless);
+	const int lagging_id = ring.AddConsumer(PclFrameBroadcastRing::Policy::kLossless);
+	const int latest_id = ring.AddConsumer(PclFrameBroadcastRing::Policy::kLatestOnly);
+
+	// frames held by the triple buffer
+	PclFrame* held_frames[kTripleBufferCount] = {};
+
+	for (int frame_no = 1; frame_no <= kFrameCount; frame_no++) {
+		PclFrame* frame = pool.Acquire();
+		if (frame == nullptr) {
+			printf("[FAIL] no free frame for frame %d\n", frame_no);
+			errors++;
+			break;
+		}
+		frame->pcl_data.frame_no = frame_no;
+
+		if (ring.Put(frame) != 0) {
+			printf("[FAIL] frame %d is not put\n", frame_no);
+			errors++;
+		}
+
+		// the triple buffer keeps the reference of the producer
+		PclFrame** held_frame = &held_frames[frame_no % kTripleBufferCount];
+		PclFramePool::Release(*held_frame);
+		*held_frame = frame;
+
+		ReadFrame(&ring, lossless_id, frame_no, "lossless");
+		if (frame_no <= kLagFrameCount) {
+			ReadFrame(&ring, lagging_id, frame_no, "lagging");
+		}
+		if ((frame_no % 7) == 0) {
+			ReadFrame(&ring, latest_id, frame_no, "latest");
+		}
+	}
+
+	// the lagging consumer reads the frames the ring kept for it
+	const int first_kept_frame_no = kFrameCount - kPCL_FRAME_RING_DEPTH + 1;
+	for (int frame_no = first_kept_frame_no; frame_no <= kFrameCount; frame_no++) {
+		ReadFrame(&ring, lagging_id, frame_no, "lagging");
+	}
+
+	const long long lagging_skipped_count = ring.GetSkippedCount(lagging_id);
+	if (lagging_skipped_count != first_kept_frame_no - kLagFrameCount - 1) {
+		printf("[FAIL] lagging: %lld frames skipped, %d are expected\n", lagging_skipped_count, first_kept_frame_no - kLagFrameCount - 1);
+		errors++;
+	}
+	if (ring.GetSkippedCount(lossless_id) != 0 || ring.GetDroppedCount() != 0) {
+		printf("[FAIL] lossless: %lld frames skipped, %lld frames dropped\n", ring.GetSkippedCount(lossless_id), ring.GetDroppedCount());
+		errors++;
+	}
+
+	for (int i = 0; i < kTripleBufferCount; i++) {
+		PclFramePool::Release(held_frames[i]);
+	}
+	ring.RemoveConsumer(lossless_id);
+	ring.RemoveConsumer(lagging_id);
+	ring.RemoveConsumer(latest_id);
+	ring.Terminate();
+
+	// every reference is released
+	for (int i = 0; i < pool.GetCount(); i++) {
+		if (pool.GetFrame(i)->reference_count.load() != 0) {
+			printf("[FAIL] frame %d of the pool is still referenced\n", i);
+			errors++;
+		}
+	}
+	pool.Terminate();
+
+	printf("%s\n", errors == 0 ? "passed" : "failed");
+
+	return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file test_pcl_frame_triple_buffer.cpp
+ * @brief Checks the triple buffer with one producer and one consumer thread.
+ * @version 0.1
+ *
+ * @details The producer writes the frame number into the whole buffer and publishes it as fast as it can,
+ *  the consumer takes the latest frame at the same time. Each buffer is marked by the thread which holds it
+ *  (the consumer holds the buffer it read until it takes the next one), a buffer held by both threads is an error. The consumer checks that the frame is complete (one number
+ *  everywhere) and newer than the last one it got.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "pcl_def.h"
+
+#include "pcl_data_ring_buffer.h"
+#include "pcl_frame_pool.h"
+#include "pcl_frame_triple_buffer.h"
+
+namespace {
+
+constexpr int kWidth = 64;
+constexpr int kHeight = 48;
+constexpr int kFrameCount = 200000;
+constexpr int kBufferCount = 3;
+
+constexpr int kOwnerNone = 0;
+constexpr int kOwnerProducer = 1;
+constexpr int kOwnerConsumer = 2;
+
+std::atomic<int> owners[kBufferCount];		/**< thread which holds each buffer */
+std::atomic<int> errors(0);
+
+/**
+ * バッファーの所有を記録します.
+ *
+ * @param[in] index バッファーのIndex
+ * @param[in] owner 所有するスレッド
+ *
+ * @return none.
+ */
+void Take(const int index, const int owner)
+{
+	int expected = kOwnerNone;
+	if (index < 0 || index >= kBufferCount || !owners[index].compare_exchange_strong(expected, owner)) {
+		printf("[FAIL] buffer %d is taken by %d, held by %d\n", index, owner, expected);
+		errors++;
+	}
+
+	return;
+}
+
+/**
+ * バッファーの所有を解除します.
+ *
+ * @param[in] index バッファーのIndex
+ *
+ * @return none.
+ */
+void Give(const int index)
+{
+	owners[index].store(kOwnerNone);
+
+	return;
+}
+
+/**
+ * フレームを書き込みます.
+ *
+ * @param[in] frame_buffer バッファー
+ *
+ * @return none.
+ */
+void Produce(PclFrameTripleBuffer* frame_buffer)
+{
+	for (int frame_no = 1; frame_no <= kFrameCount; frame_no++) {
+		PclFrameTripleBuffer::BufferData* buffer_data = nullptr;
+		const int index = frame_buffer->GetPutBuffer(&buffer_data, (std::uint64_t)frame_no);
+		if (index < 0) {
+			printf("[FAIL] GetPutBuffer %d\n", index);
+			errors++;
+			return;
+		}
+		Take(index, kOwnerProducer);
+
+		buffer_data->pcl_data.frame_no = frame_no;
+		float* disparity_data = buffer_data->pcl_data.disparity_data;
+		for (int i = 0; i < kWidth * kHeight; i++) {
+			disparity_data[i] = (float)frame_no;
+		}
+
+		Give(index);
+		if (frame_buffer->DonePutBuffer(index, 1) != 0) {
+			printf("[FAIL] DonePutBuffer %d\n", index);
+			errors++;
+			return;
+		}
+
+		if ((frame_no % 4) == 0) {
+			// the consumer runs between the frames on a single core as well
+			std::this_thread::yield();
+		}
+	}
+
+	return;
+}
+
+/**
+ * 最新のフレームを読み込みます.
+ *
+ * @param[in] frame_buffer バッファー
+ * @param[in] done 書き込みの終了
+ * @param[out] read_count 読み込んだフレームの数
+ *
+ * @return none.
+ */
+void Consume(PclFrameTripleBuffer* frame_buffer, const std::atomic<bool>* done, int* read_count)
+{
+	int last_frame_no = 0;
+	int held_index = -1;
+	*read_count = 0;
+
+	for (;;) {
+		// the last frame is published before done is set
+		const bool last = done->load();
+
+		// the buffer read last is held by the consumer until the next one is taken
+		if (held_index >= 0) {
+			Give(held_index);
+		}
+
+		PclFrameTripleBuffer::BufferData* buffer_data = nullptr;
+		std::uint64_t time = 0;
+		const int index = frame_buffer->GetGetBuffer(&buffer_data, &time);
+		if (index < 0) {
+			if (held_index >= 0) {
+				Take(held_index, kOwnerConsumer);
+			}
+			if (last) {
+				break;
+			}
+			std::this_thread::yield();
+			continue;
+		}
+		Take(index, kOwnerConsumer);
+		held_index = index;
+
+		const int frame_no = buffer_data->pcl_data.frame_no;
+		if (frame_no <= last_frame_no || time != (std::uint64_t)frame_no) {
+			printf("[FAIL] frame %d (time %llu) after frame %d\n", frame_no, (unsigned long long)time, last_frame_no);
+			errors++;
+		}
+		const float* disparity_data = buffer_data->pcl_data.disparity_data;
+		for (int i = 0; i < kWidth * kHeight; i++) {
+			if (disparity_data[i] != (float)frame_no) {
+				printf("[FAIL] frame %d has data of frame %d\n", frame_no, (int)disparity_data[i]);
+				errors++;
+				break;
+			}
+		}
+		last_frame_no = frame_no;
+		(*read_count)++;
+
+		frame_buffer->DoneGetBuffer(index);
+	}
+
+	if (last_frame_no != kFrameCount) {
+		printf("[FAIL] the last frame is %d, not %d\n", last_frame_no, kFrameCount);
+		errors++;
+	}
+
+	return;
+}
+
+}
+
+int main()
+{
+	PclFrameTripleBuffer frame_buffer;
+	if (frame_buffer.Initialize(kWidth, kHeight) != 0) {
+		printf("[FAIL] Initialize\n");
+		return 1;
+	}
+
+	for (int i = 0; i < kBufferCount; i++) {
+		owners[i].store(kOwnerNone);
+	}
+
+	std::atomic<bool> done(false);
+	int read_count = 0;
+	std::thread consumer(Consume, &frame_buffer, &done, &read_count);
+	std::thread producer([&frame_buffer, &done]() {
+		Produce(&frame_buffer);
+		done.store(true);
+	});
+
+	producer.join();
+	consumer.join();
+
+	frame_buffer.Terminate();
+
+	printf("%d frames written, %d frames read\n", kFrameCount, read_count);
+	printf("%s\n", errors.load() == 0 ? "passed" : "failed");
+
+	return (errors.load() == 0) ? 0 : 1;
+}
@@ -0,0 +1,267 @@
+﻿// Copyright 2023 ITD Lab Corp.All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http ://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file test_pcl_point_cloud_builder.cpp
+ * @brief Checks that the scalar and SIMD projection kernels give the same point cloud.
+ * @version 0.1
+ *
+ * @details A synthetic disparity image (valid, out of range, below d_inf and zero values) is built with
+ *  both kernels for each image format, colour source (same size, 2x nearest/bilinear, heat map) and output mode.
+ *  The points must match bit for bit.
+ *  The widths are not multiples of 8 so the scalar tail of the SIMD kernel is used as well.
+ *  The two builders share a cloud buffer pool, the second build must not write the cloud of the first one.
+ *  It is built for SSE2 and for AVX2, the AVX2 build is skipped (77) on a CPU without AVX2.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "opencv2/opencv.hpp"
+
+#include "pcl_cloud_buffer_pool.h"
+#include "pcl_point_cloud_builder.h"
+
+#if defined(__AVX2__) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * SIMD kernel の命令を CPU が実行できるか確認します.
+ *
+ * @retval true 実行できます
+ * @retval false 実行できません
+ */
+static bool IsSimdSupported()
+{
+#if defined(__AVX2__) && defined(_MSC_VER)
+	int cpu_info[4] = {};
+	__cpuid(cpu_info, 0);
+	if (cpu_info[0] < 7) {
+		return false;
+	}
+	__cpuidex(cpu_info, 7, 0);
+	return (cpu_info[1] & (1 << 5)) != 0;
+#elif defined(__AVX2__)
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	// SSE2 is in every x64 CPU
+	return true;
+#endif
+}
+
+/**
+ * 試験用の視差と画像を作成します.
+ *
+ * @param[in] width 幅
+ * @param[in] height 高さ
+ * @param[in] image_type base_image の型
+ * @param[in] image_scale base_image の拡大率
+ * @param[out] base_image 画像
+ * @param[out] heat_image 視差の色
+ * @param[out] depth_data 視差
+ *
+ * @return none.
+ */
+static void MakeInput(const int width, const int height, const int image_type, const int image_scale, cv::Mat* base_image, cv::Mat* heat_image, cv::Mat* depth_data)
+{
+	uint32_t seed = 12345;
+	auto next = [&seed]() {
+		seed = (seed * 1103515245) + 12345;
+		return (seed >> 8) & 0xFFFF;
+	};
+
+	*depth_data = cv::Mat(height, width, CV_32F);
+	for (int i = 0; i < height; i++) {
+		float* row = depth_data->ptr<float>(i);
+		for (int j = 0; j < width; j++) {
+			const int select = next() % 16;
+			if (select == 0) {
+				row[j] = 0;
+			}
+			else if (select == 1) {
+				row[j] = 0.5F;		// below d_inf
+			}
+			else if (select == 2) {
+				row[j] = 250.0F;	// too near
+			}
+			else {
+				row[j] = 1.0F + ((float)next() / 65535.0F) * 120.0F;
+			}
+		}
+	}
+
+	*base_image = cv::Mat(height * image_scale, width * image_scale, image_type);
+	for (int i = 0; i < base_image->rows; i++) {
+		unsigned char* row = base_image->ptr<unsigned char>(i);
+		for (int j = 0; j < base_image->cols * base_image->channels(); j++) {
+			row[j] = (unsigned char)next();
+		}
+	}
+
+	*heat_image = cv::Mat(height, width, CV_8UC4);
+	for (int i = 0; i < height; i++) {
+		unsigned char* row = heat_image->ptr<unsigned char>(i);
+		for (int j = 0; j < width * 4; j++) {
+			row[j] = (unsigned char)next();
+		}
+	}
+
+	return;
+}
+
+/**
+ * 1条件について scalar と SIMD の結果を比較します.
+ *
+ * @param[in] name 条件の名前
+ * @param[in] build_parameter 点群作成のパラメータ
+ * @param[in] base_image 画像
+ * @param[in] heat_image 視差の色
+ * @param[in] depth_data 視差
+ *
+ * @retval 0 一致
+ * @retval -1 不一致
+ */
+static int CompareKernels(const char* name, const PclPointCloudBuilder::BuildParameter& build_parameter, cv::Mat& base_image, cv::Mat& heat_image, cv::Mat& depth_data)
+{
+	// the builders share the clouds as the build slots do, a cloud still held must not be written
+	PclCloudBufferPool cloud_pool;
+	cloud_pool.Initialize(2);
+
+	PclPointCloudBuilder builder_scalar, builder_simd;
+	builder_scalar.Initialize(build_parameter.width, build_parameter.height);
+	builder_simd.Initialize(build_parameter.width, build_parameter.height);
+	builder_scalar.SetCloudBufferPool(&cloud_pool);
+	builder_simd.SetCloudBufferPool(&cloud_pool);
+	builder_scalar.SetProjectionKernel(PclPointCloudBuilder::ProjectionKernel::kScalar);
+	builder_simd.SetProjectionKernel(PclPointCloudBuilder::ProjectionKernel::kSimd);
+
+	pcl::PointCloud<pcl::PointXYZRGBA>::Ptr cloud_scalar, cloud_simd;
+	if (builder_scalar.Build(build_parameter, base_image, heat_image, depth_data, &cloud_scalar) != 0 ||
+		builder_simd.Build(build_parameter, base_image, heat_image, depth_data, &cloud_simd) != 0) {
+		printf("[FAIL] %s: Build failed\n", name);
+		return -1;
+	}
+
+	int ret = 0;
+	if (cloud_scalar == cloud_simd) {
+		printf("[FAIL] %s: both builds are in the same cloud\n", name);
+		ret = -1;
+	}
+	else if (cloud_scalar->size() != cloud_simd->size() || cloud_scalar->width != cloud_simd->width || cloud_scalar->height != cloud_simd->height) {
+		printf("[FAIL] %s: size %d != %d\n", name, (int)cloud_scalar->size(), (int)cloud_simd->size());
+		ret = -1;
+	}
+	else {
+		int mismatch = 0;
+		for (size_t i = 0; i < cloud_scalar->size(); i++) {
+			const pcl::PointXYZRGBA& a = cloud_scalar->points[i];
+			const pcl::PointXYZRGBA& b = cloud_simd->points[i];
+			if (memcmp(a.data, b.data, sizeof(a.data)) != 0 || a.rgba != b.rgba) {
+				if (mismatch == 0) {
+					printf("[FAIL] %s: point %d (%.9g %.9g %.9g %08x) != (%.9g %.9g %.9g %08x)\n", name, (int)i, a.x, a.y, a.z, a.rgba, b.x, b.y, b.z, b.rgba);
+				}
+				mismatch++;
+			}
+		}
+		if (build_parameter.dense && builder_scalar.GetPixelIndex() != builder_simd.GetPixelIndex()) {
+			printf("[FAIL] %s: pixel index\n", name);
+			mismatch++;
+		}
+		if (mismatch != 0) {
+			ret = -1;
+		}
+	}
+
+	if (ret == 0) {
+		printf("[ OK ] %s: %d points\n", name, (int)cloud_scalar->size());
+	}
+
+	builder_scalar.Terminate();
+	builder_simd.Terminate();
+	cloud_pool.Terminate();
+
+	return ret;
+}
+
+int main()
+{
+	if (!IsSimdSupported()) {
+		printf("skipped, the CPU does not support the SIMD kernel\n");
+		return 77;
+	}
+
+	struct ImageFormat {
+		const char* name;
+		int image_type;
+		bool heat;
+	};
+	const ImageFormat image_formats[] = {
+		{ "mono", CV_8UC1, false },
+		{ "bgr", CV_8UC3, false },
+		{ "bgra", CV_8UC4, false },
+		{ "heat", CV_8UC3, true },
+	};
+	const int sizes[][2] = { { 101, 37 }, { 755, 483 } };
+
+	int failed = 0;
+	for (const auto& size : sizes) {
+		for (const int image_scale : { 1, 2 }) {
+			for (const ImageFormat& image_format : image_formats) {
+				cv::Mat base_image, heat_image, depth_data;
+				MakeInput(size[0], size[1], image_format.image_type, image_scale, &base_image, &heat_image, &depth_data);
+
+				for (const bool dense : { false, true }) {
+					for (const bool tilt : { false, true }) {
+						PclPointCloudBuilder::BuildParameter build_parameter = {};
+						build_parameter.width					= size[0];
+						build_parameter.height					= size[1];
+						build_parameter.d_inf					= 1.0;
+						build_parameter.base_length				= 0.1;
+						build_parameter.bf						= 60.0;
+						build_parameter.angle					= tilt ? 15.0 : 0.0;
+						build_parameter.min_distance			= 0.1;
+						build_parameter.max_distance			= 20.0;
+						build_parameter.pass_through			= tilt;
+						build_parameter.pass_through_min		= 0.5;
+						build_parameter.pass_through_max		= 10.0;
+						build_parameter.image_source_depth_heat	= image_format.heat;
+						build_parameter.color_sampling			= tilt ? PclPointCloudBuilder::ColorSampling::kBilinear : PclPointCloudBuilder::ColorSampling::kNearest;
+						build_parameter.dense					= dense;
+						build_parameter.output_frame			= tilt ? PclPointCloudBuilder::OutputFrame::kRos : PclPointCloudBuilder::OutputFrame::kCamera;
+						build_parameter.lod_mode				= PclPointCloudBuilder::LodMode::kOff;
+						build_parameter.lod_step				= 1;
+						for (int k = 0; k < 16; k++) {
+							build_parameter.extrinsic[k] = (k % 5 == 0) ? 1.0 : 0.0;
+						}
+
+						char name[128] = {};
+						snprintf(name, sizeof(name), "%dx%d x%d %s %s %s", size[0], size[1], image_scale, image_format.name, dense ? "dense" : "organized", tilt ? "tilt" : "level");
+						if (CompareKernels(name, build_parameter, base_image, heat_image, depth_data) != 0) {
+							failed++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	printf("%s\n", failed == 0 ? "passed" : "failed");
+
+	return (failed == 0) ? 0 : 1;
+}